@@ -320,6 +320,18 @@ static inline int pte_present(pte_t a)
 	return pte_flags(a) & (_PAGE_PRESENT | _PAGE_PROTNONE);
 }
 
+#define __HAVE_ARCH_PTE_NUMA
+/*
+ * NUMA hinting faults: the pte of a page in an accessible vma was made
+ * PROT_NONE by the NUMA balancing scanner.  Such a pte is present to the
+ * core VM but not to the hardware, so the next access faults.
+ */
+static inline int pte_numa(pte_t pte)
+{
+	return (pte_flags(pte) & (_PAGE_PRESENT | _PAGE_PROTNONE)) ==
+		_PAGE_PROTNONE;
+}
+
 static inline int pte_hidden(pte_t pte)
 {
 	return pte_flags(pte) & _PAGE_HIDDEN;
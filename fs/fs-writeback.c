@@ -150,6 +150,22 @@ static void wb_clear_pending(struct bdi_writeback *wb, struct bdi_work *work)
 	}
 }
 
+static void bdi_wakeup_flusher(struct backing_dev_info *bdi)
+{
+	/*
+	 * If the default thread isn't there, make sure we add it. When
+	 * it gets created and wakes up, we'll run the pending work.
+	 */
+	if (unlikely(list_empty_careful(&bdi->wb_list)))
+		wake_up_process(default_backing_dev_info.wb.task);
+	else {
+		struct bdi_writeback *wb = &bdi->wb;
+
+		if (wb->task)
+			wake_up_process(wb->task);
+	}
+}
+
 static void bdi_queue_work(struct backing_dev_info *bdi, struct bdi_work *work)
 {
 	work->seen = bdi->wb_mask;
@@ -166,18 +182,7 @@ static void bdi_queue_work(struct backing_dev_info *bdi, struct bdi_work *work)
 	list_add_tail_rcu(&work->list, &bdi->work_list);
 	spin_unlock(&bdi->wb_lock);
 
-	/*
-	 * If the default thread isn't there, make sure we add it. When
-	 * it gets created and wakes up, we'll run this work.
-	 */
-	if (unlikely(list_empty_careful(&bdi->wb_list)))
-		wake_up_process(default_backing_dev_info.wb.task);
-	else {
-		struct bdi_writeback *wb = &bdi->wb;
-
-		if (wb->task)
-			wake_up_process(wb->task);
-	}
+	bdi_wakeup_flusher(bdi);
 }
 
 /*
@@ -272,6 +277,21 @@ void bdi_start_writeback(struct backing_dev_info *bdi, struct super_block *sb,
 	bdi_alloc_queue_work(bdi, &args);
 }
 
+/**
+ * bdi_start_background_writeback - start background writeback
+ * @bdi: the backing device to write from
+ *
+ * Description:
+ *   This makes sure the flusher thread of @bdi is running; it writes back
+ *   dirty data until we are below the background dirty threshold.  Unlike
+ *   bdi_start_writeback() no work item is queued, so this is cheap enough
+ *   to be called by every task throttled in balance_dirty_pages().
+ */
+void bdi_start_background_writeback(struct backing_dev_info *bdi)
+{
+	bdi_wakeup_flusher(bdi);
+}
+
 /*
  * Redirty an inode: set its when-it-was dirtied timestamp and move it to the
  * furthest end of its superblock's dirty-inode list.
@@ -759,6 +779,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		.range_cyclic		= args->range_cyclic,
 	};
 	unsigned long oldest_jif;
+	unsigned long wb_start = jiffies;
 	long wrote = 0;
 	struct inode *inode;
 
@@ -786,6 +807,8 @@ static long wb_writeback(struct bdi_writeback *wb,
 		if (args->for_background && !over_bground_thresh())
 			break;
 
+		bdi_update_bandwidth(wb->bdi, wb_start);
+
 		wbc.more_io = 0;
 		wbc.encountered_congestion = 0;
 		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
@@ -889,6 +912,26 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 	return 0;
 }
 
+/*
+ * Tasks throttled in balance_dirty_pages() only wake us up instead of
+ * queueing work, so check the background threshold ourselves.
+ */
+static long wb_check_background_flush(struct bdi_writeback *wb)
+{
+	if (over_bground_thresh()) {
+		struct wb_writeback_args args = {
+			.nr_pages	= LONG_MAX,
+			.sync_mode	= WB_SYNC_NONE,
+			.for_background	= 1,
+			.range_cyclic	= 1,
+		};
+
+		return wb_writeback(wb, &args);
+	}
+
+	return 0;
+}
+
 /*
  * Retrieve work items and do the writeback they describe
  */
@@ -928,6 +971,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 	 * Check for periodic writeback, kupdated() style
 	 */
 	wrote += wb_check_old_data_flush(wb);
+	wrote += wb_check_background_flush(wb);
 
 	return wrote;
 }
@@ -1633,7 +1633,7 @@ out:
 	return ~0U;
 }
 
-#define PROC_FDINFO_MAX 64
+#define PROC_FDINFO_MAX 128
 
 static int proc_fd_info(struct inode *inode, struct path *path, char *info)
 {
@@ -1661,9 +1661,15 @@ static int proc_fd_info(struct inode *inode, struct path *path, char *info)
 			if (info)
 				snprintf(info, PROC_FDINFO_MAX,
 					 "pos:\t%lli\n"
-					 "flags:\t0%o\n",
+					 "flags:\t0%o\n"
+					 "ra_pages:\t%u\n"
+					 "ra_hit:\t%u\n"
+					 "ra_miss:\t%u\n",
 					 (long long) file->f_pos,
-					 file->f_flags);
+					 file->f_flags,
+					 file->f_ra.ra_pages,
+					 file->f_ra.hit,
+					 file->f_ra.miss);
 			spin_unlock(&files->file_lock);
 			put_files_struct(files);
 			return 0;
@@ -2498,6 +2504,23 @@ static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 	return 0;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+static int proc_pid_numa_stat(struct seq_file *m, struct pid_namespace *ns,
+			      struct pid *pid, struct task_struct *task)
+{
+	unsigned long *faults = task->numa_faults;
+	int nid;
+
+	seq_printf(m, "preferred_node %d\n", task->numa_preferred_nid);
+	seq_printf(m, "scan_period_ms %u\n", task->numa_scan_period);
+	seq_printf(m, "pages_migrated %lu\n", task->numa_pages_migrated);
+	for_each_online_node(nid)
+		seq_printf(m, "faults_node%d %lu\n", nid,
+			   faults ? faults[nid] : 0);
+	return 0;
+}
+#endif
+
 /*
  * Thread groups
  */
@@ -2515,6 +2538,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 	INF("auxv",       S_IRUSR, proc_pid_auxv),
 	ONE("status",     S_IRUGO, proc_pid_status),
 	ONE("personality", S_IRUSR, proc_pid_personality),
+#ifdef CONFIG_NUMA_BALANCING
+	ONE("numa_stat",  S_IRUGO, proc_pid_numa_stat),
+#endif
 	INF("limits",	  S_IRUSR, proc_pid_limits),
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",      S_IRUGO|S_IWUSR, proc_pid_sched_operations),
@@ -2540,6 +2566,8 @@ static const struct pid_entry tgid_base_stuff[] = {
 	REG("clear_refs", S_IWUSR, proc_clear_refs_operations),
 	REG("smaps",      S_IRUGO, proc_smaps_operations),
 	REG("pagemap",    S_IRUSR, proc_pagemap_operations),
+	REG("idle_pages", S_IRUSR, proc_idle_pages_operations),
+	REG("reclaim",    S_IWUSR, proc_reclaim_operations),
 #endif
 #ifdef CONFIG_SECURITY
 	DIR("attr",       S_IRUGO|S_IXUGO, proc_attr_dir_inode_operations, proc_attr_dir_operations),
@@ -2849,6 +2877,9 @@ static const struct pid_entry tid_base_stuff[] = {
 	INF("auxv",      S_IRUSR, proc_pid_auxv),
 	ONE("status",    S_IRUGO, proc_pid_status),
 	ONE("personality", S_IRUSR, proc_pid_personality),
+#ifdef CONFIG_NUMA_BALANCING
+	ONE("numa_stat",  S_IRUGO, proc_pid_numa_stat),
+#endif
 	INF("limits",	 S_IRUSR, proc_pid_limits),
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",     S_IRUGO|S_IWUSR, proc_pid_sched_operations),
@@ -2873,6 +2904,8 @@ static const struct pid_entry tid_base_stuff[] = {
 	REG("clear_refs", S_IWUSR, proc_clear_refs_operations),
 	REG("smaps",     S_IRUGO, proc_smaps_operations),
 	REG("pagemap",    S_IRUSR, proc_pagemap_operations),
+	REG("idle_pages", S_IRUSR, proc_idle_pages_operations),
+	REG("reclaim",    S_IWUSR, proc_reclaim_operations),
 #endif
 #ifdef CONFIG_SECURITY
 	DIR("attr",      S_IRUGO|S_IXUGO, proc_attr_dir_inode_operations, proc_attr_dir_operations),
@@ -472,9 +472,49 @@ static int clear_refs_pte_range(pmd_t *pmd, unsigned long addr,
 	return 0;
 }
 
+/*
+ * Take an idle page sample: a page accessed since the previous sample gets
+ * idle age 0, the others get one sample older.  The accessed bit is passed on
+ * to PG_referenced, so that reclaim still sees recent accesses.
+ */
+static int idle_age_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+	int age;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte)) {
+			SetPageReferenced(page);
+			set_page_idle_age(page, 0);
+		} else {
+			ClearPageReferenced(page);
+			age = page_idle_age(page);
+			if (age < IDLE_AGE_MAX)
+				set_page_idle_age(page, age + 1);
+		}
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+	return 0;
+}
+
 #define CLEAR_REFS_ALL 1
 #define CLEAR_REFS_ANON 2
 #define CLEAR_REFS_MAPPED 3
+#define CLEAR_REFS_IDLE 4
 
 static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *ppos)
@@ -492,7 +532,7 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 		return -EFAULT;
 	if (strict_strtol(strstrip(buffer), 10, &type))
 		return -EINVAL;
-	if (type < CLEAR_REFS_ALL || type > CLEAR_REFS_MAPPED)
+	if (type < CLEAR_REFS_ALL || type > CLEAR_REFS_IDLE)
 		return -EINVAL;
 	task = get_proc_task(file->f_path.dentry->d_inode);
 	if (!task)
@@ -503,6 +543,9 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 			.pmd_entry = clear_refs_pte_range,
 			.mm = mm,
 		};
+
+		if (type == CLEAR_REFS_IDLE)
+			clear_refs_walk.pmd_entry = idle_age_pte_range;
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
 			clear_refs_walk.private = vma;
@@ -516,6 +559,9 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 			 *
 			 * Writing 3 to /proc/pid/clear_refs only affects file
 			 * mapped pages.
+			 *
+			 * Writing 4 to /proc/pid/clear_refs takes an idle page
+			 * sample of all pages, see /proc/pid/idle_pages.
 			 */
 			if (type == CLEAR_REFS_ANON && vma->vm_file)
 				continue;
@@ -537,6 +583,183 @@ const struct file_operations proc_clear_refs_operations = {
 	.write		= clear_refs_write,
 };
 
+struct idle_page_stats {
+	struct vm_area_struct *vma;
+	unsigned long anon[IDLE_AGE_MAX + 1];
+	unsigned long file[IDLE_AGE_MAX + 1];
+};
+
+static int idle_pages_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct idle_page_stats *ips = walk->private;
+	struct vm_area_struct *vma = ips->vma;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		/* Accessed since the last sample */
+		if (pte_young(ptent)) {
+			if (PageAnon(page))
+				ips->anon[0]++;
+			else
+				ips->file[0]++;
+			continue;
+		}
+		if (PageAnon(page))
+			ips->anon[page_idle_age(page)]++;
+		else
+			ips->file[page_idle_age(page)]++;
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+	cond_resched();
+	return 0;
+}
+
+/*
+ * /proc/pid/idle_pages - histogram of the idle ages of the mapped pages
+ *
+ * One line per idle age, the number of samples taken by writing 4 to
+ * /proc/pid/clear_refs that found the page not accessed in between, with
+ * the amount of anonymous and file memory of that age.  The last line
+ * covers all the older pages.  Pages shared with other processes are
+ * aged by the samples of all of them.
+ */
+static int idle_pages_show(struct seq_file *m, void *v)
+{
+	struct task_struct *task = m->private;
+	struct idle_page_stats *ips;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct mm_walk idle_pages_walk = {
+		.pmd_entry = idle_pages_pte_range,
+	};
+	int age;
+
+	mm = get_task_mm(task);
+	if (!mm)
+		return 0;
+
+	ips = kzalloc(sizeof(*ips), GFP_KERNEL);
+	if (!ips) {
+		mmput(mm);
+		return -ENOMEM;
+	}
+
+	idle_pages_walk.mm = mm;
+	idle_pages_walk.private = ips;
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		ips->vma = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &idle_pages_walk);
+	}
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+#define K(x) ((x) << (PAGE_SHIFT - 10))
+	seq_printf(m, "age     anon_kB     file_kB\n");
+	for (age = 0; age <= IDLE_AGE_MAX; age++)
+		seq_printf(m, "%3d %11lu %11lu\n",
+			   age, K(ips->anon[age]), K(ips->file[age]));
+#undef K
+
+	kfree(ips);
+	return 0;
+}
+
+static int idle_pages_open(struct inode *inode, struct file *file)
+{
+	struct task_struct *task = get_proc_task(inode);
+	int ret;
+
+	if (!task)
+		return -ESRCH;
+	if (!ptrace_may_access(task, PTRACE_MODE_READ)) {
+		put_task_struct(task);
+		return -EACCES;
+	}
+	ret = single_open(file, idle_pages_show, task);
+	if (ret)
+		put_task_struct(task);
+	return ret;
+}
+
+static int idle_pages_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	put_task_struct(m->private);
+	return single_release(inode, file);
+}
+
+const struct file_operations proc_idle_pages_operations = {
+	.open		= idle_pages_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= idle_pages_release,
+};
+
+/*
+ * /proc/pid/reclaim - proactive reclaim of idle memory
+ *
+ * Writing "<nr_pages> [<min_age>]" reclaims up to nr_pages of the pages
+ * mapped by the process whose idle age is at least min_age (1 by default),
+ * oldest first.
+ */
+static ssize_t reclaim_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct task_struct *task;
+	char buffer[32];
+	struct mm_struct *mm;
+	unsigned long nr_pages;
+	int min_age = 1;
+	int ret;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	ret = sscanf(buffer, "%lu %d", &nr_pages, &min_age);
+	if (ret < 1 || min_age < 1)
+		return -EINVAL;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	if (!ptrace_may_access(task, PTRACE_MODE_ATTACH)) {
+		put_task_struct(task);
+		return -EACCES;
+	}
+	mm = get_task_mm(task);
+	if (mm) {
+		down_read(&mm->mmap_sem);
+		reclaim_idle_pages(mm, nr_pages, min_age);
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	put_task_struct(task);
+
+	return count;
+}
+
+const struct file_operations proc_reclaim_operations = {
+	.write		= reclaim_write,
+};
+
 struct pagemapread {
 	u64 __user *out, *end;
 };
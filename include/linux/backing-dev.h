@@ -38,11 +38,18 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_WRITTEN,
+	BDI_RA_PAGES,		/* pages submitted by readahead */
+	BDI_RA_HIT,		/* readahead pages consumed */
+	BDI_RA_MISS,		/* readahead pages evicted unused */
 	NR_BDI_STAT_ITEMS
 };
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/* Initial write bandwidth estimate: 100 MB/s, in pages per second */
+#define INIT_BW		(100 << (20 - PAGE_SHIFT))
+
 struct bdi_writeback {
 	struct list_head list;			/* hangs off the bdi */
 
@@ -75,6 +82,20 @@ struct backing_dev_info {
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
 
+	/*
+	 * Write bandwidth estimation, in pages per second.  Dirtying tasks
+	 * are throttled by pausing them for intervals derived from it.
+	 */
+	spinlock_t bw_lock;		/* serializes bandwidth updates */
+	unsigned long bw_time_stamp;	/* last time write bw was updated */
+	unsigned long written_stamp;	/* pages written at bw_time_stamp */
+	unsigned long write_bandwidth;	/* the estimated write bandwidth */
+	unsigned long avg_write_bandwidth; /* further smoothed write bw */
+
+	unsigned long dirty_pauses;	/* number of throttling pauses */
+	unsigned long dirty_paused;	/* jiffies spent in them */
+	unsigned long last_pause;	/* length of the latest pause */
+
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
@@ -103,6 +124,7 @@ int bdi_register_dev(struct backing_dev_info *bdi, dev_t dev);
 void bdi_unregister(struct backing_dev_info *bdi);
 void bdi_start_writeback(struct backing_dev_info *bdi, struct super_block *sb,
 				long nr_pages);
+void bdi_start_background_writeback(struct backing_dev_info *bdi);
 int bdi_writeback_task(struct bdi_writeback *wb);
 int bdi_has_dirty_io(struct backing_dev_info *bdi);
 
@@ -180,6 +202,8 @@ static inline s64 bdi_stat_sum(struct backing_dev_info *bdi,
 }
 
 extern void bdi_writeout_inc(struct backing_dev_info *bdi);
+extern void bdi_update_bandwidth(struct backing_dev_info *bdi,
+				 unsigned long start_time);
 
 /*
  * maximal error of a stat counter.
@@ -48,6 +48,7 @@ extern unsigned long init_bootmem(unsigned long addr, unsigned long memend);
 
 extern unsigned long free_all_bootmem_node(pg_data_t *pgdat);
 extern unsigned long free_all_bootmem(void);
+extern unsigned long free_all_bootmem_deferred(pg_data_t *pgdat);
 
 extern void free_bootmem_node(pg_data_t *pgdat,
 			      unsigned long addr,
@@ -164,6 +164,12 @@ struct compat_robust_list_head {
 	compat_uptr_t			list_op_pending;
 };
 
+struct compat_futex_wait_block {
+	compat_uptr_t			uaddr;
+	__u32				val;
+	__u32				bitset;
+};
+
 extern void compat_exit_robust_list(struct task_struct *curr);
 
 asmlinkage long
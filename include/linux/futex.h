@@ -20,6 +20,8 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_LOCK		13
+#define FUTEX_WAIT_MULTIPLE	14
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -39,12 +41,32 @@
 					 FUTEX_PRIVATE_FLAG)
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
+#define FUTEX_LOCK_PRIVATE	(FUTEX_LOCK | FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAIT_MULTIPLE_PRIVATE	(FUTEX_WAIT_MULTIPLE | \
+					 FUTEX_PRIVATE_FLAG)
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
  */
 
+/*
+ * One futex word to wait on with FUTEX_WAIT_MULTIPLE: the syscall gets
+ * an array of these in uaddr and their number in val, and returns the
+ * index of the futex that woke us up.
+ *
+ * NOTE: this structure is part of the syscall ABI, and must not be
+ * changed.
+ */
+struct futex_wait_block {
+	__u32 __user *uaddr;
+	__u32 val;
+	__u32 bitset;
+};
+
+/* Maximum number of futexes to wait on with one FUTEX_WAIT_MULTIPLE */
+#define FUTEX_MULTIPLE_MAX_COUNT	128
+
 /*
  * Per-lock list entry - embedded in user-space locks, somewhere close
  * to the futex field. (Note: user-space uses a double-linked list to
@@ -135,6 +157,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, union ktime *timeout,
 extern int
 handle_futex_death(u32 __user *uaddr, struct task_struct *curr, int pi);
 
+int futex_wait_multiple(struct futex_wait_block *wb, unsigned int count,
+			int fshared, union ktime *abs_time);
+
 /*
  * Futexes are matched on equal values of this key.
  * The key type depends on whether it's a shared or private mapping.
@@ -177,6 +202,9 @@ union futex_key {
 extern void exit_robust_list(struct task_struct *curr);
 extern void exit_pi_state_list(struct task_struct *curr);
 extern int futex_cmpxchg_enabled;
+extern int sysctl_futex_private_hash;
+extern void futex_mm_init_private_hash(struct mm_struct *mm);
+extern void futex_mm_free_private_hash(struct mm_struct *mm);
 #else
 static inline void exit_robust_list(struct task_struct *curr)
 {
@@ -184,6 +212,12 @@ static inline void exit_robust_list(struct task_struct *curr)
 static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
+static inline void futex_mm_init_private_hash(struct mm_struct *mm)
+{
+}
+static inline void futex_mm_free_private_hash(struct mm_struct *mm)
+{
+}
 #endif
 #endif /* __KERNEL__ */
 
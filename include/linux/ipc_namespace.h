@@ -42,6 +42,7 @@ struct ipc_namespace {
 	size_t		shm_ctlall;
 	int		shm_ctlmni;
 	int		shm_tot;
+	int		shm_hugepages;
 
 	struct notifier_block ipcns_nb;
 
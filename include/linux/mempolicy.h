@@ -239,6 +239,13 @@ static inline int vma_migratable(struct vm_area_struct *vma)
 	return 1;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+				      unsigned long addr, unsigned long end);
+extern int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+			  unsigned long addr);
+#endif
+
 #else
 /*
 struct mempolicy {};
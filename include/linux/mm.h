@@ -450,6 +450,9 @@ static inline void set_compound_order(struct page *page, unsigned long order)
  * No sparsemem or sparsemem vmemmap: |       NODE     | ZONE | ... | FLAGS |
  * classic sparse with space for node:| SECTION | NODE | ZONE | ... | FLAGS |
  * classic sparse no space for node:  | SECTION |     ZONE    | ... | FLAGS |
+ *
+ * If there is room, the idle age of the page follows the zone:
+ *                                    | ... | ZONE | IDLE_AGE | ... | FLAGS |
  */
 #if defined(CONFIG_SPARSEMEM) && !defined(CONFIG_SPARSEMEM_VMEMMAP)
 //#define SECTIONS_WIDTH		SECTIONS_SHIFT
@@ -515,10 +518,20 @@ static inline void set_compound_order(struct page *page, unsigned long order)
 #error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
 #endif
 
+#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+4 <= BITS_PER_LONG - NR_PAGEFLAGS
+#define IDLE_AGE_WIDTH		4
+#else
+#define IDLE_AGE_WIDTH		0
+#endif
+#define IDLE_AGE_PGOFF		(ZONES_PGOFF - IDLE_AGE_WIDTH)
+#define IDLE_AGE_PGSHIFT	(IDLE_AGE_PGOFF * (IDLE_AGE_WIDTH != 0))
+
 #define ZONES_MASK		((1UL << ZONES_WIDTH) - 1)
 #define NODES_MASK		((1UL << NODES_WIDTH) - 1)
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
+#define IDLE_AGE_MASK		((1UL << IDLE_AGE_WIDTH) - 1)
+#define IDLE_AGE_MAX		((int)IDLE_AGE_MASK)
 
 static inline enum zone_type page_zonenum(struct page *page)
 {
@@ -588,6 +601,36 @@ static inline void set_page_section(struct page *page, unsigned long section)
 	page->flags |= (section & SECTIONS_MASK) << SECTIONS_PGSHIFT;
 }
 
+/*
+ * The idle age of a page counts the samples taken through
+ * /proc/<pid>/clear_refs that found the page not accessed since the
+ * previous one.  It is updated concurrently with the page flags, hence
+ * the cmpxchg.
+ */
+static inline int page_idle_age(struct page *page)
+{
+	return (page->flags >> IDLE_AGE_PGSHIFT) & IDLE_AGE_MASK;
+}
+
+static inline void set_page_idle_age(struct page *page, int age)
+{
+	unsigned long old, new;
+
+	if (!IDLE_AGE_WIDTH)
+		return;
+	do {
+		old = page->flags;
+		new = old & ~(IDLE_AGE_MASK << IDLE_AGE_PGSHIFT);
+		new |= (age & IDLE_AGE_MASK) << IDLE_AGE_PGSHIFT;
+	} while (cmpxchg(&page->flags, old, new) != old);
+}
+
+/* For pages nobody else can see yet */
+static inline void __reset_page_idle_age(struct page *page)
+{
+	page->flags &= ~(IDLE_AGE_MASK << IDLE_AGE_PGSHIFT);
+}
+
 static inline void set_page_links(struct page *page, enum zone_type zone,
 	unsigned long node, unsigned long pfn)
 {
@@ -871,6 +914,9 @@ extern unsigned long move_page_tables(struct vm_area_struct *vma,
 extern unsigned long do_mremap(unsigned long addr,
 			       unsigned long old_len, unsigned long new_len,
 			       unsigned long flags, unsigned long new_addr);
+extern void change_protection(struct vm_area_struct *vma, unsigned long start,
+			      unsigned long end, pgprot_t newprot,
+			      int dirty_accountable, int prot_numa);
 extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
@@ -975,9 +1021,85 @@ static inline pmd_t *pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long a
 #define pte_lockptr(mm, pmd)	({(void)(pmd); &(mm)->page_table_lock;})*/
 #endif /* USE_SPLIT_PTLOCKS */
 
+#ifdef CONFIG_SHARED_PAGE_TABLES
+/*
+ * A pte page allocated for a range that other mms may map through it
+ * too is marked in page->index.  Such a page is refcounted by the mms
+ * mapping it.  While a single mm maps it, the pages mapped through it
+ * are charged to that mm's rss as usual and the page is marked charged;
+ * once it is shared they are not charged to any of the sharers.  The
+ * charged mark only changes under the pte lock.
+ */
+#define PTE_TABLE_SHAREABLE	0x1
+#define PTE_TABLE_CHARGED	0x2
+
+static inline int pte_table_shareable_page(struct page *page)
+{
+	return page->index & PTE_TABLE_SHAREABLE;
+}
+
+static inline int pte_table_shared(struct page *page)
+{
+	return pte_table_shareable_page(page) && page_count(page) > 1;
+}
+
+/* No highmem page tables on the configs that share them */
+static inline int pte_in_shared_table(pte_t *pte)
+{
+	return pte_table_shared(virt_to_page(pte));
+}
+
+/* Are the pages mapped by @pte left out of the mm's rss? */
+static inline int pte_in_uncharged_table(pte_t *pte)
+{
+	return virt_to_page(pte)->index == PTE_TABLE_SHAREABLE;
+}
+
+extern void unshare_pte_tables(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end);
+extern int pte_table_make_private(struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long address);
+extern void pte_table_flush_page(struct vm_area_struct *vma,
+				 unsigned long address, pte_t *pte);
+#else
+static inline int pte_table_shared(struct page *page)
+{
+	return 0;
+}
+
+static inline int pte_in_shared_table(pte_t *pte)
+{
+	return 0;
+}
+
+static inline int pte_in_uncharged_table(pte_t *pte)
+{
+	return 0;
+}
+
+static inline void unshare_pte_tables(struct vm_area_struct *vma,
+				      unsigned long start, unsigned long end)
+{
+}
+
+static inline int pte_table_make_private(struct vm_area_struct *vma,
+					 pmd_t *pmd, unsigned long address)
+{
+	return 0;
+}
+
+static inline void pte_table_flush_page(struct vm_area_struct *vma,
+					unsigned long address, pte_t *pte)
+{
+}
+#endif /* CONFIG_SHARED_PAGE_TABLES */
+
 static inline void pgtable_page_ctor(struct page *page)
 {
 	pte_lock_init(page);
+#ifdef CONFIG_SHARED_PAGE_TABLES
+	page->index = 0;
+#endif
 	inc_zone_page_state(page, NR_PAGETABLE);
 }
 
@@ -21,6 +21,7 @@
 #define AT_VECTOR_SIZE (2*(AT_VECTOR_SIZE_ARCH + AT_VECTOR_SIZE_BASE + 1))
 
 struct address_space;
+struct futex_hash_bucket;
 
 #define USE_SPLIT_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 
@@ -287,6 +288,21 @@ struct mm_struct {
 #ifdef CONFIG_MMU_NOTIFIER
 	struct mmu_notifier_mm *mmu_notifier_mm;
 #endif
+#ifdef CONFIG_FUTEX
+	/* hash table for the process private futexes, if any */
+	struct futex_hash_bucket *futex_hash;
+	unsigned int futex_hash_mask;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is when the address space is next scanned for
+	 * NUMA hinting faults, numa_scan_offset is where that scan starts
+	 * and numa_scan_seq counts the completed passes over the mm.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -95,6 +95,7 @@ enum zone_stat_item {
 	NR_SLAB_RECLAIMABLE,
 	NR_SLAB_UNRECLAIMABLE,
 	NR_PAGETABLE,		/* used for pagetables */
+	NR_PAGETABLE_SAVED,	/* extra mappings of shared pte pages */
 	NR_KERNEL_STACK,
 	/* Second 128 byte cacheline */
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
@@ -104,6 +105,8 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaulted pages activated right away */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -352,6 +355,9 @@ struct zone {
 	/* Zone statistics */
 	atomic_long_t		vm_stat[NR_VM_ZONE_STAT_ITEMS];
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	/*
 	 * prev_priority holds the scanning priority for this zone.  It is
 	 * defined as the scanning priority at which we achieved our reclaim
@@ -611,6 +617,9 @@ struct node_active_region {
 extern struct page *mem_map;
 #endif
 
+/* Upper limit of the background reclaim threads of a node */
+#define MAX_KSWAPD_THREADS	16
+
 /*
  * The pg_data_t structure is used in machines with CONFIG_DISCONTIGMEM
  * (mostly NUMA machines?) to denote a higher-level memory zone than the
@@ -649,8 +658,16 @@ typedef struct pglist_data {
 	unsigned long node_spanned_pages; /* total size of physical page
 					     range, including holes */
 	int node_id;
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	/*
+	 * The struct pages from here to the end of the node are initialised
+	 * late in boot by a kernel thread, ULONG_MAX if there are none.
+	 */
+	unsigned long first_deferred_pfn;
+#endif
 	wait_queue_head_t kswapd_wait;
-	struct task_struct *kswapd;
+	/* kswapd[0] is started for every node, see vm.kswapd_threads */
+	struct task_struct *kswapd[MAX_KSWAPD_THREADS];
 	int kswapd_max_order;
 } pg_data_t;
 
@@ -8,8 +8,18 @@
 #ifndef _LINUX_PAGEVEC_H
 #define _LINUX_PAGEVEC_H
 
-/* 14 pointers + two long's align the pagevec structure to a power of two */
+#include <linux/threads.h>
+
+/*
+ * 14 pointers + two long's align the pagevec structure to a power of two.
+ * Large machines have many more cpus contending on each zone's lru_lock,
+ * so they get twice the batch (30 + 2 also a power of two) per lock hold.
+ */
+#if NR_CPUS > 64
+#define PAGEVEC_SIZE	30
+#else
 #define PAGEVEC_SIZE	14
+#endif
 
 struct page;
 struct address_space;
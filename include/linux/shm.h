@@ -102,6 +102,21 @@ struct shmid_kernel /* private to the kernel */
 #define SHM_LOCKED      02000   /* segment will not be swapped */
 #define SHM_HUGETLB     04000   /* segment will use huge TLB pages */
 #define SHM_NORESERVE   010000  /* don't check for reservations */
+#define SHM_HUGEPAGE    020000  /* use huge pages if available */
+
+/*
+ * kernel.shm_hugepages policies.  They only apply to callers that pass
+ * the SHM_HUGETLB permission check (CAP_IPC_LOCK or hugetlb_shm_group).
+ * A segment backed by huge pages behaves like a SHM_HUGETLB one: shmat()
+ * needs an address aligned to the huge page size, not just to SHMLBA,
+ * and fails with EINVAL otherwise; its pages are never swapped; and it
+ * can only be unmapped or mprotected in huge page units.  Under "always"
+ * this applies to segments that never asked for huge pages, so only
+ * enable it for applications that attach at shmat(NULL) addresses.
+ */
+#define SHM_HUGEPAGES_NEVER	0	/* SHM_HUGETLB segments only */
+#define SHM_HUGEPAGES_ADVISE	1	/* SHM_HUGEPAGE segments too */
+#define SHM_HUGEPAGES_ALWAYS	2	/* any huge page aligned segment */
 
 #ifdef CONFIG_SYSVIPC
 long do_shmat(int shmid, char __user *shmaddr, int shmflg, unsigned long *addr);
@@ -14,7 +14,10 @@
 extern void cpu_idle(void);
 
 struct call_single_data {
-	struct list_head list;
+	union {
+		struct list_head list;
+		struct call_single_data *next;	/* cpu's call queue */
+	};
 	void (*func) (void *info);
 	void *info;
 	u16 flags;
@@ -82,10 +85,6 @@ void __smp_call_function_single(int cpuid, struct call_single_data *data,
 #ifdef CONFIG_USE_GENERIC_SMP_HELPERS
 void generic_smp_call_function_single_interrupt(void);
 void generic_smp_call_function_interrupt(void);
-void ipi_call_lock(void);
-void ipi_call_unlock(void);
-void ipi_call_lock_irq(void);
-void ipi_call_unlock_irq(void);
 #endif
 
 /*
@@ -7,6 +7,7 @@
 #define _LINUX_TICK_H
 
 #include <linux/clockchips.h>
+#include <linux/smp.h>
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -43,6 +44,11 @@ enum tick_nohz_mode {
  * @idle_exittime:	Time when the idle state was left
  * @idle_sleeptime:	Sum of the time slept in idle with sched tick stopped
  * @sleep_length:	Duration of the current idle sleep
+ * @tick_stopped_full:	The tick has been stopped while a single task runs
+ * @full_jiffies:	jiffies when the tick was last stopped for a task
+ * @full_stops:		Number of times the tick was stopped for a task
+ * @full_ticks:		Residual ticks taken while stopped for a task
+ * @full_irqs:		Interrupts taken while stopped for a task
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -64,6 +70,13 @@ struct tick_sched {
 	unsigned long			last_jiffies;
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
+#ifdef CONFIG_NO_HZ_FULL
+	int				tick_stopped_full;
+	unsigned long			full_jiffies;
+	unsigned long			full_stops;
+	unsigned long			full_ticks;
+	unsigned long			full_irqs;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -140,4 +153,55 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 */
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern cpumask_var_t tick_nohz_full_mask;
+extern int tick_nohz_full_running;
+extern void __tick_nohz_full_check(int irq);
+extern void __tick_nohz_full_kick_cpu(int cpu);
+
+static inline int tick_nohz_full_enabled(void)
+{
+	return tick_nohz_full_running;
+}
+
+static inline int tick_nohz_full_cpu(int cpu)
+{
+	return tick_nohz_full_enabled() &&
+	       cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+/*
+ * Reevaluate whether this cpu can run without the tick: from schedule()
+ * once the next task is known, and from irq_exit() for anything an
+ * interrupt handler may have queued.
+ */
+static inline void tick_nohz_full_check(void)
+{
+	if (tick_nohz_full_cpu(smp_processor_id()))
+		__tick_nohz_full_check(0);
+}
+
+static inline void tick_nohz_full_irq_exit(void)
+{
+	if (tick_nohz_full_cpu(smp_processor_id()))
+		__tick_nohz_full_check(1);
+}
+
+/*
+ * Make @cpu reevaluate its tick, because something it may have stopped
+ * the tick without (a second runnable task, a timer, RCU) has changed.
+ */
+static inline void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (tick_nohz_full_cpu(cpu))
+		__tick_nohz_full_kick_cpu(cpu);
+}
+# else
+static inline int tick_nohz_full_enabled(void) { return 0; }
+static inline int tick_nohz_full_cpu(int cpu) { return 0; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_irq_exit(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
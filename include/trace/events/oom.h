@@ -0,0 +1,90 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM oom
+
+#if !defined(_TRACE_OOM_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_OOM_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(mark_victim,
+
+	TP_PROTO(int pid),
+
+	TP_ARGS(pid),
+
+	TP_STRUCT__entry(
+		__field(	int,	pid	)
+	),
+
+	TP_fast_assign(
+		__entry->pid = pid;
+	),
+
+	TP_printk("pid=%d", __entry->pid)
+);
+
+TRACE_EVENT(start_task_reaping,
+
+	TP_PROTO(int pid, s64 delay_us),
+
+	TP_ARGS(pid, delay_us),
+
+	TP_STRUCT__entry(
+		__field(	int,	pid		)
+		__field(	s64,	delay_us	)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= pid;
+		__entry->delay_us	= delay_us;
+	),
+
+	TP_printk("pid=%d delay=%lldus", __entry->pid, __entry->delay_us)
+);
+
+TRACE_EVENT(finish_task_reaping,
+
+	TP_PROTO(int pid, unsigned long freed, s64 elapsed_us),
+
+	TP_ARGS(pid, freed, elapsed_us),
+
+	TP_STRUCT__entry(
+		__field(	int,		pid		)
+		__field(	unsigned long,	freed		)
+		__field(	s64,		elapsed_us	)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= pid;
+		__entry->freed		= freed;
+		__entry->elapsed_us	= elapsed_us;
+	),
+
+	TP_printk("pid=%d freed=%lu pages time_to_free=%lldus",
+		__entry->pid, __entry->freed, __entry->elapsed_us)
+);
+
+TRACE_EVENT(skip_task_reaping,
+
+	TP_PROTO(int pid, const char *reason),
+
+	TP_ARGS(pid, reason),
+
+	TP_STRUCT__entry(
+		__field(	int,		pid	)
+		__string(	reason,		reason	)
+	),
+
+	TP_fast_assign(
+		__entry->pid	= pid;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("pid=%d reason=%s", __entry->pid, __get_str(reason))
+);
+
+#endif /* _TRACE_OOM_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -8,26 +8,27 @@
 #include <linux/sched.h>
 #include <linux/tracepoint.h>
 
+/* Trace the queueing of a work item on the worker pool of a cpu */
 TRACE_EVENT(workqueue_insertion,
 
-	TP_PROTO(struct task_struct *wq_thread, struct work_struct *work),
+	TP_PROTO(const char *wq_name, int cpu, struct work_struct *work),
 
-	TP_ARGS(wq_thread, work),
+	TP_ARGS(wq_name, cpu, work),
 
 	TP_STRUCT__entry(
-		__array(char,		thread_comm,	TASK_COMM_LEN)
-		__field(pid_t,		thread_pid)
+		__string(wq_name,	wq_name)
+		__field(int,		cpu)
 		__field(work_func_t,	func)
 	),
 
 	TP_fast_assign(
-		memcpy(__entry->thread_comm, wq_thread->comm, TASK_COMM_LEN);
-		__entry->thread_pid	= wq_thread->pid;
+		__assign_str(wq_name, wq_name);
+		__entry->cpu		= cpu;
 		__entry->func		= work->func;
 	),
 
-	TP_printk("thread=%s:%d func=%pf", __entry->thread_comm,
-		__entry->thread_pid, __entry->func)
+	TP_printk("wq=%s cpu=%d func=%pf", __get_str(wq_name),
+		__entry->cpu, __entry->func)
 );
 
 TRACE_EVENT(workqueue_execution,
@@ -52,7 +53,7 @@ TRACE_EVENT(workqueue_execution,
 		__entry->thread_pid, __entry->func)
 );
 
-/* Trace the creation of one workqueue thread on a cpu */
+/* Trace the creation of one workqueue worker on a cpu */
 TRACE_EVENT(workqueue_creation,
 
 	TP_PROTO(struct task_struct *wq_thread, int cpu),
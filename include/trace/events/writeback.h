@@ -0,0 +1,97 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM writeback
+
+#if !defined(_TRACE_WRITEBACK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WRITEBACK_H
+
+#include <linux/backing-dev.h>
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+#define KBps(x)			((x) << (PAGE_SHIFT - 10))
+
+TRACE_EVENT(bdi_dirty_bandwidth,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long written,
+		 unsigned long elapsed),
+
+	TP_ARGS(bdi, written, elapsed),
+
+	TP_STRUCT__entry(
+		__array(	char,		name,	32	)
+		__field(	unsigned long,	written		)
+		__field(	unsigned long,	elapsed		)
+		__field(	unsigned long,	write_bw	)
+		__field(	unsigned long,	avg_write_bw	)
+	),
+
+	TP_fast_assign(
+		strlcpy(__entry->name,
+			bdi->dev ? dev_name(bdi->dev) : "(unknown)", 32);
+		__entry->written	= written;
+		__entry->elapsed	= jiffies_to_msecs(elapsed);
+		__entry->write_bw	= KBps(bdi->write_bandwidth);
+		__entry->avg_write_bw	= KBps(bdi->avg_write_bandwidth);
+	),
+
+	TP_printk("bdi %s: written=%lu elapsed=%lums write_bw=%lu avg_write_bw=%lu",
+		__entry->name,
+		__entry->written,
+		__entry->elapsed,
+		__entry->write_bw,
+		__entry->avg_write_bw)
+);
+
+TRACE_EVENT(balance_dirty_pages,
+
+	TP_PROTO(struct backing_dev_info *bdi,
+		 unsigned long dirty_thresh,
+		 unsigned long nr_dirty,
+		 unsigned long bdi_thresh,
+		 unsigned long bdi_dirty,
+		 unsigned long pages_dirtied,
+		 unsigned long pause),
+
+	TP_ARGS(bdi, dirty_thresh, nr_dirty, bdi_thresh, bdi_dirty,
+		pages_dirtied, pause),
+
+	TP_STRUCT__entry(
+		__array(	char,		name,	32	)
+		__field(	unsigned long,	dirty_thresh	)
+		__field(	unsigned long,	nr_dirty	)
+		__field(	unsigned long,	bdi_thresh	)
+		__field(	unsigned long,	bdi_dirty	)
+		__field(	unsigned long,	write_bw	)
+		__field(	unsigned long,	pages_dirtied	)
+		__field(	unsigned int,	pause		)
+	),
+
+	TP_fast_assign(
+		strlcpy(__entry->name,
+			bdi->dev ? dev_name(bdi->dev) : "(unknown)", 32);
+		__entry->dirty_thresh	= dirty_thresh;
+		__entry->nr_dirty	= nr_dirty;
+		__entry->bdi_thresh	= bdi_thresh;
+		__entry->bdi_dirty	= bdi_dirty;
+		__entry->write_bw	= KBps(bdi->avg_write_bandwidth);
+		__entry->pages_dirtied	= pages_dirtied;
+		__entry->pause		= jiffies_to_msecs(pause);
+	),
+
+	TP_printk("bdi %s: limit=%lu dirty=%lu bdi_limit=%lu bdi_dirty=%lu "
+		  "write_bw=%lu dirtied=%lu pause=%u",
+		__entry->name,
+		__entry->dirty_thresh,
+		__entry->nr_dirty,
+		__entry->bdi_thresh,
+		__entry->bdi_dirty,
+		__entry->write_bw,
+		__entry->pages_dirtied,
+		__entry->pause)
+);
+
+#endif /* _TRACE_WRITEBACK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
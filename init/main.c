@@ -871,6 +871,8 @@ static int __init kernel_init(void * unused)
 	smp_init();
 	sched_init_smp();
 
+	page_alloc_init_late();
+
 	do_basic_setup();
 
 	/*
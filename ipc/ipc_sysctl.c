@@ -16,6 +16,7 @@
 #include <linux/uaccess.h>
 #include <linux/ipc_namespace.h>
 #include <linux/msg.h>
+#include <linux/shm.h>
 #include "util.h"
 
 static void *get_ipc(ctl_table *table)
@@ -37,6 +38,16 @@ static int proc_ipc_dointvec(ctl_table *table, int write,
 	return proc_dointvec(&ipc_table, write, buffer, lenp, ppos);
 }
 
+static int proc_ipc_dointvec_minmax(ctl_table *table, int write,
+	void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct ctl_table ipc_table;
+	memcpy(&ipc_table, table, sizeof(ipc_table));
+	ipc_table.data = get_ipc(table);
+
+	return proc_dointvec_minmax(&ipc_table, write, buffer, lenp, ppos);
+}
+
 static int proc_ipc_callback_dointvec(ctl_table *table, int write,
 	void __user *buffer, size_t *lenp, loff_t *ppos)
 {
@@ -125,6 +136,7 @@ static int proc_ipcauto_dointvec_minmax(ctl_table *table, int write,
 #else
 #define proc_ipc_doulongvec_minmax NULL
 #define proc_ipc_dointvec	   NULL
+#define proc_ipc_dointvec_minmax   NULL
 #define proc_ipc_callback_dointvec NULL
 #define proc_ipcauto_dointvec_minmax NULL
 #endif
@@ -192,6 +204,7 @@ static int sysctl_ipc_registered_data(ctl_table *table,
 
 static int zero;
 static int one = 1;
+static int shm_hugepages_max = SHM_HUGEPAGES_ALWAYS;
 
 static struct ctl_table ipc_kern_table[] = {
 	{
@@ -221,6 +234,17 @@ static struct ctl_table ipc_kern_table[] = {
 		.proc_handler	= proc_ipc_dointvec,
 		.strategy	= sysctl_ipc_data,
 	},
+	{
+		/* see the SHM_HUGEPAGES_* policies in <linux/shm.h> */
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "shm_hugepages",
+		.data		= &init_ipc_ns.shm_hugepages,
+		.maxlen		= sizeof(init_ipc_ns.shm_hugepages),
+		.mode		= 0644,
+		.proc_handler	= proc_ipc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &shm_hugepages_max,
+	},
 	{
 		.ctl_name	= KERN_MSGMAX,
 		.procname	= "msgmax",
@@ -76,6 +76,7 @@ void shm_init_ns(struct ipc_namespace *ns)
 	ns->shm_ctlall = SHMALL;
 	ns->shm_ctlmni = SHMMNI;
 	ns->shm_tot = 0;
+	ns->shm_hugepages = SHM_HUGEPAGES_ADVISE;
 	ipc_init_ids(&shm_ids(ns));
 }
 
@@ -331,6 +332,61 @@ static const struct vm_operations_struct shm_vm_ops = {
  * Called with shm_ids.rw_mutex held as a writer.
  */
 
+#ifdef CONFIG_HUGETLBFS
+/*
+ * Back a segment with pages from the hugetlb pool if the shm_hugepages
+ * policy of the namespace asks for it.  Only segments whose size is a
+ * multiple of the huge page size qualify, and all of their huge pages are
+ * reserved up front, so that they cannot fault for lack of them later.
+ * Either way the caller must pass the hugetlb_shm_group check of
+ * SHM_HUGETLB: the pages are not charged to RLIMIT_MEMLOCK, and could
+ * otherwise be pinned by anyone.  Returns NULL if the segment has to make
+ * do with normal pages.
+ */
+static struct file *shm_try_hugepages(struct ipc_namespace *ns,
+				      const char *name, size_t size, int shmflg)
+{
+	struct user_struct *user;
+	struct file *file;
+
+	switch (ns->shm_hugepages) {
+	case SHM_HUGEPAGES_ALWAYS:
+		if (size & (huge_page_size(&default_hstate) - 1))
+			return NULL;
+		/* The caller didn't ask: quietly keep normal pages */
+		if (!can_do_hugetlb_shm())
+			return NULL;
+		break;
+	case SHM_HUGEPAGES_ADVISE:
+		if (!(shmflg & SHM_HUGEPAGE))
+			return NULL;
+		if (size & (huge_page_size(&default_hstate) - 1))
+			goto fallback;
+		if (!can_do_hugetlb_shm())
+			goto fallback;
+		break;
+	default:
+		return NULL;
+	}
+
+	file = hugetlb_file_setup(name, size, 0, &user,
+				  HUGETLB_ANONHUGE_INODE);
+	if (!IS_ERR(file)) {
+		count_vm_event(SHM_HUGEPAGE_ALLOC);
+		return file;
+	}
+fallback:
+	count_vm_event(SHM_HUGEPAGE_FALLBACK);
+	return NULL;
+}
+#else
+static inline struct file *shm_try_hugepages(struct ipc_namespace *ns,
+				      const char *name, size_t size, int shmflg)
+{
+	return NULL;
+}
+#endif
+
 static int newseg(struct ipc_namespace *ns, struct ipc_params *params)
 {
 	key_t key = params->key;
@@ -372,7 +428,7 @@ static int newseg(struct ipc_namespace *ns, struct ipc_params *params)
 			acctflag = VM_NORESERVE;
 		file = hugetlb_file_setup(name, size, acctflag,
 					&shp->mlock_user, HUGETLB_SHMFS_INODE);
-	} else {
+	} else if (!(file = shm_try_hugepages(ns, name, size, shmflg))) {
 		/*
 		 * Do not allow no accounting for OVERCOMMIT_NEVER, even
 	 	 * if it's asked for.
@@ -164,6 +164,7 @@ void __put_task_struct(struct task_struct *tsk)
 
 	exit_creds(tsk);
 	delayacct_tsk_free(tsk);
+	task_numa_free(tsk);
 
 	if (!profile_handoff_task(tsk))
 		free_task(tsk);
@@ -462,6 +463,16 @@ static struct mm_struct * mm_init(struct mm_struct * mm, struct task_struct *p)
 	mm->cached_hole_size = ~0UL;
 	mm_init_aio(mm);
 	mm_init_owner(mm, p);
+#ifdef CONFIG_NUMA_BALANCING
+	mm->numa_next_scan = jiffies +
+		msecs_to_jiffies(sysctl_numa_balancing_scan_delay);
+	mm->numa_scan_offset = 0;
+	mm->numa_scan_seq = 0;
+#endif
+#ifdef CONFIG_FUTEX
+	mm->futex_hash = NULL;
+	mm->futex_hash_mask = 0;
+#endif
 
 	if (likely(!mm_alloc_pgd(mm))) {
 		mm->def_flags = 0;
@@ -496,6 +507,7 @@ struct mm_struct * mm_alloc(void)
 void __mmdrop(struct mm_struct *mm)
 {
 	BUG_ON(mm == &init_mm);
+	futex_mm_free_private_hash(mm);
 	mm_free_pgd(mm);
 	destroy_context(mm);
 	mmu_notifier_mm_destroy(mm);
@@ -701,6 +713,12 @@ static int copy_mm(unsigned long clone_flags, struct task_struct * tsk)
 		return 0;
 
 	if (clone_flags & CLONE_VM) {
+		/*
+		 * Private futexes can only get a hash table of their own
+		 * before the first thread is added, see futex.c.
+		 */
+		if (clone_flags & CLONE_THREAD)
+			futex_mm_init_private_hash(oldmm);
 		atomic_inc(&oldmm->mm_users);
 		mm = oldmm;
 		goto good_mm;
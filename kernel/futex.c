@@ -59,6 +59,10 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -66,7 +70,8 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
+/* Give each new multi-threaded process a futex hash of its own */
+int sysctl_futex_private_hash __read_mostly;
 
 /*
  * Priority Inheritance state:
@@ -126,23 +131,96 @@ struct futex_q {
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
  * waiting on a futex.
+ *
+ * The global table is sized by the number of cpus at boot, and spread
+ * over the nodes on NUMA.  Buckets get a cache line each, so that the
+ * locks of neighbouring buckets don't bounce together.
  */
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
+
+struct futex_hash_stats {
+	unsigned long queued;		/* waiters queued */
+	unsigned long collisions;	/* ... behind waiters on other futexes */
+};
+static DEFINE_PER_CPU(struct futex_hash_stats, futex_hash_stats);
+static atomic_t nr_futex_private_hashes = ATOMIC_INIT(0);
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
+ *
+ * PRIVATE futexes of a process with a hash table of its own are hashed
+ * there, everything else goes to the global table.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		struct mm_struct *mm = key->private.mm;
+
+		if (mm->futex_hash)
+			return &mm->futex_hash[hash & mm->futex_hash_mask];
+	}
+	return &futex_queues[hash & (futex_hashsize - 1)];
+}
+
+static void futex_hash_init_buckets(struct futex_hash_bucket *hb,
+				    unsigned long nr)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr; i++) {
+		plist_head_init(&hb[i].chain, &hb[i].lock);
+		spin_lock_init(&hb[i].lock);
+	}
+}
+
+/**
+ * futex_mm_init_private_hash() - give @mm a hash table for private futexes
+ * @mm:		the mm about to get its first additional thread
+ *
+ * Called from copy_mm() for CLONE_THREAD.  The private keys of @mm must
+ * hash to the same bucket for as long as anybody can wait on them, so
+ * the table is only installed while the caller is the only user of @mm:
+ * no private futex of it can have a waiter then.  If that doesn't work
+ * out, @mm keeps using the global table.
+ */
+void futex_mm_init_private_hash(struct mm_struct *mm)
+{
+	struct futex_hash_bucket *hb;
+	unsigned long nr;
+
+	if (!sysctl_futex_private_hash || mm->futex_hash ||
+	    atomic_read(&mm->mm_users) != 1)
+		return;
+
+	nr = roundup_pow_of_two(4 * num_online_cpus());
+	nr = clamp(nr, 16UL, futex_hashsize);
+	hb = kmalloc(nr * sizeof(*hb), GFP_KERNEL | __GFP_NOWARN);
+	if (!hb)
+		return;
+	futex_hash_init_buckets(hb, nr);
+
+	mm->futex_hash_mask = nr - 1;
+	mm->futex_hash = hb;
+	atomic_inc(&nr_futex_private_hashes);
+}
+
+void futex_mm_free_private_hash(struct mm_struct *mm)
+{
+	if (mm->futex_hash) {
+		kfree(mm->futex_hash);
+		mm->futex_hash = NULL;
+		atomic_dec(&nr_futex_private_hashes);
+	}
 }
 
 /*
@@ -1406,6 +1484,11 @@ static inline void queue_me(struct futex_q *q, struct futex_hash_bucket *hb)
 #ifdef CONFIG_DEBUG_PI_LIST
 	q->list.plist.lock = &hb->lock;
 #endif
+	__get_cpu_var(futex_hash_stats).queued++;
+	if (!plist_head_empty(&hb->chain) &&
+	    !match_futex(&plist_first_entry(&hb->chain, struct futex_q,
+					    list)->key, &q->key))
+		__get_cpu_var(futex_hash_stats).collisions++;
 	plist_add(&q->list, &hb->chain);
 	q->task = current;
 	spin_unlock(&hb->lock);
@@ -1882,6 +1965,452 @@ static long futex_wait_restart(struct restart_block *restart)
 }
 
 
+/*
+ * Adaptive spinning futex lock (FUTEX_LOCK).
+ *
+ * The futex word holds the TID of the owner, or 0 when the lock is
+ * free, with FUTEX_WAITERS set once somebody had to block on it:
+ *
+ *   lock:    if (cmpxchg(&var, 0, tid) != 0) futex(&var, FUTEX_LOCK);
+ *   unlock:  if (cmpxchg(&var, tid, 0) != tid) {
+ *                    var = 0; futex(&var, FUTEX_WAKE, 1);
+ *            }
+ *
+ * Like the adaptive kernel mutexes, a contender keeps spinning while the
+ * owner is running on another cpu, as it is likely to release the lock
+ * soon, and only queues itself and goes to sleep when the owner got
+ * scheduled out.  A task which has slept once takes the lock with
+ * FUTEX_WAITERS set, since there may be other sleepers left behind it.
+ */
+#ifdef CONFIG_SMP
+/*
+ * Spin as long as the futex is held by the owner encoded in @uval and
+ * that owner is running.  Returns 1 if the owner changed, 0 if we should
+ * go to sleep instead.
+ */
+static int futex_spin_on_owner(u32 __user *uaddr, u32 uval)
+{
+	pid_t pid = uval & FUTEX_TID_MASK;
+	struct task_struct *owner;
+	u32 curval;
+	int ret = 1;
+
+	rcu_read_lock();
+	owner = find_task_by_vpid(pid);
+	if (owner)
+		get_task_struct(owner);
+	rcu_read_unlock();
+
+	if (!owner)
+		return 0;
+
+	preempt_disable();
+	for (;;) {
+		/*
+		 * Stop when the owner got scheduled out, and leave faults
+		 * on the futex word to the slow path.
+		 */
+		if (!task_curr(owner) || need_resched() ||
+		    signal_pending(current) ||
+		    get_futex_value_locked(&curval, uaddr)) {
+			ret = 0;
+			break;
+		}
+		/* Owner changed (or released the lock), re-assess */
+		if ((curval & FUTEX_TID_MASK) != pid)
+			break;
+
+		cpu_relax();
+	}
+	preempt_enable();
+	put_task_struct(owner);
+
+	return ret;
+}
+#else
+static inline int futex_spin_on_owner(u32 __user *uaddr, u32 uval)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Try to take the lock with @newval, spinning while the owner runs.
+ * Returns 1 if we got the lock, 0 if we have to block, or an error.
+ */
+static int futex_lock_spin(u32 __user *uaddr, u32 newval)
+{
+	u32 curval;
+
+	for (;;) {
+		curval = cmpxchg_futex_value_locked(uaddr, 0, newval);
+		if (unlikely(curval == -EFAULT)) {
+			if (fault_in_user_writeable(uaddr))
+				return -EFAULT;
+			continue;
+		}
+		if (!curval)
+			return 1;
+		if ((curval & FUTEX_TID_MASK) == (newval & FUTEX_TID_MASK))
+			return -EDEADLK;
+
+		if (!futex_spin_on_owner(uaddr, curval))
+			return 0;
+	}
+}
+
+/*
+ * We were woken up to take the lock, but are about to return an error.
+ * Take it if it is free; otherwise pass the wakeup on to the next
+ * waiter, which would be left sleeping behind an owner that may never
+ * call FUTEX_WAKE.  Returns 1 if we got the lock.
+ */
+static int futex_lock_handoff(u32 __user *uaddr, int fshared, u32 tid)
+{
+	if (!cmpxchg_futex_value_locked(uaddr, 0, tid | FUTEX_WAITERS))
+		return 1;
+
+	futex_wake(uaddr, fshared, 1, FUTEX_BITSET_MATCH_ANY);
+	return 0;
+}
+
+static int futex_lock(u32 __user *uaddr, int fshared, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_hash_bucket *hb;
+	u32 tid = task_pid_vnr(current);
+	u32 uval, curval;
+	struct futex_q q;
+	int ret, woken;
+
+	q.pi_state = NULL;
+	q.bitset = FUTEX_BITSET_MATCH_ANY;
+	q.rt_waiter = NULL;
+	q.requeue_pi_key = NULL;
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+	ret = futex_lock_spin(uaddr, tid);
+	if (ret)
+		goto out_lock;
+
+retry:
+	q.key = FUTEX_KEY_INIT;
+	ret = get_futex_key(uaddr, fshared, &q.key);
+	if (unlikely(ret != 0))
+		goto out;
+
+retry_private:
+	hb = queue_lock(&q);
+
+	ret = get_futex_value_locked(&uval, uaddr);
+	if (ret)
+		goto uaddr_faulted;
+
+	/*
+	 * Under the hb lock, either take the lock or make sure that
+	 * FUTEX_WAITERS is set before we queue, so that the unlocker
+	 * will see it and wake us up.
+	 */
+	for (;;) {
+		if (!uval) {
+			curval = cmpxchg_futex_value_locked(uaddr, 0,
+						tid | FUTEX_WAITERS);
+			if (!curval) {
+				queue_unlock(&q, hb);
+				put_futex_key(fshared, &q.key);
+				ret = 0;
+				goto out;
+			}
+		} else if ((uval & FUTEX_TID_MASK) == tid) {
+			queue_unlock(&q, hb);
+			put_futex_key(fshared, &q.key);
+			ret = -EDEADLK;
+			goto out;
+		} else if (uval & FUTEX_WAITERS) {
+			break;
+		} else {
+			curval = cmpxchg_futex_value_locked(uaddr, uval,
+						uval | FUTEX_WAITERS);
+			if (curval == uval)
+				break;
+		}
+		if (unlikely(curval == -EFAULT))
+			goto uaddr_faulted;
+		uval = curval;
+	}
+
+	/* queue_me and wait for wakeup, timeout, or a signal. */
+	futex_wait_queue_me(hb, &q, to);
+
+	/* unqueue_me() drops q.key ref */
+	woken = !unqueue_me(&q);
+
+	ret = 0;
+	if (to && !to->task)
+		ret = -ETIMEDOUT;
+	else if (signal_pending(current))
+		ret = abs_time ? -EINTR : -ERESTARTNOINTR;
+	if (ret) {
+		/*
+		 * A FUTEX_WAKE from the unlocker picked us while we were
+		 * leaving: don't lose it, take the lock or hand it on.
+		 */
+		if (woken && futex_lock_handoff(uaddr, fshared, tid))
+			ret = 0;
+		goto out;
+	}
+
+	/* Woken up (or spuriously): try again, spinning if worthwhile */
+	ret = futex_lock_spin(uaddr, tid | FUTEX_WAITERS);
+	if (!ret)
+		goto retry;
+
+out_lock:
+	if (ret == 1)
+		ret = 0;
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+	return ret;
+
+uaddr_faulted:
+	queue_unlock(&q, hb);
+
+	ret = fault_in_user_writeable(uaddr);
+	if (ret)
+		goto out_put_key;
+
+	if (!fshared)
+		goto retry_private;
+
+	put_futex_key(fshared, &q.key);
+	goto retry;
+
+out_put_key:
+	put_futex_key(fshared, &q.key);
+	goto out;
+}
+
+
+/*
+ * unqueue_multiple() - Remove several futexes from their hash buckets
+ * @qs:		array of futex_q's
+ * @count:	number of futexes in @qs
+ *
+ * Returns the index of the first futex that was woken up (or -1 if none
+ * was) and drops the key references of all of them.
+ */
+static int unqueue_multiple(struct futex_q *qs, int count)
+{
+	int ret = -1;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&qs[i]) && ret < 0)
+			ret = i;
+	}
+	return ret;
+}
+
+/*
+ * futex_wait_multiple_setup() - Prepare to wait on and queue several futexes
+ * @qs:		array of futex_q's, with their bitsets set up
+ * @wb:		the futexes to wait on
+ * @count:	number of futexes
+ * @fshared:	whether the futexes are shared
+ * @woken:	index of the futex that got woken while we were setting up
+ *
+ * This is futex_wait_setup() followed by queue_me() for each futex.  The
+ * task state is set before the first futex is queued, so a wakeup of any
+ * of them after that point is not lost.  If one of the values does not
+ * match, everything that was queued is unqueued again.
+ *
+ * Returns 0 with all futexes queued, 1 if one of them was woken up during
+ * the setup (its index in @woken), or an error with nothing queued.
+ */
+static int futex_wait_multiple_setup(struct futex_q *qs,
+				     struct futex_wait_block *wb, int count,
+				     int fshared, int *woken)
+{
+	struct futex_hash_bucket *hb;
+	u32 uval;
+	int i, ret;
+
+retry:
+	for (i = 0; i < count; i++) {
+		qs[i].key = FUTEX_KEY_INIT;
+		ret = get_futex_key(wb[i].uaddr, fshared, &qs[i].key);
+		if (unlikely(ret)) {
+			while (--i >= 0)
+				put_futex_key(fshared, &qs[i].key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		struct futex_q *q = &qs[i];
+
+		hb = queue_lock(q);
+
+		ret = get_futex_value_locked(&uval, wb[i].uaddr);
+		if (ret || uval != wb[i].val) {
+			u32 __user *uaddr = wb[i].uaddr;
+			int j;
+
+			queue_unlock(q, hb);
+			__set_current_state(TASK_RUNNING);
+
+			*woken = unqueue_multiple(qs, i);
+			for (j = i; j < count; j++)
+				put_futex_key(fshared, &qs[j].key);
+			if (*woken >= 0)
+				return 1;
+
+			if (!ret)
+				return -EWOULDBLOCK;
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+
+		/* queue_me() drops the hb lock */
+		queue_me(q, hb);
+	}
+	return 0;
+}
+
+/**
+ * futex_wait_multiple() - Wait on several futexes at once
+ * @wb:		the futexes to wait on, copied from user space
+ * @count:	number of futexes in @wb
+ * @fshared:	whether the futexes are shared
+ * @abs_time:	absolute CLOCK_MONOTONIC timeout, or NULL
+ *
+ * Returns the index in @wb of a futex that was woken up, or an error.
+ */
+int futex_wait_multiple(struct futex_wait_block *wb, unsigned int count,
+			int fshared, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_q *qs;
+	int i, ret, woken;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	qs = kcalloc(count, sizeof(*qs), GFP_KERNEL);
+	if (!qs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (!wb[i].bitset) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+		qs[i].bitset = wb[i].bitset;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+	for (;;) {
+		ret = futex_wait_multiple_setup(qs, wb, count, fshared, &woken);
+		if (ret) {
+			if (ret > 0)
+				ret = woken;
+			break;
+		}
+
+		if (to) {
+			hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+			if (!hrtimer_active(&to->timer))
+				to->task = NULL;
+		}
+
+		/*
+		 * Skip the schedule() if one of the futexes has been woken
+		 * already, see futex_wait_queue_me().
+		 */
+		for (i = 0; i < count; i++) {
+			if (plist_node_empty(&qs[i].list))
+				break;
+		}
+		if (i == count && (!to || to->task))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* unqueue_multiple() drops the key refs */
+		ret = unqueue_multiple(qs, count);
+		if (ret >= 0)
+			break;
+
+		ret = -ETIMEDOUT;
+		if (to && !to->task)
+			break;
+
+		/*
+		 * Without a timeout the call can just be restarted; with
+		 * one, the relative timeout would be applied again.
+		 */
+		if (signal_pending(current)) {
+			ret = abs_time ? -EINTR : -ERESTARTSYS;
+			break;
+		}
+		/* Spurious wakeup, wait again */
+	}
+
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(qs);
+	return ret;
+}
+
+static int futex_wait_multiple_user(void __user *uaddr, unsigned int count,
+				    int fshared, ktime_t *abs_time)
+{
+	struct futex_wait_block *wb;
+	int ret;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	wb = kmalloc(count * sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	if (copy_from_user(wb, uaddr, count * sizeof(*wb)))
+		ret = -EFAULT;
+	else
+		ret = futex_wait_multiple(wb, count, fshared, abs_time);
+
+	kfree(wb);
+	return ret;
+}
+
+
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
  * and failed. The kernel side here does the whole locking operation:
@@ -2596,6 +3125,13 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		ret = futex_requeue(uaddr, fshared, uaddr2, val, val2, &val3,
 				    1);
 		break;
+	case FUTEX_LOCK:
+		if (futex_cmpxchg_enabled)
+			ret = futex_lock(uaddr, fshared, timeout);
+		break;
+	case FUTEX_WAIT_MULTIPLE:
+		ret = futex_wait_multiple_user(uaddr, val, fshared, timeout);
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -2614,14 +3150,16 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI || cmd == FUTEX_LOCK ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK ||
+		    cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -2636,10 +3174,76 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+#ifdef CONFIG_DEBUG_FS
+#define FUTEX_CHAIN_SLOTS	6	/* 0, 1, 2-3, 4-7, 8-15, 16+ */
+
+static int futex_hash_show(struct seq_file *m, void *v)
+{
+	unsigned long chains[FUTEX_CHAIN_SLOTS] = { 0, };
+	unsigned long queued = 0, collisions = 0, longest = 0;
+	unsigned long i;
+	int cpu;
+
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+		struct futex_q *this;
+		unsigned long len = 0;
+
+		spin_lock(&hb->lock);
+		plist_for_each_entry(this, &hb->chain, list)
+			len++;
+		spin_unlock(&hb->lock);
+
+		longest = max(longest, len);
+		chains[min_t(unsigned long, len ? ilog2(len) + 1 : 0,
+			     FUTEX_CHAIN_SLOTS - 1)]++;
+		cond_resched();
+	}
+
+	for_each_possible_cpu(cpu) {
+		queued += per_cpu(futex_hash_stats, cpu).queued;
+		collisions += per_cpu(futex_hash_stats, cpu).collisions;
+	}
+
+	seq_printf(m, "buckets          %lu\n", futex_hashsize);
+	seq_printf(m, "private_tables   %d\n",
+		   atomic_read(&nr_futex_private_hashes));
+	seq_printf(m, "queued           %lu\n", queued);
+	seq_printf(m, "collisions       %lu\n", collisions);
+	seq_printf(m, "longest_chain    %lu\n", longest);
+	seq_printf(m, "chains_0         %lu\n", chains[0]);
+	seq_printf(m, "chains_1         %lu\n", chains[1]);
+	seq_printf(m, "chains_2_3       %lu\n", chains[2]);
+	seq_printf(m, "chains_4_7       %lu\n", chains[3]);
+	seq_printf(m, "chains_8_15      %lu\n", chains[4]);
+	seq_printf(m, "chains_16_more   %lu\n", chains[5]);
+	return 0;
+}
+
+static int futex_hash_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_show, NULL);
+}
+
+static const struct file_operations futex_hash_fops = {
+	.open		= futex_hash_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_debugfs_init(void)
+{
+	debugfs_create_file("futex_hash", 0400, NULL, NULL, &futex_hash_fops);
+	return 0;
+}
+late_initcall(futex_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
 	u32 curval;
-	int i;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2655,10 +3259,18 @@ static int __init futex_init(void)
 	if (curval == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain, &futex_queues[i].lock);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+	futex_queues = alloc_large_system_hash("futex",
+					       sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
+	futex_hash_init_buckets(futex_queues, futex_hashsize);
 
 	return 0;
 }
@@ -10,6 +10,7 @@
 #include <linux/compat.h>
 #include <linux/nsproxy.h>
 #include <linux/futex.h>
+#include <linux/slab.h>
 
 #include <asm/uaccess.h>
 
@@ -170,6 +171,38 @@ err_unlock:
 	return ret;
 }
 
+static long compat_futex_wait_multiple(void __user *uaddr, unsigned int count,
+				       int fshared, ktime_t *abs_time)
+{
+	struct compat_futex_wait_block __user *cwb = uaddr;
+	struct compat_futex_wait_block cblock;
+	struct futex_wait_block *wb;
+	unsigned int i;
+	long ret = 0;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	wb = kmalloc(count * sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&cblock, &cwb[i], sizeof(cblock))) {
+			ret = -EFAULT;
+			break;
+		}
+		wb[i].uaddr = compat_ptr(cblock.uaddr);
+		wb[i].val = cblock.val;
+		wb[i].bitset = cblock.bitset;
+	}
+	if (!ret)
+		ret = futex_wait_multiple(wb, count, fshared, abs_time);
+
+	kfree(wb);
+	return ret;
+}
+
 asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 		struct compat_timespec __user *utime, u32 __user *uaddr2,
 		u32 val3)
@@ -181,20 +214,25 @@ asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI || cmd == FUTEX_LOCK ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (get_compat_timespec(&ts, utime))
 			return -EFAULT;
 		if (!timespec_valid(&ts))
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK ||
+		    cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
 	if (cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE ||
 	    cmd == FUTEX_CMP_REQUEUE_PI || cmd == FUTEX_WAKE_OP)
 		val2 = (int) (unsigned long) utime;
+	if (cmd == FUTEX_WAIT_MULTIPLE)
+		return compat_futex_wait_multiple(uaddr, val,
+				!(op & FUTEX_PRIVATE_FLAG), tp);
 
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
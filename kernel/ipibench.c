@@ -0,0 +1,171 @@
+/*
+ * kernel/ipibench.c
+ *
+ * Cross-cpu function call benchmark.
+ *
+ * Measures, from one cpu:
+ *  - the round trip of a synchronous call to one other cpu,
+ *  - the throughput of asynchronous calls queued back to back to that
+ *    cpu, which may be run several per IPI,
+ *  - the round trip of a synchronous call to all other online cpus.
+ *
+ * Everything runs from module init, results go to the kernel log:
+ *
+ *   modprobe ipibench nr_calls=100000 target_cpu=1
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/cpu.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <asm/atomic.h>
+#include <asm/div64.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Cross-cpu function call benchmark");
+
+static unsigned long nr_calls = 100000;
+module_param(nr_calls, ulong, 0444);
+MODULE_PARM_DESC(nr_calls, "Number of calls per test");
+
+static int source_cpu = -1;
+module_param(source_cpu, int, 0444);
+MODULE_PARM_DESC(source_cpu, "Cpu sending the calls (default: current)");
+
+static int target_cpu = -1;
+module_param(target_cpu, int, 0444);
+MODULE_PARM_DESC(target_cpu, "Cpu receiving single calls (default: any other)");
+
+#define BENCH_BATCH	256
+
+static struct call_single_data *csds;
+static atomic_t nr_run;
+
+static void bench_noop(void *info)
+{
+}
+
+static void bench_count(void *info)
+{
+	atomic_inc(&nr_run);
+}
+
+/*
+ * Apply @op @nr times in batches, and return the average time per call
+ * in ns.  Preemption is disabled within a batch, so that all calls come
+ * from the source cpu; only the batches themselves are timed.
+ */
+static u64 bench_calls(unsigned long nr, void (*op)(int cpu, int n))
+{
+	unsigned long i;
+	u64 total = 0;
+
+	for (i = 0; i < nr; i += BENCH_BATCH) {
+		int n = min_t(unsigned long, BENCH_BATCH, nr - i);
+		ktime_t start;
+
+		preempt_disable();
+		start = ktime_get();
+		op(target_cpu, n);
+		total += ktime_to_ns(ktime_sub(ktime_get(), start));
+		preempt_enable();
+		cond_resched();
+	}
+	do_div(total, nr);
+	return total;
+}
+
+static void op_single(int cpu, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		smp_call_function_single(cpu, bench_noop, NULL, 1);
+}
+
+static void op_queued(int cpu, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		__smp_call_function_single(cpu, &csds[i], 0);
+	/* Calls to one cpu run in order: this one waits for all of them */
+	smp_call_function_single(cpu, bench_noop, NULL, 1);
+}
+
+static void op_many(int cpu, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		smp_call_function_many(cpu_online_mask, bench_noop, NULL, 1);
+}
+
+static int __init ipibench_init(void)
+{
+	cpumask_var_t old_mask;
+	u64 single, queued, many;
+	int i, ret = 0;
+
+	if (!nr_calls)
+		return -EINVAL;
+
+	if (!alloc_cpumask_var(&old_mask, GFP_KERNEL))
+		return -ENOMEM;
+	csds = kcalloc(BENCH_BATCH, sizeof(*csds), GFP_KERNEL);
+	if (!csds) {
+		ret = -ENOMEM;
+		goto out_mask;
+	}
+	for (i = 0; i < BENCH_BATCH; i++)
+		csds[i].func = bench_count;
+
+	get_online_cpus();
+	if (source_cpu < 0)
+		source_cpu = raw_smp_processor_id();
+	if (target_cpu < 0)
+		target_cpu = cpumask_any_but(cpu_online_mask, source_cpu);
+	if (source_cpu >= nr_cpu_ids || !cpu_online(source_cpu) ||
+	    target_cpu >= nr_cpu_ids || !cpu_online(target_cpu) ||
+	    target_cpu == source_cpu) {
+		printk(KERN_ERR "ipibench: need two distinct online cpus\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	cpumask_copy(old_mask, &current->cpus_allowed);
+	ret = set_cpus_allowed_ptr(current, cpumask_of(source_cpu));
+	if (ret)
+		goto out;
+
+	single = bench_calls(nr_calls, op_single);
+	queued = bench_calls(nr_calls, op_queued);
+	many = bench_calls(nr_calls, op_many);
+
+	set_cpus_allowed_ptr(current, old_mask);
+
+	printk(KERN_INFO "ipibench: cpu %d -> cpu %d: single %llu ns, "
+	       "queued %llu ns (%d run)\n", source_cpu, target_cpu,
+	       (unsigned long long)single, (unsigned long long)queued,
+	       atomic_read(&nr_run));
+	printk(KERN_INFO "ipibench: cpu %d -> %d other cpus: many %llu ns\n",
+	       source_cpu, num_online_cpus() - 1, (unsigned long long)many);
+out:
+	put_online_cpus();
+	kfree(csds);
+out_mask:
+	free_cpumask_var(old_mask);
+	return ret;
+}
+
+static void __exit ipibench_exit(void)
+{
+}
+
+module_init(ipibench_init);
+module_exit(ipibench_exit);
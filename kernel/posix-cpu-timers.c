@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -712,6 +713,26 @@ static int cpu_timer_sample_group(const clockid_t which_clock,
 	return 0;
 }
 
+/*
+ * A cpu running @p without the tick would not check a new expiry.  A
+ * process-wide clock samples every thread of the group, so kick all of
+ * their cpus.  Called with tasklist_lock or the siglock held.
+ */
+static void posix_cpu_timer_kick(struct task_struct *p, int thread)
+{
+	struct task_struct *t = p;
+
+	if (!tick_nohz_full_enabled())
+		return;
+	if (thread) {
+		tick_nohz_full_kick_cpu(task_cpu(p));
+		return;
+	}
+	do {
+		tick_nohz_full_kick_cpu(task_cpu(t));
+	} while_each_thread(p, t);
+}
+
 /*
  * Guts of sys_timer_settime for CPU timers.
  * This is called with the timer locked and interrupts disabled.
@@ -832,6 +853,7 @@ int posix_cpu_timer_set(struct k_itimer *timer, int flags,
 	    (timer->it_sigev_notify & ~SIGEV_THREAD_ID) != SIGEV_NONE &&
 	    cpu_time_before(timer->it_clock, val, new_expires)) {
 		arm_timer(timer, val);
+		posix_cpu_timer_kick(p, CPUCLOCK_PERTHREAD(timer->it_clock));
 	}
 
 	read_unlock(&tasklist_lock);
@@ -1386,6 +1408,27 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return sig->rlim[RLIMIT_CPU].rlim_cur != RLIM_INFINITY;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/**
+ * posix_cpu_timers_can_stop_tick - check whether @tsk needs the tick
+ *
+ * @tsk:	The task (thread) running on a full dynticks cpu.
+ *
+ * The CPU timers and the RLIMIT_CPU limit of @tsk are only checked from
+ * the tick.  Return true if there are none to check.
+ */
+int posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	struct signal_struct *sig = tsk->signal;
+
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return 0;
+	if (!task_cputime_zero(&sig->cputime_expires))
+		return 0;
+	return sig->rlim[RLIMIT_CPU].rlim_cur == RLIM_INFINITY;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1504,6 +1547,9 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			break;
 		}
 	}
+
+	/* setitimer() and RLIMIT_CPU both end up here */
+	posix_cpu_timer_kick(tsk, 0);
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -46,6 +46,11 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/tick.h>
+#include <linux/kthread.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "rcutree.h"
 
@@ -88,6 +93,10 @@ static int rcu_gp_in_progress(struct rcu_state *rsp)
 	return ACCESS_ONCE(rsp->completed) != ACCESS_ONCE(rsp->gpnum);
 }
 
+/* Set while an expedited grace period waits for this CPU. */
+static DEFINE_PER_CPU(int, rcu_exp_need_qs);
+static void rcu_exp_report(int cpu);
+
 /*
  * Note a quiescent state.  Because we do not need to know
  * how many quiescent states passed, just if there was at least
@@ -102,6 +111,8 @@ void rcu_sched_qs(int cpu)
 	barrier();
 	rdp->passed_quiesc = 1;
 	rcu_preempt_note_context_switch(cpu);
+	if (unlikely(per_cpu(rcu_exp_need_qs, cpu)))
+		rcu_exp_report(cpu);
 }
 
 void rcu_bh_qs(int cpu)
@@ -224,8 +235,14 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 	if (rdp->preemptable)
 		return 0;
 
-	/* The CPU is online, so send it a reschedule IPI. */
-	if (rdp->cpu != smp_processor_id())
+	/*
+	 * The CPU is online, so send it a reschedule IPI.  A full
+	 * dynticks CPU needs its tick back to report the quiescent
+	 * state instead.
+	 */
+	if (tick_nohz_full_cpu(rdp->cpu))
+		tick_nohz_full_kick_cpu(rdp->cpu);
+	else if (rdp->cpu != smp_processor_id())
 		smp_send_reschedule(rdp->cpu);
 	else
 		set_need_resched();
@@ -1325,9 +1342,13 @@ static void rcu_process_callbacks(struct softirq_action *unused)
 	smp_mb(); /* See above block comment. */
 }
 
+/*
+ * Queue a callback on the current CPU.  If @may_offload and the CPU is
+ * one of rcu_nocbs=, hand it to the CPU's kthread instead.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, int may_offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1345,6 +1366,10 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	 */
 	local_irq_save(flags);
 	rdp = rsp->rda[smp_processor_id()];
+	if (may_offload && rcu_nocb_enqueue(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
 	rcu_process_gp_end(rsp, rdp);
 	check_for_new_grace_period(rsp, rdp);
 
@@ -1385,7 +1410,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1394,7 +1419,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1480,6 +1505,16 @@ int rcu_needs_cpu(int cpu)
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+/*
+ * Check to see if this CPU needs the scheduling-clock tick for RCU,
+ * either for work to be done now or for callbacks still waiting.
+ * Used to decide whether a CPU running a task may stop its tick.
+ */
+int rcu_needs_tick(int cpu)
+{
+	return rcu_pending(cpu) || rcu_needs_cpu(cpu);
+}
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
@@ -1531,6 +1566,7 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	preempt_disable(); /* stop CPU_DYING from filling orphan_cbs_list */
 	rcu_adopt_orphan_cbs(rsp);
 	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	rcu_nocb_barrier(rsp);
 	preempt_enable(); /* CPU_DYING can again fill orphan_cbs_list */
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
@@ -1556,6 +1592,144 @@ void rcu_barrier_sched(void)
 }
 EXPORT_SYMBOL_GPL(rcu_barrier_sched);
 
+/*
+ * Expedited RCU-sched grace periods.  Instead of waiting for each CPU
+ * to notice the grace period from its scheduling-clock interrupt, IPI
+ * every online CPU that is not in dynticks idle.  A CPU interrupted in
+ * the idle loop reports its quiescent state right away, any other one
+ * is made to reschedule and reports it from rcu_sched_qs() at its next
+ * context switch.  No CPU gets stopped and nothing waits for a tick.
+ *
+ * Concurrent callers are batched: rcu_exp_seq is odd while an expedited
+ * grace period runs, and a caller that sees a full one start and end
+ * after it arrived just returns.
+ */
+static DEFINE_MUTEX(rcu_exp_mutex);
+static unsigned long rcu_exp_seq;
+static atomic_t rcu_exp_left;		/* CPUs still to report, plus one */
+static struct completion rcu_exp_done;
+static DECLARE_BITMAP(rcu_exp_cpus, NR_CPUS);	/* CPUs to IPI */
+
+/* Statistics, protected by rcu_exp_mutex. */
+static unsigned long rcu_exp_n_gps;	/* expedited GPs run */
+static unsigned long rcu_exp_n_batched;	/* callers served by another's GP */
+static unsigned long rcu_exp_n_ipis;	/* CPUs IPIed */
+static unsigned long rcu_exp_n_idle;	/* CPUs skipped in dynticks idle */
+
+static void rcu_exp_report(int cpu)
+{
+	if (xchg(&per_cpu(rcu_exp_need_qs, cpu), 0) &&
+	    atomic_dec_and_test(&rcu_exp_left))
+		complete(&rcu_exp_done);
+}
+
+/*
+ * Is the CPU in dynticks idle, and therefore in a quiescent state?
+ * Must be preceded by a memory barrier.
+ */
+static int rcu_exp_cpu_idle(int cpu)
+{
+#ifdef CONFIG_NO_HZ
+	struct rcu_dynticks *rdtp = &per_cpu(rcu_dynticks, cpu);
+
+	return (ACCESS_ONCE(rdtp->dynticks) & 0x1) == 0 &&
+	       (ACCESS_ONCE(rdtp->dynticks_nmi) & 0x1) == 0;
+#else /* #ifdef CONFIG_NO_HZ */
+	return 0;
+#endif /* #else #ifdef CONFIG_NO_HZ */
+}
+
+static void rcu_exp_ipi(void *unused)
+{
+	int cpu = smp_processor_id();
+
+	if (!per_cpu(rcu_exp_need_qs, cpu))
+		return;
+
+	/* Same test as rcu_check_callbacks() for the idle loop. */
+	if (idle_cpu(cpu) && !in_softirq() &&
+	    hardirq_count() <= (1 << HARDIRQ_SHIFT))
+		rcu_exp_report(cpu);
+	else
+		set_need_resched();
+}
+
+static void rcu_exp_run(void)
+{
+	struct cpumask *cpus = to_cpumask(rcu_exp_cpus);
+	int cpu, this_cpu;
+
+	init_completion(&rcu_exp_done);
+	atomic_set(&rcu_exp_left, 1);
+	cpumask_clear(cpus);
+
+	/* With preemption disabled, no CPU can go offline under us. */
+	preempt_disable();
+	this_cpu = smp_processor_id();
+	smp_mb(); /* Caller's updates before sampling dynticks state. */
+	for_each_online_cpu(cpu) {
+		/* We are not in a read-side critical section ourselves. */
+		if (cpu == this_cpu)
+			continue;
+		if (rcu_exp_cpu_idle(cpu)) {
+			rcu_exp_n_idle++;
+			continue;
+		}
+		atomic_inc(&rcu_exp_left);
+		per_cpu(rcu_exp_need_qs, cpu) = 1;
+		cpumask_set_cpu(cpu, cpus);
+	}
+	rcu_exp_n_ipis += cpumask_weight(cpus);
+	smp_call_function_many(cpus, rcu_exp_ipi, NULL, 0);
+	preempt_enable();
+
+	if (!atomic_dec_and_test(&rcu_exp_left))
+		wait_for_completion(&rcu_exp_done);
+	rcu_exp_n_gps++;
+}
+
+/**
+ * synchronize_sched_expedited - brute-force RCU-sched grace period
+ *
+ * Wait for an RCU-sched grace period, forcing every CPU through a
+ * quiescent state with an IPI rather than waiting for them to pass
+ * through one.  This costs an IPI and possibly a context switch on all
+ * non-idle CPUs, so it is meant for latency-sensitive slow paths only.
+ * Concurrent callers share grace periods.
+ */
+void synchronize_sched_expedited(void)
+{
+	unsigned long s;
+
+	if (rcu_blocking_is_gp())
+		return;
+
+	smp_mb(); /* Caller's updates before the snapshot. */
+	s = (ACCESS_ONCE(rcu_exp_seq) + 3) & ~0x1UL;
+	mutex_lock(&rcu_exp_mutex);
+	if ((long)(rcu_exp_seq - s) >= 0) {
+		rcu_exp_n_batched++;
+		mutex_unlock(&rcu_exp_mutex);
+		smp_mb(); /* Grace period before the caller's frees. */
+		return;
+	}
+	rcu_exp_seq++;
+	smp_mb(); /* Start of the grace period before sampling CPUs. */
+	rcu_exp_run();
+	smp_mb(); /* Quiescent states before the end of the grace period. */
+	rcu_exp_seq++;
+	mutex_unlock(&rcu_exp_mutex);
+}
+EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
+
+int rcu_expedited_torture_stats(char *page)
+{
+	return sprintf(page, "seq: %lu gps: %lu batched: %lu ipis: %lu "
+		       "idle: %lu\n", rcu_exp_seq, rcu_exp_n_gps,
+		       rcu_exp_n_batched, rcu_exp_n_ipis, rcu_exp_n_idle);
+}
+EXPORT_SYMBOL_GPL(rcu_expedited_torture_stats);
+
 /*
  * Do boot-time initialization of a CPU's per-CPU RCU data.
  */
@@ -1574,6 +1748,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	for (i = 0; i < RCU_NEXT_SIZE; i++)
 		rdp->nxttail[i] = &rdp->nxtlist;
 	rdp->qlen = 0;
+	rcu_boot_init_nocb_percpu_data(rdp);
 #ifdef CONFIG_NO_HZ
 	rdp->dynticks = &per_cpu(rcu_dynticks, cpu);
 #endif /* #ifdef CONFIG_NO_HZ */
@@ -1675,6 +1850,7 @@ int __cpuinit rcu_cpu_notify(struct notifier_block *self,
 	case CPU_UP_CANCELED:
 	case CPU_UP_CANCELED_FROZEN:
 		rcu_offline_cpu(cpu);
+		rcu_exp_report(cpu);
 		break;
 	default:
 		break;
@@ -200,6 +200,19 @@ struct rcu_data {
 	long n_rp_need_fqs;
 	long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) callbacks handed off to an rcu_nocbs= kthread. */
+	struct rcu_head *nocb_head;	/* CBs waiting for the kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs not yet invoked. */
+	struct rcu_head *nocb_gp_head;	/* CBs the kthread waits a GP for. */
+	struct rcu_head **nocb_gp_tail;
+	long nocb_q_count_max;		/* Largest backlog seen. */
+	unsigned long nocb_queued;	/* # CBs handed off since boot. */
+	unsigned long nocb_invoked;	/* # CBs invoked by the kthread. */
+	unsigned long nocb_gps;		/* # GPs waited for by the kthread. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 };
 
@@ -324,5 +337,8 @@ static int rcu_preempt_needs_cpu(int cpu);
 static void __cpuinit rcu_preempt_init_percpu_data(int cpu);
 static void rcu_preempt_send_cbs_to_orphanage(void);
 static void __init __rcu_init_preempt(void);
+static int rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head);
+static void rcu_nocb_barrier(struct rcu_state *rsp);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
 
 #endif /* #else #ifdef RCU_TREE_NONCORE */
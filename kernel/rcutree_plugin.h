@@ -394,7 +394,7 @@ static void rcu_preempt_process_callbacks(void)
  *
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -643,3 +643,344 @@ static void __init __rcu_init_preempt(void)
 }
 
 #endif /* #else #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * The CPUs given by rcu_nocbs= do not invoke their own RCU callbacks.
+ * call_rcu() on such a CPU just appends the callback to ->nocb_head,
+ * and a kthread serving a group of these CPUs waits for a grace period
+ * and invokes the callbacks.  The kthreads are not bound to any CPU, so
+ * they can be moved away from the CPUs they work for.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static int rcu_nocb_active;
+static int rcu_nocb_group_size;	/* CPUs per kthread, 0 for sqrt(nr_cpu_ids) */
+module_param(rcu_nocb_group_size, int, 0444);
+
+struct rcu_nocb_group {
+	wait_queue_head_t wq;
+	int kicked;			/* Callbacks queued since last pass */
+	int leader;			/* First CPU of the group */
+};
+static DEFINE_PER_CPU(struct rcu_nocb_group *, rcu_nocb_group);
+
+static struct rcu_nocb_flavor {
+	struct rcu_state *rsp;
+	const char *name;
+} rcu_nocb_flavors[] = {
+	{ &rcu_sched_state, "rcu_sched" },
+	{ &rcu_bh_state, "rcu_bh" },
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	{ &rcu_preempt_state, "rcu_preempt" },
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+};
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	if (cpulist_parse(str, rcu_nocb_mask) < 0) {
+		printk(KERN_WARNING "RCU: Incorrect rcu_nocbs cpumask\n");
+		cpumask_clear(rcu_nocb_mask);
+	}
+	rcu_nocb_active = !cpumask_empty(rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static int rcu_is_nocb_cpu(int cpu)
+{
+	return rcu_nocb_active && cpumask_test_cpu(cpu, rcu_nocb_mask);
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_head = NULL;
+	rdp->nocb_tail = &rdp->nocb_head;
+	atomic_long_set(&rdp->nocb_q_count, 0);
+}
+
+/*
+ * Hand a callback queued on an rcu_nocbs= CPU to its kthread, returning
+ * 0 if the CPU invokes its own callbacks.  Callbacks are appended by
+ * swinging ->nocb_tail first, so any number of CPUs may queue at once,
+ * and the kthread may briefly see a callback whose ->next is not yet
+ * linked.  Called with interrupts disabled.
+ */
+static int rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	struct rcu_nocb_group *grp;
+	struct rcu_head **old_tail;
+	long qlen;
+
+	if (!rcu_is_nocb_cpu(rdp->cpu))
+		return 0;
+
+	qlen = atomic_long_inc_return(&rdp->nocb_q_count);
+	if (qlen > rdp->nocb_q_count_max)
+		rdp->nocb_q_count_max = qlen;
+	rdp->nocb_queued++;
+
+	old_tail = xchg(&rdp->nocb_tail, &head->next);
+	ACCESS_ONCE(*old_tail) = head;
+
+	/* Only the first callback since the kthread's last pass wakes it. */
+	grp = per_cpu(rcu_nocb_group, rdp->cpu);
+	if (old_tail == &rdp->nocb_head && grp != NULL) {
+		ACCESS_ONCE(grp->kicked) = 1;
+		wake_up(&grp->wq);
+	}
+	return 1;
+}
+
+/*
+ * on_each_cpu() leaves out offline CPUs, but their kthread may still be
+ * working off callbacks they queued earlier.  Queue the barrier callback
+ * behind those.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	struct rcu_head *head;
+	struct rcu_data *rdp;
+	unsigned long flags;
+	int cpu;
+
+	if (!rcu_nocb_active)
+		return;
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = rsp->rda[cpu];
+		if (cpu_online(cpu) || !atomic_long_read(&rdp->nocb_q_count))
+			continue;
+		head = &per_cpu(rcu_barrier_head, cpu);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		/* As from __call_rcu(), see rcu_nocb_invoke() */
+		local_irq_save(flags);
+		rcu_nocb_enqueue(rdp, head);
+		local_irq_restore(flags);
+	}
+}
+
+struct rcu_nocb_gp {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *head)
+{
+	complete(&container_of(head, struct rcu_nocb_gp, head)->done);
+}
+
+/*
+ * Wait for a grace period of the given flavor.  This cannot just be
+ * synchronize_sched() and friends: the kthread may be running on one of
+ * the CPUs it serves, which would hand the callback back to it.
+ */
+static void rcu_nocb_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_nocb_gp gp;
+
+	init_completion(&gp.done);
+	__call_rcu(&gp.head, rcu_nocb_gp_done, rsp, 0);
+	wait_for_completion(&gp.done);
+}
+
+/*
+ * Invoke the callbacks that the grace period just waited for.
+ */
+static void rcu_nocb_invoke(struct rcu_data *rdp)
+{
+	struct rcu_head *list = rdp->nocb_gp_head;
+	struct rcu_head **tail = rdp->nocb_gp_tail;
+	struct rcu_head *next;
+	long count = 0;
+
+	while (list) {
+		/*
+		 * Wait for an enqueue in progress to link in its callback,
+		 * it does so with interrupts disabled right after the xchg().
+		 */
+		next = ACCESS_ONCE(list->next);
+		while (next == NULL && &list->next != tail) {
+			cpu_relax();
+			next = ACCESS_ONCE(list->next);
+		}
+		local_bh_disable();
+		list->func(list);
+		local_bh_enable();
+		count++;
+		list = next;
+		cond_resched();
+	}
+	rdp->nocb_gp_head = NULL;
+	rdp->nocb_invoked += count;
+	atomic_long_sub(count, &rdp->nocb_q_count);
+}
+
+/*
+ * Take the callbacks queued by the group's CPUs so far, wait for one
+ * grace period for all of them, and invoke them.
+ */
+static void rcu_nocb_do_batch(struct rcu_state *rsp,
+			      struct rcu_nocb_group *grp)
+{
+	struct rcu_data *rdp;
+	int cpu, found = 0;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (per_cpu(rcu_nocb_group, cpu) != grp)
+			continue;
+		rdp = rsp->rda[cpu];
+		rdp->nocb_gp_head = ACCESS_ONCE(rdp->nocb_head);
+		if (rdp->nocb_gp_head == NULL)
+			continue;
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		rdp->nocb_gp_tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		found = 1;
+	}
+	if (!found)
+		return;
+
+	rcu_nocb_wait_gp(rsp);
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (per_cpu(rcu_nocb_group, cpu) != grp)
+			continue;
+		rdp = rsp->rda[cpu];
+		if (rdp->nocb_gp_head == NULL)
+			continue;
+		rdp->nocb_gps++;
+		rcu_nocb_invoke(rdp);
+	}
+}
+
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_nocb_group *grp = arg;
+	int i;
+
+	for (;;) {
+		wait_event_interruptible(grp->wq, ACCESS_ONCE(grp->kicked));
+		ACCESS_ONCE(grp->kicked) = 0;
+		/* Clear before looking at the queues, or a kick may be lost */
+		smp_mb();
+		for (i = 0; i < ARRAY_SIZE(rcu_nocb_flavors); i++)
+			rcu_nocb_do_batch(rcu_nocb_flavors[i].rsp, grp);
+	}
+	return 0;
+}
+
+/*
+ * Split the rcu_nocbs= CPUs into groups and start a kthread for each.
+ * Callbacks queued before this are picked up by the first pass.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	struct rcu_nocb_group *grp = NULL;
+	struct task_struct *t;
+	int cpu, size, n = 0;
+	char buf[128];
+
+	if (!rcu_nocb_active)
+		return 0;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+
+	size = rcu_nocb_group_size;
+	if (size <= 0)
+		size = max_t(int, int_sqrt(nr_cpu_ids), 1);
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		if (n++ % size == 0) {
+			grp = kzalloc(sizeof(*grp), GFP_KERNEL);
+			BUG_ON(grp == NULL);
+			init_waitqueue_head(&grp->wq);
+			grp->kicked = 1;
+			grp->leader = cpu;
+		}
+		per_cpu(rcu_nocb_group, cpu) = grp;
+	}
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		grp = per_cpu(rcu_nocb_group, cpu);
+		if (grp->leader != cpu)
+			continue;
+		t = kthread_run(rcu_nocb_kthread, grp, "rcuo/%d", cpu);
+		BUG_ON(IS_ERR(t));
+	}
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "RCU: Offloading callbacks of CPUs %s, "
+	       "%d per kthread\n", buf, size);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int show_rcu_nocb(struct seq_file *m, void *unused)
+{
+	struct rcu_data *rdp;
+	int cpu, i;
+
+	if (!rcu_nocb_active)
+		return 0;
+	for (i = 0; i < ARRAY_SIZE(rcu_nocb_flavors); i++) {
+		seq_printf(m, "%s:\n", rcu_nocb_flavors[i].name);
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = rcu_nocb_flavors[i].rsp->rda[cpu];
+			seq_printf(m, "%3d%cgrp=%d ql=%ld qlmax=%ld "
+				   "queued=%lu invoked=%lu gps=%lu\n",
+				   cpu, cpu_is_offline(cpu) ? '!' : ' ',
+				   per_cpu(rcu_nocb_group, cpu)->leader,
+				   atomic_long_read(&rdp->nocb_q_count),
+				   rdp->nocb_q_count_max, rdp->nocb_queued,
+				   rdp->nocb_invoked, rdp->nocb_gps);
+		}
+	}
+	return 0;
+}
+
+static int rcu_nocb_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_rcu_nocb, NULL);
+}
+
+static const struct file_operations rcu_nocb_fops = {
+	.owner = THIS_MODULE,
+	.open = rcu_nocb_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init rcu_nocb_debugfs_init(void)
+{
+	if (rcu_nocb_active)
+		debugfs_create_file("rcu_nocb", 0444, NULL, NULL,
+				    &rcu_nocb_fops);
+	return 0;
+}
+late_initcall(rcu_nocb_debugfs_init);
+
+#endif /* #ifdef CONFIG_DEBUG_FS */
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+/*
+ * Without CONFIG_RCU_NOCB_CPU, all CPUs invoke their own callbacks.
+ */
+static int rcu_nocb_enqueue(struct rcu_data *rdp, struct rcu_head *head)
+{
+	return 0;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -76,6 +76,7 @@
 #include <asm/irq_regs.h>
 
 #include "sched_cpupri.h"
+#include "workqueue_sched.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/sched.h>
@@ -623,6 +624,9 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+	unsigned int ttwu_llc_idle;	/* placed through the llc idle mask */
+	unsigned int ttwu_migrate;	/* placed away from the previous cpu */
+	unsigned int ttwu_cold;		/* ... and its last level cache */
 
 	/* BKL stats */
 	unsigned int bkl_count;
@@ -1260,6 +1264,17 @@ void wake_up_idle_cpu(int cpu)
 }
 #endif /* CONFIG_NO_HZ */
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Called with interrupts disabled by a full dynticks cpu: the tick is
+ * only needed to preempt the current task when there is another one.
+ */
+int sched_can_stop_tick(void)
+{
+	return this_rq()->nr_running <= 1;
+}
+#endif
+
 static u64 sched_avg_period(void)
 {
 	return (u64)sysctl_sched_time_avg * NSEC_PER_MSEC / 2;
@@ -1845,6 +1860,44 @@ static inline void __set_task_cpu(struct task_struct *p, unsigned int cpu)
 #endif
 }
 
+#ifdef CONFIG_SMP
+/*
+ * Idle cpus of each last level cache.  The cpus sharing a cache are
+ * identified by the first cpu of their largest SD_SHARE_PKG_RESOURCES
+ * domain, and that cpu's llc_idle_mask holds the idle cpus among them.
+ * A cpu sets its bit when it switches to the idle task and clears it
+ * when it switches away, so the mask can be slightly stale: users have
+ * to check idle_cpu() before trusting a bit.
+ */
+static DEFINE_PER_CPU(int, sd_llc_id);
+static DEFINE_PER_CPU(cpumask_var_t, llc_idle_mask);
+
+static inline struct cpumask *cpu_llc_idle_mask(int cpu)
+{
+	return per_cpu(llc_idle_mask, per_cpu(sd_llc_id, cpu));
+}
+
+static inline int cpus_share_cache(int this_cpu, int that_cpu)
+{
+	return per_cpu(sd_llc_id, this_cpu) == per_cpu(sd_llc_id, that_cpu);
+}
+
+static inline void update_llc_idle(int cpu, int idle)
+{
+	struct cpumask *mask = cpu_llc_idle_mask(cpu);
+
+	/* Avoid dirtying the shared cacheline when nothing changes */
+	if (cpumask_test_cpu(cpu, mask) == !!idle)
+		return;
+	if (idle)
+		cpumask_set_cpu(cpu, mask);
+	else
+		cpumask_clear_cpu(cpu, mask);
+}
+#else
+static inline void update_llc_idle(int cpu, int idle) { }
+#endif
+
 #include "sched_stats.h"
 #include "sched_idletask.c"
 #include "sched_fair.c"
@@ -1860,6 +1913,10 @@ static inline void __set_task_cpu(struct task_struct *p, unsigned int cpu)
 static void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+	/* A full dynticks cpu needs the tick again to preempt */
+	if (rq->nr_running == 2)
+		tick_nohz_full_kick_cpu(cpu_of(rq));
 }
 
 static void dec_nr_running(struct rq *rq)
@@ -2446,8 +2503,12 @@ static int try_to_wake_up(struct task_struct *p, unsigned int state,
 		p->sched_class->task_waking(rq, p);
 
 	cpu = select_task_rq(rq, p, SD_BALANCE_WAKE, wake_flags);
-	if (cpu != orig_cpu)
+	if (cpu != orig_cpu) {
+		schedstat_inc(this_rq(), ttwu_migrate);
+		if (!cpus_share_cache(cpu, orig_cpu))
+			schedstat_inc(this_rq(), ttwu_cold);
 		set_task_cpu(p, cpu);
+	}
 	__task_rq_unlock(rq);
 
 	rq = cpu_rq(cpu);
@@ -2492,6 +2553,10 @@ out_activate:
 	activate_task(rq, p, 1);
 	success = 1;
 
+	/* if a worker is waking up, notify workqueue */
+	if (p->flags & PF_WQ_WORKER)
+		wq_worker_waking_up(p, cpu_of(rq));
+
 	/*
 	 * Only attribute actual wakeups done by this task.
 	 */
@@ -2535,6 +2600,44 @@ out:
 	return success;
 }
 
+/**
+ * try_to_wake_up_local - try to wake up a local task with rq lock held
+ * @p: the thread to be awakened
+ *
+ * Put @p on the run-queue if it's not already there.  The caller must
+ * ensure that this_rq() is locked, @p is bound to this_rq() and not
+ * the current task.  this_rq() stays locked over invocation.
+ */
+static void try_to_wake_up_local(struct task_struct *p)
+{
+	struct rq *rq = task_rq(p);
+	int success = 0;
+
+	BUG_ON(rq != this_rq());
+	BUG_ON(p == current);
+
+	if (!(p->state & TASK_NORMAL))
+		return;
+
+	if (!p->se.on_rq) {
+		if (likely(!task_running(rq, p))) {
+			schedstat_inc(p, se.nr_wakeups);
+			schedstat_inc(p, se.nr_wakeups_local);
+		}
+		activate_task(rq, p, 1);
+		success = 1;
+	}
+
+	trace_sched_wakeup(rq, p, success);
+	check_preempt_curr(rq, p, 0);
+
+	p->state = TASK_RUNNING;
+#ifdef CONFIG_SMP
+	if (p->sched_class->task_woken)
+		p->sched_class->task_woken(rq, p);
+#endif
+}
+
 /**
  * wake_up_process - Wake up a specific process
  * @p: The process to be woken up.
@@ -2612,6 +2715,16 @@ static void __sched_fork(struct task_struct *p)
 	p->se.on_rq = 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_NUMA_BALANCING
+	p->numa_scan_seq = p->mm ? p->mm->numa_scan_seq : 0;
+	p->numa_scan_period = sysctl_numa_balancing_scan_period_min;
+	p->numa_work_pending = 0;
+	p->numa_preferred_nid = -1;
+	p->node_stamp = 0ULL;
+	p->numa_pages_migrated = 0;
+	p->numa_faults = NULL;
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	//INIT_HLIST_HEAD(&p->preempt_notifiers);
 #endif
@@ -2803,6 +2916,11 @@ static inline void
 prepare_task_switch(struct rq *rq, struct task_struct *prev,
 		    struct task_struct *next)
 {
+	/* Only a switch to or from the idle task changes the idle mask */
+	if (next == rq->idle)
+		update_llc_idle(cpu_of(rq), 1);
+	else if (prev == rq->idle)
+		update_llc_idle(cpu_of(rq), 0);
 	fire_sched_out_preempt_notifiers(prev, next);
 	prepare_lock_switch(rq, next);
 	prepare_arch_switch(next);
@@ -3269,6 +3387,28 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 		return 0;
 	}
 
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * Pull tasks towards the node most of their memory lives on, even
+	 * when cache hot, and resist pulling them away from it until the
+	 * balancing keeps failing.
+	 */
+	if (sysctl_numa_balancing && p->numa_preferred_nid != -1) {
+		int src_nid = cpu_to_node(task_cpu(p));
+		int dst_nid = cpu_to_node(this_cpu);
+
+		if (src_nid != dst_nid) {
+			if (dst_nid == p->numa_preferred_nid)
+				return 1;
+			if (src_nid == p->numa_preferred_nid &&
+			    sd->nr_balance_failed <= sd->cache_nice_tries) {
+				schedstat_inc(p, se.nr_failed_migrations_hot);
+				return 0;
+			}
+		}
+	}
+#endif
+
 	/*
 	 * Aggressive migration if:
 	 * 1) task is cache cold, or
@@ -5584,8 +5724,22 @@ need_resched_nonpreemptible:
 	if (prev->state && !(preempt_count() & PREEMPT_ACTIVE)) {
 		if (unlikely(signal_pending_state(prev->state, prev)))
 			prev->state = TASK_RUNNING;
-		else
+		else {
+			/*
+			 * If a worker is going to sleep, notify and
+			 * ask workqueue whether it wants to wake up a
+			 * task to maintain concurrency.  If so, wake
+			 * up the task.
+			 */
+			if (prev->flags & PF_WQ_WORKER) {
+				struct task_struct *to_wakeup;
+
+				to_wakeup = wq_worker_sleeping(prev, cpu);
+				if (to_wakeup)
+					try_to_wake_up_local(to_wakeup);
+			}
 			deactivate_task(rq, prev, 1);
+		}
 		switch_count = &prev->nvcsw;
 	}
 
@@ -5620,6 +5774,8 @@ need_resched_nonpreemptible:
 	if (unlikely(reacquire_kernel_lock(current) < 0))
 		goto need_resched_nonpreemptible;
 
+	tick_nohz_full_check();
+
 	preempt_enable_no_resched();
 	if (need_resched())
 		goto need_resched;
@@ -7313,11 +7469,6 @@ fail:
 	return ret;
 }
 
-#define RCU_MIGRATION_IDLE	0
-#define RCU_MIGRATION_NEED_QS	1
-#define RCU_MIGRATION_GOT_QS	2
-#define RCU_MIGRATION_MUST_SYNC	3
-
 /*
  * migration_thread - this is a highprio system thread that performs
  * thread migration by bumping thread off CPU then 'pushing' onto
@@ -7325,7 +7476,6 @@ fail:
  */
 static int migration_thread(void *data)
 {
-	int badcpu;
 	int cpu = (long)data;
 	struct rq *rq;
 
@@ -7360,17 +7510,8 @@ static int migration_thread(void *data)
 		req = list_entry(head->next, struct migration_req, list);
 		list_del_init(head->next);
 
-		if (req->task != NULL) {
-			spin_unlock(&rq->lock);
-			__migrate_task(req->task, cpu, req->dest_cpu);
-		} else if (likely(cpu == (badcpu = smp_processor_id()))) {
-			req->dest_cpu = RCU_MIGRATION_GOT_QS;
-			spin_unlock(&rq->lock);
-		} else {
-			req->dest_cpu = RCU_MIGRATION_MUST_SYNC;
-			spin_unlock(&rq->lock);
-			WARN_ONCE(1, "migration_thread() on CPU %d, expected %d\n", badcpu, cpu);
-		}
+		spin_unlock(&rq->lock);
+		__migrate_task(req->task, cpu, req->dest_cpu);
 		local_irq_enable();
 
 		complete(&req->done);
@@ -8150,6 +8291,37 @@ static struct root_domain *alloc_rootdomain(void)
 	return rd;
 }
 
+/*
+ * Find the cpus sharing the last level cache with 'cpu' in its new
+ * domains 'sd', and move its idle bit over to their idle mask.
+ */
+static void update_llc_id(int cpu, struct sched_domain *sd)
+{
+	struct rq *rq = cpu_rq(cpu);
+	struct sched_domain *llc = NULL;
+	unsigned long flags;
+	int id = cpu;
+
+	for (; sd; sd = sd->parent) {
+		if (!(sd->flags & SD_SHARE_PKG_RESOURCES))
+			break;
+		llc = sd;
+	}
+	if (llc)
+		id = cpumask_first(sched_domain_span(llc));
+
+	if (id == per_cpu(sd_llc_id, cpu))
+		return;
+
+	/* Serialize against the cpu switching to or from idle */
+	spin_lock_irqsave(&rq->lock, flags);
+	cpumask_clear_cpu(cpu, cpu_llc_idle_mask(cpu));
+	per_cpu(sd_llc_id, cpu) = id;
+	if (idle_cpu(cpu))
+		cpumask_set_cpu(cpu, cpu_llc_idle_mask(cpu));
+	spin_unlock_irqrestore(&rq->lock, flags);
+}
+
 /*
  * Attach the domain 'sd' to 'cpu' as its base domain. Callers must
  * hold the hotplug lock.
@@ -8187,6 +8359,7 @@ cpu_attach_domain(struct sched_domain *sd, struct root_domain *rd, int cpu)
 
 	rq_attach_root(rq, rd);
 	rcu_assign_pointer(rq->sd, sd);
+	update_llc_id(cpu, sd);
 }
 
 /* cpus with isolated domains */
@@ -9515,7 +9688,7 @@ void __init sched_init(void)
 	alloc_size *= 2;
 #endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
-	alloc_size += num_possible_cpus() * cpumask_size();
+	alloc_size += 2 * num_possible_cpus() * cpumask_size();
 #endif
 	/*
 	 * As sched_init() is called before page_alloc is setup,
@@ -9559,6 +9732,10 @@ void __init sched_init(void)
 			per_cpu(load_balance_tmpmask, i) = (void *)ptr;
 			ptr += cpumask_size();
 		}
+		for_each_possible_cpu(i) {
+			per_cpu(llc_idle_mask, i) = (void *)ptr;
+			ptr += cpumask_size();
+		}
 #endif /* CONFIG_CPUMASK_OFFSTACK */
 	}
 
@@ -9673,6 +9850,7 @@ void __init sched_init(void)
 		rq->next_balance = jiffies;
 		rq->push_cpu = 0;
 		rq->cpu = i;
+		per_cpu(sd_llc_id, i) = i;
 		rq->online = 0;
 		rq->migration_thread = NULL;
 		rq->idle_stamp = 0;
@@ -10974,113 +11152,3 @@ struct cgroup_subsys cpuacct_subsys = {
 	.subsys_id = cpuacct_subsys_id,
 };*/
 #endif	/* CONFIG_CGROUP_CPUACCT */
-
-#ifndef CONFIG_SMP
-/*
-int rcu_expedited_torture_stats(char *page)
-{
-	return 0;
-}
-EXPORT_SYMBOL_GPL(rcu_expedited_torture_stats);
-
-void synchronize_sched_expedited(void)
-{
-}
-EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
-*/
-#else /* #ifndef CONFIG_SMP */
-
-static DEFINE_PER_CPU(struct migration_req, rcu_migration_req);
-static DEFINE_MUTEX(rcu_sched_expedited_mutex);
-
-#define RCU_EXPEDITED_STATE_POST -2
-#define RCU_EXPEDITED_STATE_IDLE -1
-
-static int rcu_expedited_state = RCU_EXPEDITED_STATE_IDLE;
-
-int rcu_expedited_torture_stats(char *page)
-{
-	int cnt = 0;
-	int cpu;
-
-	cnt += sprintf(&page[cnt], "state: %d /", rcu_expedited_state);
-	for_each_online_cpu(cpu) {
-		 cnt += sprintf(&page[cnt], " %d:%d",
-				cpu, per_cpu(rcu_migration_req, cpu).dest_cpu);
-	}
-	cnt += sprintf(&page[cnt], "\n");
-	return cnt;
-}
-EXPORT_SYMBOL_GPL(rcu_expedited_torture_stats);
-
-static long synchronize_sched_expedited_count;
-
-/*
- * Wait for an rcu-sched grace period to elapse, but use "big hammer"
- * approach to force grace period to end quickly.  This consumes
- * significant time on all CPUs, and is thus not recommended for
- * any sort of common-case code.
- *
- * Note that it is illegal to call this function while holding any
- * lock that is acquired by a CPU-hotplug notifier.  Failing to
- * observe this restriction will result in deadlock.
- */
-void synchronize_sched_expedited(void)
-{
-	int cpu;
-	unsigned long flags;
-	bool need_full_sync = 0;
-	struct rq *rq;
-	struct migration_req *req;
-	long snap;
-	int trycount = 0;
-
-	smp_mb();  /* ensure prior mod happens before capturing snap. */
-	snap = ACCESS_ONCE(synchronize_sched_expedited_count) + 1;
-	get_online_cpus();
-	while (!mutex_trylock(&rcu_sched_expedited_mutex)) {
-		put_online_cpus();
-		if (trycount++ < 10)
-			udelay(trycount * num_online_cpus());
-		else {
-			synchronize_sched();
-			return;
-		}
-		if (ACCESS_ONCE(synchronize_sched_expedited_count) - snap > 0) {
-			smp_mb(); /* ensure test happens before caller kfree */
-			return;
-		}
-		get_online_cpus();
-	}
-	rcu_expedited_state = RCU_EXPEDITED_STATE_POST;
-	for_each_online_cpu(cpu) {
-		rq = cpu_rq(cpu);
-		req = &per_cpu(rcu_migration_req, cpu);
-		init_completion(&req->done);
-		req->task = NULL;
-		req->dest_cpu = RCU_MIGRATION_NEED_QS;
-		spin_lock_irqsave(&rq->lock, flags);
-		list_add(&req->list, &rq->migration_queue);
-		spin_unlock_irqrestore(&rq->lock, flags);
-		wake_up_process(rq->migration_thread);
-	}
-	for_each_online_cpu(cpu) {
-		rcu_expedited_state = cpu;
-		req = &per_cpu(rcu_migration_req, cpu);
-		rq = cpu_rq(cpu);
-		wait_for_completion(&req->done);
-		spin_lock_irqsave(&rq->lock, flags);
-		if (unlikely(req->dest_cpu == RCU_MIGRATION_MUST_SYNC))
-			need_full_sync = 1;
-		req->dest_cpu = RCU_MIGRATION_IDLE;
-		spin_unlock_irqrestore(&rq->lock, flags);
-	}
-	rcu_expedited_state = RCU_EXPEDITED_STATE_IDLE;
-	mutex_unlock(&rcu_sched_expedited_mutex);
-	put_online_cpus();
-	if (need_full_sync)
-		synchronize_sched();
-}
-EXPORT_SYMBOL_GPL(synchronize_sched_expedited);
-
-#endif /* #else #ifndef CONFIG_SMP */
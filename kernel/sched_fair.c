@@ -21,6 +21,7 @@
  */
 
 #include <linux/latencytop.h>
+#include <linux/mempolicy.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -1383,6 +1384,24 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * Find an idle cpu sharing the last level cache with 'target' that 'p'
+ * may run on, from the cache's idle mask.  Returns -1 if there is none.
+ */
+static int select_idle_llc(struct task_struct *p, int target)
+{
+	int i;
+
+	for_each_cpu_and(i, cpu_llc_idle_mask(target), &p->cpus_allowed) {
+		/* The mask may be stale, see update_llc_idle() */
+		if (idle_cpu(i) && cpu_active(i)) {
+			schedstat_inc(this_rq(), ttwu_llc_idle);
+			return i;
+		}
+	}
+	return -1;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
@@ -1407,6 +1426,15 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	if (target == prev_cpu && idle_cpu(prev_cpu))
 		return prev_cpu;
 
+	/*
+	 * The largest domain searched below is the last level cache of
+	 * target, whose idle cpus we already know.
+	 */
+	if (sched_feat(LLC_IDLE_WAKEUP)) {
+		i = select_idle_llc(p, target);
+		return i >= 0 ? i : target;
+	}
+
 	/*
 	 * Otherwise, iterate the domains and find an elegible idle cpu.
 	 */
@@ -1460,6 +1488,22 @@ select_task_rq_fair(struct rq *rq, struct task_struct *p, int sd_flag, int wake_
 		    cpumask_test_cpu(cpu, &p->cpus_allowed))
 			want_affine = 1;
 		new_cpu = prev_cpu;
+
+		/*
+		 * If cpu and prev_cpu share a cache, wake_affine() could
+		 * only choose between two cache-hot targets, and
+		 * select_idle_sibling() would search the same cache for an
+		 * idle cpu anyway.  Skip the domain walk if there is one.
+		 */
+		if (want_affine && sched_feat(LLC_IDLE_WAKEUP) &&
+		    cpus_share_cache(cpu, prev_cpu)) {
+			if (idle_cpu(prev_cpu))
+				return prev_cpu;
+			new_cpu = select_idle_llc(p, prev_cpu);
+			if (new_cpu >= 0)
+				return new_cpu;
+			new_cpu = prev_cpu;
+		}
 	}
 
 	for_each_domain(cpu, tmp) {
@@ -1964,6 +2008,195 @@ static void rq_offline_fair(struct rq *rq)
 /*
  * scheduler tick hitting a task of our scheduling class:
  */
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing.
+ *
+ * After every numa_balancing_scan_period of runtime, a task makes the ptes
+ * of the next numa_balancing_scan_size MB of its address space PROT_NONE.
+ * The NUMA hinting faults that follow (see do_numa_page()) tell us which
+ * node the memory the task uses is on: misplaced pages are migrated to the
+ * faulting node, and the node with most faults becomes the preferred node
+ * of the task, which the load balancer honours in can_migrate_task().
+ *
+ * A task whose pages stay where they are scans less and less often, while
+ * migrating pages brings it back to the fastest scan rate.
+ */
+int sysctl_numa_balancing = 1;
+unsigned int sysctl_numa_balancing_scan_delay = 1000;		/* ms */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;	/* ms */
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;	/* ms */
+unsigned int sysctl_numa_balancing_scan_size = 256;		/* MB */
+
+/*
+ * Once per full pass over the address space, pick the node with most
+ * faults as the preferred one and decay the fault counts.
+ */
+static void task_numa_placement(struct task_struct *p)
+{
+	int seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	unsigned long max_faults = 0;
+	int max_nid = -1;
+	int nid;
+
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	for_each_online_node(nid) {
+		unsigned long faults = p->numa_faults[nid];
+
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+		p->numa_faults[nid] = faults >> 1;
+	}
+	p->numa_preferred_nid = max_nid;
+}
+
+/*
+ * Called for each NUMA hinting fault of current, with the node the page
+ * is on after it has been migrated, if it was.
+ */
+void task_numa_fault(int node, int pages, int migrated)
+{
+	struct task_struct *p = current;
+
+	if (!sysctl_numa_balancing)
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		p->numa_faults = kzalloc(sizeof(*p->numa_faults) * nr_node_ids,
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+	}
+
+	task_numa_placement(p);
+	p->numa_faults[node] += pages;
+
+	if (migrated) {
+		p->numa_pages_migrated += pages;
+		p->numa_scan_period = sysctl_numa_balancing_scan_period_min;
+	} else {
+		p->numa_scan_period = min(sysctl_numa_balancing_scan_period_max,
+					  p->numa_scan_period + 10);
+	}
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+static int vma_numa_scannable(struct vm_area_struct *vma)
+{
+	if (!vma_migratable(vma) || (vma->vm_flags & VM_MIXEDMAP))
+		return 0;
+	/* Inaccessible vmas never take hinting faults */
+	if (!(vma->vm_flags & (VM_READ|VM_WRITE|VM_EXEC)))
+		return 0;
+	/* Read-only file mappings are mostly shared library text */
+	if (vma->vm_file && (vma->vm_flags & (VM_READ|VM_WRITE)) == VM_READ)
+		return 0;
+	return 1;
+}
+
+/*
+ * Make the next part of the address space of current take NUMA hinting
+ * faults.  Runs on the way back to user mode, see task_tick_numa().
+ */
+void task_numa_work(void)
+{
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long migrate, next_scan, now = jiffies;
+	unsigned long start, end;
+	long pages;
+
+	p->numa_work_pending = 0;
+	if (!mm || (p->flags & PF_EXITING))
+		return;
+
+	/*
+	 * All the threads of a process get here; only the first one after
+	 * numa_next_scan does the scan.
+	 */
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = (long)sysctl_numa_balancing_scan_size << (20 - PAGE_SHIFT);
+	start = mm->numa_scan_offset;
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, start);
+	if (!vma) {
+		mm->numa_scan_seq++;
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_numa_scannable(vma))
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = min(vma->vm_end, start + (pages << PAGE_SHIFT));
+			pages -= change_prot_numa(vma, start, end);
+			start = end;
+			if (pages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+out:
+	/*
+	 * Continue where we stopped next time.  Having reached the end of
+	 * the address space, start over: that completes a pass.
+	 */
+	if (vma) {
+		mm->numa_scan_offset = start;
+	} else {
+		mm->numa_scan_offset = 0;
+		mm->numa_scan_seq++;
+	}
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Scan based on the runtime of the task, so that tasks which hardly run
+ * do not pay for it.  The scan needs mmap_sem, so it is done on the way
+ * back to user mode.
+ */
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	u64 period, now;
+
+	if (!sysctl_numa_balancing || !curr->mm || curr->numa_work_pending ||
+	    (curr->flags & (PF_EXITING | PF_KTHREAD)))
+		return;
+
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+	if (now - curr->node_stamp > period) {
+		curr->node_stamp = now;
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			curr->numa_work_pending = 1;
+			set_tsk_thread_flag(curr, TIF_NOTIFY_RESUME);
+		}
+	}
+}
+#else
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 {
 	struct cfs_rq *cfs_rq;
@@ -1973,6 +2206,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
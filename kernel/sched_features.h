@@ -74,6 +74,13 @@ SCHED_FEAT(SYNC_WAKEUPS, 1)
  */
 SCHED_FEAT(AFFINE_WAKEUPS, 1)
 
+/*
+ * When the waker and the wakee's previous cpu share a last level
+ * cache, place the wakee on an idle cpu of that cache straight from
+ * the cache's idle mask, without walking the sched domains.
+ */
+SCHED_FEAT(LLC_IDLE_WAKEUP, 1)
+
 /*
  * Weaken SYNC hint based on overlap
  */
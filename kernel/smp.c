@@ -3,8 +3,6 @@
  *
  * (C) Jens Axboe <jens.axboe@oracle.com> 2008
  */
-#include <linux/rcupdate.h>
-#include <linux/rculist.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/percpu.h>
@@ -12,34 +10,34 @@
 #include <linux/smp.h>
 #include <linux/cpu.h>
 
-static DEFINE_PER_CPU(struct call_single_queue, call_single_queue);
+/*
+ * Every cpu has a single queue of pending calls, for both single and
+ * multi-cpu calls.  It is a lock-free singly linked stack: senders push
+ * with cmpxchg, the target takes the whole stack with one xchg.  Only
+ * the sender that finds the queue empty raises the IPI, so calls queued
+ * while the target has not yet got around to an earlier one are all run
+ * from that one interrupt.
+ */
+struct call_single_queue {
+	struct call_single_data	*first;
+};
 
-static struct {
-	struct list_head	queue;
-	spinlock_t		lock;
-} call_function __cacheline_aligned_in_smp =
-	{
-		.queue		= LIST_HEAD_INIT(call_function.queue),
-		.lock		= __SPIN_LOCK_UNLOCKED(call_function.lock),
-	};
+static DEFINE_PER_CPU(struct call_single_queue, call_single_queue);
 
 enum {
 	CSD_FLAG_LOCK		= 0x01,
 };
 
 struct call_function_data {
-	struct call_single_data	csd;
-	atomic_t		refs;
+	struct call_single_data	*csd;		/* percpu, one per target */
 	cpumask_var_t		cpumask;
-};
-
-struct call_single_queue {
-	struct list_head	list;
-	spinlock_t		lock;
+	cpumask_var_t		cpumask_ipi;
 };
 
 static DEFINE_PER_CPU(struct call_function_data, cfd_data);
 
+static void flush_call_single_queue(struct call_single_queue *q);
+
 static int
 hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 {
@@ -52,15 +50,39 @@ hotplug_cfd(struct notifier_block *nfb, unsigned long action, void *hcpu)
 		if (!zalloc_cpumask_var_node(&cfd->cpumask, GFP_KERNEL,
 				cpu_to_node(cpu)))
 			return NOTIFY_BAD;
+		if (!zalloc_cpumask_var_node(&cfd->cpumask_ipi, GFP_KERNEL,
+				cpu_to_node(cpu))) {
+			free_cpumask_var(cfd->cpumask);
+			return NOTIFY_BAD;
+		}
+		cfd->csd = alloc_percpu(struct call_single_data);
+		if (!cfd->csd) {
+			free_cpumask_var(cfd->cpumask);
+			free_cpumask_var(cfd->cpumask_ipi);
+			return NOTIFY_BAD;
+		}
 		break;
 
 #ifdef CONFIG_HOTPLUG_CPU
+	case CPU_DYING:
+	case CPU_DYING_FROZEN:
+		/*
+		 * Runs on the dying cpu with interrupts disabled, after it
+		 * was marked offline: nobody queues new calls for it, but
+		 * those already queued must still run or their senders
+		 * would wait forever.
+		 */
+		flush_call_single_queue(&per_cpu(call_single_queue, cpu));
+		break;
+
 	case CPU_UP_CANCELED:
 	case CPU_UP_CANCELED_FROZEN:
 
 	case CPU_DEAD:
 	case CPU_DEAD_FROZEN:
 		free_cpumask_var(cfd->cpumask);
+		free_cpumask_var(cfd->cpumask_ipi);
+		free_percpu(cfd->csd);
 		break;
 #endif
 	};
@@ -75,14 +97,6 @@ static struct notifier_block __cpuinitdata hotplug_cfd_notifier = {
 static int __cpuinit init_call_single_data(void)
 {
 	void *cpu = (void *)(long)smp_processor_id();
-	int i;
-
-	for_each_possible_cpu(i) {
-		struct call_single_queue *q = &per_cpu(call_single_queue, i);
-
-		spin_lock_init(&q->lock);
-		INIT_LIST_HEAD(&q->list);
-	}
 
 	hotplug_cfd(&hotplug_cfd_notifier, CPU_UP_PREPARE, cpu);
 	register_cpu_notifier(&hotplug_cfd_notifier);
@@ -129,6 +143,27 @@ static void csd_unlock(struct call_single_data *data)
 	data->flags &= ~CSD_FLAG_LOCK;
 }
 
+/*
+ * Push @data on @q.  Returns 1 if the queue was empty, in which case
+ * the caller has to send the IPI.
+ *
+ * The cmpxchg is a full barrier, so the queued entry is visible to the
+ * target before the IPI is sent, and before the target's xchg in
+ * flush_call_single_queue() if no IPI is sent because one is already
+ * on its way.
+ */
+static int csq_push(struct call_single_data *data, struct call_single_queue *q)
+{
+	struct call_single_data *first;
+
+	do {
+		first = ACCESS_ONCE(q->first);
+		data->next = first;
+	} while (cmpxchg(&q->first, first, data) != first);
+
+	return first == NULL;
+}
+
 /*
  * Insert a previously allocated call_single_data element
  * for execution on the given CPU. data must already have
@@ -137,27 +172,7 @@ static void csd_unlock(struct call_single_data *data)
 static
 void generic_exec_single(int cpu, struct call_single_data *data, int wait)
 {
-	struct call_single_queue *dst = &per_cpu(call_single_queue, cpu);
-	unsigned long flags;
-	int ipi;
-
-	spin_lock_irqsave(&dst->lock, flags);
-	ipi = list_empty(&dst->list);
-	list_add_tail(&data->list, &dst->list);
-	spin_unlock_irqrestore(&dst->lock, flags);
-
-	/*
-	 * The list addition should be visible before sending the IPI
-	 * handler locks the list to pull the entry off it because of
-	 * normal cache coherency rules implied by spinlocks.
-	 *
-	 * If IPIs can go out of order to the cache coherency protocol
-	 * in an architecture, sufficient synchronisation should be added
-	 * to arch code to make it appear to obey cache coherency WRT
-	 * locking and barrier primitives. Generic code isn't really
-	 * equipped to do the right thing...
-	 */
-	if (ipi)
+	if (csq_push(data, &per_cpu(call_single_queue, cpu)))
 		arch_send_call_function_single_ipi(cpu);
 
 	if (wait)
@@ -165,54 +180,54 @@ void generic_exec_single(int cpu, struct call_single_data *data, int wait)
 }
 
 /*
- * Invoked by arch to handle an IPI for call function. Must be called with
- * interrupts disabled.
+ * Run all calls queued on @q.  Must be called on the cpu owning @q,
+ * with interrupts disabled.
  */
-void generic_smp_call_function_interrupt(void)
+static void flush_call_single_queue(struct call_single_queue *q)
 {
-	struct call_function_data *data;
-	int cpu = get_cpu();
-
-	/*
-	 * Shouldn't receive this interrupt on a cpu that is not yet online.
-	 */
-	WARN_ON_ONCE(!cpu_online(cpu));
-
-	/*
-	 * Ensure entry is visible on call_function_queue after we have
-	 * entered the IPI. See comment in smp_call_function_many.
-	 * If we don't have this, then we may miss an entry on the list
-	 * and never get another IPI to process it.
-	 */
-	smp_mb();
-
-	/*
-	 * It's ok to use list_for_each_rcu() here even though we may
-	 * delete 'pos', since list_del_rcu() doesn't clear ->next
-	 */
-	list_for_each_entry_rcu(data, &call_function.queue, csd.list) {
-		int refs;
+	struct call_single_data *data, *next, *list = NULL;
+	unsigned int data_flags;
 
-		if (!cpumask_test_and_clear_cpu(cpu, data->cpumask))
-			continue;
+	/* Entries were pushed at the head; run them in queueing order */
+	data = xchg(&q->first, NULL);
+	while (data) {
+		next = data->next;
+		data->next = list;
+		list = data;
+		data = next;
+	}
 
-		data->csd.func(data->csd.info);
+	while (list) {
+		data = list;
+		list = data->next;
 
-		refs = atomic_dec_return(&data->refs);
-		WARN_ON(refs < 0);
-		if (!refs) {
-			spin_lock(&call_function.lock);
-			list_del_rcu(&data->csd.list);
-			spin_unlock(&call_function.lock);
-		}
+		/*
+		 * 'data' can be invalid after this call if flags == 0
+		 * (when called through generic_exec_single()),
+		 * so save them away before making the call:
+		 */
+		data_flags = data->flags;
 
-		if (refs)
-			continue;
+		data->func(data->info);
 
-		csd_unlock(&data->csd);
+		/*
+		 * Unlocked CSDs are valid through generic_exec_single():
+		 */
+		if (data_flags & CSD_FLAG_LOCK)
+			csd_unlock(data);
 	}
+}
 
-	put_cpu();
+/*
+ * Invoked by arch to handle an IPI for call function. Must be called with
+ * interrupts disabled.
+ *
+ * Single and multi-cpu calls share the per-cpu queue, so this is the same
+ * as the single call interrupt; archs just use a different vector.
+ */
+void generic_smp_call_function_interrupt(void)
+{
+	generic_smp_call_function_single_interrupt();
 }
 
 /*
@@ -221,40 +236,12 @@ void generic_smp_call_function_interrupt(void)
  */
 void generic_smp_call_function_single_interrupt(void)
 {
-	struct call_single_queue *q = &__get_cpu_var(call_single_queue);
-	unsigned int data_flags;
-	LIST_HEAD(list);
-
 	/*
 	 * Shouldn't receive this interrupt on a cpu that is not yet online.
 	 */
 	WARN_ON_ONCE(!cpu_online(smp_processor_id()));
 
-	spin_lock(&q->lock);
-	list_replace_init(&q->list, &list);
-	spin_unlock(&q->lock);
-
-	while (!list_empty(&list)) {
-		struct call_single_data *data;
-
-		data = list_entry(list.next, struct call_single_data, list);
-		list_del(&data->list);
-
-		/*
-		 * 'data' can be invalid after this call if flags == 0
-		 * (when called through generic_exec_single()),
-		 * so save them away before making the call:
-		 */
-		data_flags = data->flags;
-
-		data->func(data->info);
-
-		/*
-		 * Unlocked CSDs are valid through generic_exec_single():
-		 */
-		if (data_flags & CSD_FLAG_LOCK)
-			csd_unlock(data);
-	}
+	flush_call_single_queue(&__get_cpu_var(call_single_queue));
 }
 
 static DEFINE_PER_CPU(struct call_single_data, csd_data);
@@ -346,6 +333,7 @@ void __smp_call_function_single(int cpu, struct call_single_data *data,
 
 	generic_exec_single(cpu, data, wait);
 }
+EXPORT_SYMBOL_GPL(__smp_call_function_single);
 
 /**
  * smp_call_function_many(): Run a function on a set of other CPUs.
@@ -362,12 +350,14 @@ void __smp_call_function_single(int cpu, struct call_single_data *data,
  * You must not call this function with disabled interrupts or from a
  * hardware interrupt handler or from a bottom half handler. Preemption
  * must be disabled when calling this function.
+ *
+ * Each target cpu gets its own call_single_data from this cpu's set, and
+ * only targets whose queue was empty are sent an IPI, all in one go.
  */
 void smp_call_function_many(const struct cpumask *mask,
 			    void (*func)(void *), void *info, bool wait)
 {
 	struct call_function_data *data;
-	unsigned long flags;
 	int cpu, next_cpu, this_cpu = smp_processor_id();
 
 	/*
@@ -400,36 +390,30 @@ void smp_call_function_many(const struct cpumask *mask,
 	}
 
 	data = &__get_cpu_var(cfd_data);
-	csd_lock(&data->csd);
 
-	data->csd.func = func;
-	data->csd.info = info;
 	cpumask_and(data->cpumask, mask, cpu_online_mask);
 	cpumask_clear_cpu(this_cpu, data->cpumask);
-	atomic_set(&data->refs, cpumask_weight(data->cpumask));
+	cpumask_clear(data->cpumask_ipi);
 
-	spin_lock_irqsave(&call_function.lock, flags);
-	/*
-	 * Place entry at the _HEAD_ of the list, so that any cpu still
-	 * observing the entry in generic_smp_call_function_interrupt()
-	 * will not miss any other list entries:
-	 */
-	list_add_rcu(&data->csd.list, &call_function.queue);
-	spin_unlock_irqrestore(&call_function.lock, flags);
+	for_each_cpu(cpu, data->cpumask) {
+		struct call_single_data *csd = per_cpu_ptr(data->csd, cpu);
 
-	/*
-	 * Make the list addition visible before sending the ipi.
-	 * (IPIs must obey or appear to obey normal Linux cache
-	 * coherency rules -- see comment in generic_exec_single).
-	 */
-	smp_mb();
+		csd_lock(csd);
+		csd->func = func;
+		csd->info = info;
+		if (csq_push(csd, &per_cpu(call_single_queue, cpu)))
+			cpumask_set_cpu(cpu, data->cpumask_ipi);
+	}
 
-	/* Send a message to all CPUs in the map */
-	arch_send_call_function_ipi_mask(data->cpumask);
+	/* Send a message to all CPUs in the map with nothing pending yet */
+	if (!cpumask_empty(data->cpumask_ipi))
+		arch_send_call_function_ipi_mask(data->cpumask_ipi);
 
 	/* Optionally wait for the CPUs to complete */
-	if (wait)
-		csd_lock_wait(&data->csd);
+	if (wait) {
+		for_each_cpu(cpu, data->cpumask)
+			csd_lock_wait(per_cpu_ptr(data->csd, cpu));
+	}
 }
 EXPORT_SYMBOL(smp_call_function_many);
 
@@ -458,23 +442,3 @@ int smp_call_function(void (*func)(void *), void *info, int wait)
 	return 0;
 }
 EXPORT_SYMBOL(smp_call_function);
-
-void ipi_call_lock(void)
-{
-	spin_lock(&call_function.lock);
-}
-
-void ipi_call_unlock(void)
-{
-	spin_unlock(&call_function.lock);
-}
-
-void ipi_call_lock_irq(void)
-{
-	spin_lock_irq(&call_function.lock);
-}
-
-void ipi_call_unlock_irq(void)
-{
-	spin_unlock_irq(&call_function.lock);
-}
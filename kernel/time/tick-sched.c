@@ -17,6 +17,7 @@
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
@@ -292,9 +293,11 @@ void tick_nohz_stop_sched_tick(int inidle)
 	}
 	/*
 	 * Do not stop the tick, if we are only one off
-	 * or if the cpu is required for rcu
+	 * or if the cpu is required for rcu. The timekeeper
+	 * keeps ticking for the full dynticks cpus.
 	 */
-	if (!ts->tick_stopped && delta_jiffies == 1)
+	if (!ts->tick_stopped && (delta_jiffies == 1 ||
+	    (tick_nohz_full_enabled() && cpu == tick_do_timer_cpu)))
 		goto out;
 
 	/* Schedule the tick, if we are at least one jiffie off */
@@ -502,6 +505,204 @@ void tick_nohz_restart_sched_tick(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: the cpus in tick_nohz_full_mask also stop the tick
+ * while they run a single task.  The tick would only interrupt that
+ * task to find out that nothing else wants the cpu.
+ *
+ * The tick is pushed out to the next timer wheel event, but no further
+ * than one second.  That residual tick puts the cpu back to periodic
+ * ticks for one period and irq_exit() then stops the tick again.  These
+ * cpus never take the do_timer() duty: the boot cpu keeps the tick and
+ * does the timekeeping for them.
+ */
+cpumask_var_t tick_nohz_full_mask;
+int tick_nohz_full_running;
+
+static DEFINE_PER_CPU(struct call_single_data, tick_nohz_full_csd);
+static DEFINE_PER_CPU(unsigned long, tick_nohz_full_kicked);
+
+static int __init setup_tick_nohz_full(char *str)
+{
+	int cpu = smp_processor_id();
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing boot CPU %d from nohz_full "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	return 1;
+}
+
+__setup("nohz_full=", setup_tick_nohz_full);
+
+static int tick_nohz_full_can_stop(struct tick_sched *ts, int cpu)
+{
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return 0;
+
+	/* The idle code stops the tick its own way */
+	if (ts->inidle || idle_cpu(cpu) || !cpu_online(cpu))
+		return 0;
+
+	if (!sched_can_stop_tick())
+		return 0;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return 0;
+
+	if (rcu_needs_tick(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu))
+		return 0;
+
+	return !local_softirq_pending();
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ts->tick_stopped = 0;
+	ts->tick_stopped_full = 0;
+	tick_nohz_restart(ts, ktime_get());
+}
+
+static void tick_nohz_full_stop_tick(struct tick_sched *ts)
+{
+	unsigned long seq, last_jiffies, next_jiffies;
+	ktime_t last_update, expires;
+	long delta_jiffies;
+
+	/* Read jiffies and the time when jiffies were updated last */
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	next_jiffies = get_next_timer_interrupt(last_jiffies);
+	delta_jiffies = min_t(unsigned long, next_jiffies - last_jiffies, HZ);
+	if ((long)(next_jiffies - last_jiffies) <= 1) {
+		/* Something is due with the next tick anyway */
+		if (ts->tick_stopped_full)
+			tick_nohz_full_restart(ts);
+		return;
+	}
+
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+
+	/* Skip reprogram of event if its not changed */
+	if (ts->tick_stopped_full &&
+	    ktime_equal(expires, hrtimer_get_expires(&ts->sched_timer)))
+		return;
+
+	if (!ts->tick_stopped_full) {
+		ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->tick_stopped = 1;
+		ts->tick_stopped_full = 1;
+		ts->full_jiffies = last_jiffies;
+		ts->full_stops++;
+	}
+
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+		hrtimer_start(&ts->sched_timer, expires,
+			      HRTIMER_MODE_ABS_PINNED);
+		/* Check, if the timer was already in the past */
+		if (hrtimer_active(&ts->sched_timer))
+			return;
+	} else {
+		hrtimer_set_expires(&ts->sched_timer, expires);
+		if (!tick_program_event(expires, 0))
+			return;
+	}
+	/* We are past the event already, just keep ticking */
+	tick_nohz_full_restart(ts);
+}
+
+/**
+ * __tick_nohz_full_check - stop or restart the tick of a full dynticks cpu
+ * @irq:	called from irq_exit()
+ */
+void __tick_nohz_full_check(int irq)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+
+	cpu = smp_processor_id();
+	ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (irq && ts->tick_stopped_full)
+		ts->full_irqs++;
+
+	if (tick_nohz_full_can_stop(ts, cpu))
+		tick_nohz_full_stop_tick(ts);
+	else if (ts->tick_stopped_full)
+		tick_nohz_full_restart(ts);
+
+	local_irq_restore(flags);
+}
+
+static void tick_nohz_full_kick_func(void *info)
+{
+	/* irq_exit() reevaluates the tick once this IPI is done */
+	clear_bit(0, &__get_cpu_var(tick_nohz_full_kicked));
+}
+
+/**
+ * __tick_nohz_full_kick_cpu - make a full dynticks cpu reevaluate its tick
+ * @cpu:	the cpu to kick
+ *
+ * May be called with interrupts disabled and with the timer wheel base
+ * or runqueue lock of @cpu held, so the IPI does not do anything itself
+ * and there is at most one of them in flight per cpu.
+ */
+void __tick_nohz_full_kick_cpu(int cpu)
+{
+	struct call_single_data *csd;
+
+	if (cpu == smp_processor_id()) {
+		/* Stopped or not, schedule() takes another look */
+		if (per_cpu(tick_cpu_sched, cpu).tick_stopped_full)
+			set_tsk_need_resched(current);
+		return;
+	}
+
+	if (!cpu_online(cpu) ||
+	    test_and_set_bit(0, &per_cpu(tick_nohz_full_kicked, cpu)))
+		return;
+
+	csd = &per_cpu(tick_nohz_full_csd, cpu);
+	csd->func = tick_nohz_full_kick_func;
+	__smp_call_function_single(cpu, csd, 0);
+}
+
+/*
+ * The residual tick of a cpu running without the tick: go back to
+ * periodic ticks, irq_exit() stops the tick again if it still can.
+ */
+static inline void tick_nohz_full_residual(struct tick_sched *ts)
+{
+	if (ts->tick_stopped_full) {
+		ts->tick_stopped = 0;
+		ts->tick_stopped_full = 0;
+		ts->full_ticks++;
+	}
+}
+
+#else
+
+static inline void tick_nohz_full_residual(struct tick_sched *ts) { }
+
+#endif /* NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -527,13 +728,16 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
 	if (tick_do_timer_cpu == cpu)
 		tick_do_update_jiffies64(now);
 
+	tick_nohz_full_residual(ts);
+
 	/*
 	 * When we are idle and the tick is stopped, we have to touch
 	 * the watchdog as we might not schedule for a really long
@@ -682,8 +886,11 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
+
+	tick_nohz_full_residual(ts);
 #endif
 
 	/* Check, if the jiffies need an update */
@@ -54,38 +54,79 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH levels of LVL_SIZE buckets each.  Level 0
+ * has a granularity of one jiffy, and every further level is LVL_CLK_DIV
+ * times coarser than the one below it:
+ *
+ * HZ 1000, LVL_DEPTH 9
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms
+ *  3    192       512 ms             4032 ms -      32255 ms
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~12d)
+ *
+ * A timer is queued once, in the level whose range covers its timeout,
+ * and its expiry is rounded up to the granularity of that level.  Timers
+ * are never moved to a lower level as they get closer to expiry: a timer
+ * expires late by up to the level granularity, which is at most 1/8 of
+ * its timeout, instead.  That's what nearly all long timers (networking
+ * timeouts, watchdogs) want anyway: most of them are canceled or rearmed
+ * long before they expire, and the old cascading of all timers of an
+ * outer level into the inner ones produced long latency spikes in the
+ * timer softirq with many of them pending.
+ *
+ * Timeouts beyond the last level are capped to WHEEL_TIMEOUT_MAX.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/* The first jiffy (relative to base->clk) covered by level n */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#define LVL_BITS	(CONFIG_BASE_SMALL ? 4 : 6)
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
+/*
+ * Deferrable timers live in a base of their own, so that looking for the
+ * next timer event of an idle cpu never has to skip over them.
+ */
 struct tvec_base {
 	spinlock_t lock;
 	struct timer_list *running_timer;
-	unsigned long timer_jiffies;
-	unsigned long next_timer;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	unsigned long clk;		/* next jiffy to be processed */
+	unsigned long next_expiry;	/* no bucket is due before this */
+	int cpu;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
+static struct tvec_base boot_tvec_bases_def;
 static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
+static DEFINE_PER_CPU(struct tvec_base *, tvec_bases_def) =
+	&boot_tvec_bases_def;
 
 /*
  * Note that all tvec_bases are 2 byte aligned and lower bit of
@@ -118,6 +159,14 @@ timer_set_base(struct timer_list *timer, struct tvec_base *new_base)
 				      tbase_get_deferrable(timer->base));
 }
 
+static inline struct tvec_base *get_timer_base(struct timer_list *timer,
+					       int cpu)
+{
+	if (tbase_get_deferrable(timer->base))
+		return per_cpu(tvec_bases_def, cpu);
+	return per_cpu(tvec_bases, cpu);
+}
+
 static unsigned long round_jiffies_common(unsigned long j, int cpu,
 		bool force_up)
 {
@@ -327,46 +376,90 @@ static inline void set_running_timer(struct tvec_base *base,
 #endif
 }
 
-static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Helper function to calculate the array index for a given expiry time
+ * in level @lvl.  The expiry is rounded up to the level granularity, so
+ * the timer never fires early; @bucket_expiry gets the jiffy at which
+ * the bucket will be processed.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long) delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		/* Use the maximum timeout for anything beyond the wheel */
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		lvl = LVL_DEPTH - 1;
 	} else {
-		int i;
-		/* If the timeout is larger than 0xffffffff on 64-bit
-		 * architectures then we use the maximum timeout:
-		 */
-		if (idx > 0xffffffffUL) {
-			idx = 0xffffffffUL;
-			expires = idx + base->timer_jiffies;
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+			if (delta < LVL_START(lvl + 1))
+				break;
 		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
 	}
+	return calc_index(expires, lvl, bucket_expiry);
+}
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->clk, &bucket_expiry);
+
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+
+	if (time_before(bucket_expiry, base->next_expiry)) {
+		base->next_expiry = bucket_expiry;
+		/*
+		 * A full dynticks cpu may have stopped its tick until
+		 * the old first timer.
+		 */
+		if (!tbase_get_deferrable(timer->base))
+			tick_nohz_full_kick_cpu(base->cpu);
+	}
+}
+
+/*
+ * base->clk only advances when the timer softirq runs, which may not
+ * have happened for a while if this cpu was idle.  Bring it up to date
+ * before queueing, so that a new timer does not end up in a coarser
+ * level than its timeout asks for.  Nothing is due before next_expiry,
+ * so no bucket gets skipped.
+ */
+static inline void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long jnow = jiffies;
+
+	if (!time_after(jnow, base->clk))
+		return;
+
+	if (time_after(base->next_expiry, jnow))
+		base->clk = jnow;
+	else if (time_after(base->next_expiry, base->clk))
+		base->clk = base->next_expiry;
 }
 
 #ifdef CONFIG_TIMER_STATS
@@ -586,13 +679,21 @@ void init_timer_deferrable_key(struct timer_list *timer,
 EXPORT_SYMBOL(init_timer_deferrable_key);
 
 static inline void detach_timer(struct timer_list *timer,
-				int clear_pending)
+				struct tvec_base *base, int clear_pending)
 {
 	struct list_head *entry = &timer->entry;
+	struct list_head *prev = entry->prev;
 
 	debug_deactivate(timer);
 
-	__list_del(entry->prev, entry->next);
+	__list_del(prev, entry->next);
+	/*
+	 * If this was the last timer of a wheel bucket, prev is the
+	 * bucket's (now empty) list head.
+	 */
+	if (prev == prev->next && prev >= base->vectors &&
+	    prev < base->vectors + WHEEL_SIZE)
+		__clear_bit(prev - base->vectors, base->pending_map);
 	if (clear_pending)
 		entry->next = NULL;
 	entry->prev = LIST_POISON2;
@@ -644,10 +745,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	base = lock_timer_base(timer, &flags);
 
 	if (timer_pending(timer)) {
-		detach_timer(timer, 0);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
+		detach_timer(timer, base, 0);
 		ret = 1;
 	} else {
 		if (pending_only)
@@ -656,8 +754,6 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	debug_activate(timer, expires);
 
-	new_base = __get_cpu_var(tvec_bases);
-
 	cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
@@ -668,7 +764,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 			cpu = preferred_cpu;
 	}
 #endif
-	new_base = per_cpu(tvec_bases, cpu);
+	new_base = get_timer_base(timer, cpu);
 
 	if (base != new_base) {
 		/*
@@ -688,10 +784,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 		}
 	}
 
+	forward_timer_base(base);
 	timer->expires = expires;
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 
 out_unlock:
@@ -802,7 +896,7 @@ EXPORT_SYMBOL(add_timer);
  */
 void add_timer_on(struct timer_list *timer, int cpu)
 {
-	struct tvec_base *base = per_cpu(tvec_bases, cpu);
+	struct tvec_base *base = get_timer_base(timer, cpu);
 	unsigned long flags;
 
 	timer_stats_timer_set_start_info(timer);
@@ -810,9 +904,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
-	if (time_before(timer->expires, base->next_timer) &&
-	    !tbase_get_deferrable(timer->base))
-		base->next_timer = timer->expires;
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 	/*
 	 * Check whether the other CPU is idle and needs to be
@@ -848,10 +940,7 @@ int del_timer(struct timer_list *timer)
 	if (timer_pending(timer)) {
 		base = lock_timer_base(timer, &flags);
 		if (timer_pending(timer)) {
-			detach_timer(timer, 1);
-			if (timer->expires == base->next_timer &&
-			    !tbase_get_deferrable(timer->base))
-				base->next_timer = base->timer_jiffies;
+			detach_timer(timer, base, 1);
 			ret = 1;
 		}
 		spin_unlock_irqrestore(&base->lock, flags);
@@ -884,10 +973,7 @@ int try_to_del_timer_sync(struct timer_list *timer)
 
 	ret = 0;
 	if (timer_pending(timer)) {
-		detach_timer(timer, 1);
-		if (timer->expires == base->next_timer &&
-		    !tbase_get_deferrable(timer->base))
-			base->next_timer = base->timer_jiffies;
+		detach_timer(timer, base, 1);
 		ret = 1;
 	}
 out:
@@ -935,191 +1021,183 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
 {
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
+	struct timer_list *timer;
 
-	list_replace_init(tv->vec + index, &tv_list);
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
 
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		internal_add_timer(base, timer);
+		timer = list_first_entry(head, struct timer_list,entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		set_running_timer(base, timer);
+		detach_timer(timer, base, 1);
+
+		spin_unlock_irq(&base->lock);
+		{
+			int preempt_count = preempt_count();
+
+#ifdef CONFIG_LOCKDEP
+			/*
+			 * It is permissible to free the timer from
+			 * inside the function that is called from
+			 * it, this we need to take into account for
+			 * lockdep too. To avoid bogus "held lock
+			 * freed" warnings as well as problems when
+			 * looking into timer->lockdep_map, make a
+			 * copy and use that here.
+			 */
+			/*struct lockdep_map lockdep_map =
+				timer->lockdep_map;*/
+#endif
+			/*
+			 * Couple the lock chain with the lock chain at
+			 * del_timer_sync() by acquiring the lock_map
+			 * around the fn() call here and in
+			 * del_timer_sync().
+			 */
+			lock_map_acquire(&lockdep_map);
+
+			trace_timer_expire_entry(timer);
+			fn(data);
+			trace_timer_expire_exit(timer);
+
+			lock_map_release(&lockdep_map);
+
+			if (preempt_count != preempt_count()) {
+				printk(KERN_ERR "huh, entered %p "
+				       "with preempt_count %08x, exited"
+				       " with %08x?\n",
+				       fn, preempt_count,
+				       preempt_count());
+				BUG();
+			}
+		}
+		spin_lock_irq(&base->lock);
 	}
+}
+
+/*
+ * Move the buckets which are due at base->clk to @heads: the level 0
+ * bucket, and the bucket of each further level whose granularity
+ * base->clk is a multiple of.  Returns the number of buckets collected.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->clk;
+	unsigned int idx;
+	int i, levels = 0;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
 
-	return index;
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Find the next pending bucket of a level, searching from @clk (the
+ * index of the next bucket due in that level) and wrapping around.
+ * Returns the distance in buckets, or -1 if the level is empty.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	pos = find_next_bit(base->pending_map, end, start);
+	if (pos < end)
+		return pos - start;
+
+	pos = find_next_bit(base->pending_map, start, offset);
+	return pos < start ? pos + LVL_SIZE - start : -1;
+}
+
+/*
+ * Search the first expiring bucket of the wheel.  Cheap enough to be
+ * done from scratch: one bitmap search per level.  Needs base->lock.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base)
+{
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
+
+	next = base->clk + NEXT_TIMER_MAX_DELTA;
+	clk = base->clk;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long) pos;
+
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * Clock for the next level.  If the lower bits of the
+		 * current level clock are not zero, the next bucket due in
+		 * the next level is one further, as the current one has
+		 * been processed already.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
+	}
+	return next;
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function executes all expired timer buckets.  Stretches of
+ * jiffies without anything due (base->next_expiry) are skipped, instead
+ * of walking the wheel one jiffy at a time.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH];
+	int levels;
 
 	spin_lock_irq(&base->lock);
-	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			set_running_timer(base, timer);
-			detach_timer(timer, 1);
-
-			spin_unlock_irq(&base->lock);
-			{
-				int preempt_count = preempt_count();
-
-#ifdef CONFIG_LOCKDEP
-				/*
-				 * It is permissible to free the timer from
-				 * inside the function that is called from
-				 * it, this we need to take into account for
-				 * lockdep too. To avoid bogus "held lock
-				 * freed" warnings as well as problems when
-				 * looking into timer->lockdep_map, make a
-				 * copy and use that here.
-				 */
-				/*struct lockdep_map lockdep_map =
-					timer->lockdep_map;*/
-#endif
-				/*
-				 * Couple the lock chain with the lock chain at
-				 * del_timer_sync() by acquiring the lock_map
-				 * around the fn() call here and in
-				 * del_timer_sync().
-				 */
-				lock_map_acquire(&lockdep_map);
-
-				trace_timer_expire_entry(timer);
-				fn(data);
-				trace_timer_expire_exit(timer);
-
-				lock_map_release(&lockdep_map);
-
-				if (preempt_count != preempt_count()) {
-					printk(KERN_ERR "huh, entered %p "
-					       "with preempt_count %08x, exited"
-					       " with %08x?\n",
-					       fn, preempt_count,
-					       preempt_count());
-					BUG();
-				}
+	while (time_after_eq(jiffies, base->clk)) {
+		if (time_after(base->next_expiry, base->clk)) {
+			if (time_after(base->next_expiry, jiffies)) {
+				base->clk = jiffies + 1;
+				break;
 			}
-			spin_lock_irq(&base->lock);
+			base->clk = base->next_expiry;
 		}
+
+		levels = collect_expired_timers(base, heads);
+		base->clk++;
+
+		while (levels--)
+			expire_timers(base, heads + levels);
+
+		base->next_expiry = __next_timer_interrupt(base);
 	}
 	set_running_timer(base, NULL);
 	spin_unlock_irq(&base->lock);
 }
 
 #ifdef CONFIG_NO_HZ
-/*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
- */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
-}
-
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1174,9 +1252,8 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 	unsigned long expires;
 
 	spin_lock(&base->lock);
-	if (time_before_eq(base->next_timer, base->timer_jiffies))
-		base->next_timer = __next_timer_interrupt(base);
-	expires = base->next_timer;
+	expires = __next_timer_interrupt(base);
+	base->next_expiry = expires;
 	spin_unlock(&base->lock);
 
 	if (time_before_eq(expires, now))
@@ -1210,13 +1287,17 @@ void update_process_times(int user_tick)
 static void run_timer_softirq(struct softirq_action *h)
 {
 	struct tvec_base *base = __get_cpu_var(tvec_bases);
+	struct tvec_base *base_def = __get_cpu_var(tvec_bases_def);
 
 	perf_event_do_pending();
 
 	hrtimer_run_pending();
 
-	if (time_after_eq(jiffies, base->timer_jiffies))
+	/* Unlocked peeks: a stale value just means an extra lock round */
+	if (time_after_eq(jiffies, base->next_expiry))
 		__run_timers(base);
+	if (time_after_eq(jiffies, base_def->next_expiry))
+		__run_timers(base_def);
 }
 
 /*
@@ -1511,10 +1592,42 @@ SYSCALL_DEFINE1(sysinfo, struct sysinfo __user *, info)
 	return 0;
 }
 
-static int __cpuinit init_timers_cpu(int cpu)
+static struct tvec_base * __cpuinit alloc_timer_base(int cpu)
 {
-	int j;
 	struct tvec_base *base;
+
+	base = kmalloc_node(sizeof(*base), GFP_KERNEL | __GFP_ZERO,
+			    cpu_to_node(cpu));
+	if (!base)
+		return NULL;
+
+	/* Make sure that tvec_base is 2 byte aligned */
+	if (tbase_get_deferrable(base)) {
+		WARN_ON(1);
+		kfree(base);
+		return NULL;
+	}
+	return base;
+}
+
+static void __cpuinit init_timer_base(struct tvec_base *base, int cpu)
+{
+	int j;
+
+	spin_lock_init(&base->lock);
+
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
+
+	base->clk = jiffies;
+	base->next_expiry = base->clk + NEXT_TIMER_MAX_DELTA;
+	base->cpu = cpu;
+}
+
+static int __cpuinit init_timers_cpu(int cpu)
+{
+	struct tvec_base *base, *base_def;
 	static char __cpuinitdata tvec_base_done[NR_CPUS];
 
 	if (!tvec_base_done[cpu]) {
@@ -1524,19 +1637,15 @@ static int __cpuinit init_timers_cpu(int cpu)
 			/*
 			 * The APs use this path later in boot
 			 */
-			base = kmalloc_node(sizeof(*base),
-						GFP_KERNEL | __GFP_ZERO,
-						cpu_to_node(cpu));
-			if (!base)
-				return -ENOMEM;
-
-			/* Make sure that tvec_base is 2 byte aligned */
-			if (tbase_get_deferrable(base)) {
-				WARN_ON(1);
+			base = alloc_timer_base(cpu);
+			base_def = alloc_timer_base(cpu);
+			if (!base || !base_def) {
 				kfree(base);
+				kfree(base_def);
 				return -ENOMEM;
 			}
 			per_cpu(tvec_bases, cpu) = base;
+			per_cpu(tvec_bases_def, cpu) = base_def;
 		} else {
 			/*
 			 * This is for the boot CPU - we use compile-time
@@ -1546,53 +1655,39 @@ static int __cpuinit init_timers_cpu(int cpu)
 			 */
 			boot_done = 1;
 			base = &boot_tvec_bases;
+			base_def = &boot_tvec_bases_def;
 		}
 		tvec_base_done[cpu] = 1;
 	} else {
 		base = per_cpu(tvec_bases, cpu);
+		base_def = per_cpu(tvec_bases_def, cpu);
 	}
 
-	spin_lock_init(&base->lock);
-
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
-
-	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
+	init_timer_base(base, cpu);
+	init_timer_base(base_def, cpu);
 	return 0;
 }
 
 #ifdef CONFIG_HOTPLUG_CPU
-static void migrate_timer_list(struct tvec_base *new_base, struct list_head *head)
+static void migrate_timer_list(struct tvec_base *new_base,
+			       struct tvec_base *old_base,
+			       struct list_head *head)
 {
 	struct timer_list *timer;
 
 	while (!list_empty(head)) {
 		timer = list_first_entry(head, struct timer_list, entry);
-		detach_timer(timer, 0);
+		detach_timer(timer, old_base, 0);
 		timer_set_base(timer, new_base);
-		if (time_before(timer->expires, new_base->next_timer) &&
-		    !tbase_get_deferrable(timer->base))
-			new_base->next_timer = timer->expires;
 		internal_add_timer(new_base, timer);
 	}
 }
 
-static void __cpuinit migrate_timers(int cpu)
+static void __cpuinit migrate_timer_base(struct tvec_base *new_base,
+					 struct tvec_base *old_base)
 {
-	struct tvec_base *old_base;
-	struct tvec_base *new_base;
 	int i;
 
-	BUG_ON(cpu_online(cpu));
-	old_base = per_cpu(tvec_bases, cpu);
-	new_base = get_cpu_var(tvec_bases);
 	/*
 	 * The caller is globally serialized and nobody else
 	 * takes two locks at once, deadlock is not possible.
@@ -1602,18 +1697,25 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	forward_timer_base(new_base);
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base, old_base->vectors + i);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
-	put_cpu_var(tvec_bases);
+}
+
+static void __cpuinit migrate_timers(int cpu)
+{
+	int this_cpu;
+
+	BUG_ON(cpu_online(cpu));
+	this_cpu = get_cpu();
+	migrate_timer_base(per_cpu(tvec_bases, this_cpu),
+			   per_cpu(tvec_bases, cpu));
+	migrate_timer_base(per_cpu(tvec_bases_def, this_cpu),
+			   per_cpu(tvec_bases_def, cpu));
+	put_cpu();
 }
 #endif /* CONFIG_HOTPLUG_CPU */
 
@@ -0,0 +1,228 @@
+/*
+ * kernel/timerbench.c
+ *
+ * Timer wheel benchmark.
+ *
+ * Arms, rearms and cancels a large number of timers with timeouts spread
+ * like those of networking retransmit/keepalive timers, and reports the
+ * cost per operation.  While those timers are pending, a second set of
+ * short timers is left to expire, and how late they fire (in jiffies,
+ * and relative to their timeout) is reported as a histogram.
+ *
+ * Everything runs from module init, results go to the kernel log:
+ *
+ *   modprobe timerbench nr_timers=1000000 nr_expire=100000
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
+#include <asm/atomic.h>
+#include <asm/div64.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Timer wheel benchmark");
+
+static unsigned long nr_timers = 1000000;
+module_param(nr_timers, ulong, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of timers to arm and cancel");
+
+static unsigned long max_timeout = 600 * HZ;
+module_param(max_timeout, ulong, 0444);
+MODULE_PARM_DESC(max_timeout, "Largest timeout of the armed timers (jiffies)");
+
+static unsigned long nr_expire = 100000;
+module_param(nr_expire, ulong, 0444);
+MODULE_PARM_DESC(nr_expire, "Number of timers to let expire");
+
+static unsigned long expire_range = HZ;
+module_param(expire_range, ulong, 0444);
+MODULE_PARM_DESC(expire_range, "Largest timeout of the expiring timers (jiffies)");
+
+#define BENCH_BATCH	1024
+#define LATE_SLOTS	12	/* 0, 1, 2-3, ... 1024+ jiffies */
+
+struct bench_timer {
+	struct timer_list timer;
+	unsigned long timeout;
+};
+
+static atomic_t nr_pending;
+static DECLARE_COMPLETION(expire_done);
+static atomic_t late_hist[LATE_SLOTS];
+static unsigned long max_late;
+static unsigned long max_late_permille;
+static DEFINE_SPINLOCK(max_lock);
+
+static unsigned long random_timeout(unsigned long range)
+{
+	/* Mostly short timeouts, with a long tail */
+	switch (random32() & 3) {
+	case 0:
+		range = min(range, 16UL);
+		break;
+	case 1:
+		range = min(range, (unsigned long)HZ);
+		break;
+	}
+	return 1 + random32() % range;
+}
+
+static void bench_noop(unsigned long data)
+{
+}
+
+static void bench_expire(unsigned long data)
+{
+	struct bench_timer *bt = (struct bench_timer *)data;
+	unsigned long late = jiffies - bt->timer.expires;
+	unsigned long permille = late * 1000 / bt->timeout;
+	int slot = late ? min_t(int, fls_long(late), LATE_SLOTS - 1) : 0;
+
+	atomic_inc(&late_hist[slot]);
+
+	spin_lock(&max_lock);
+	if (late > max_late)
+		max_late = late;
+	if (permille > max_late_permille)
+		max_late_permille = permille;
+	spin_unlock(&max_lock);
+
+	if (atomic_dec_and_test(&nr_pending))
+		complete(&expire_done);
+}
+
+/*
+ * Apply @op to all timers in batches, and return the average time per
+ * timer in ns.  Only the batches themselves are timed, not the
+ * cond_resched() between them.
+ */
+static u64 bench_timers(struct bench_timer *timers, unsigned long nr,
+			void (*op)(struct bench_timer *bt))
+{
+	unsigned long i, j;
+	u64 total = 0;
+
+	for (i = 0; i < nr; i += BENCH_BATCH) {
+		ktime_t start = ktime_get();
+
+		for (j = i; j < min(i + BENCH_BATCH, nr); j++)
+			op(&timers[j]);
+		total += ktime_to_ns(ktime_sub(ktime_get(), start));
+		cond_resched();
+	}
+	do_div(total, nr);
+	return total;
+}
+
+static void op_arm(struct bench_timer *bt)
+{
+	bt->timeout = random_timeout(max_timeout);
+	mod_timer(&bt->timer, jiffies + bt->timeout);
+}
+
+static void op_cancel(struct bench_timer *bt)
+{
+	del_timer(&bt->timer);
+}
+
+static void op_sync(struct bench_timer *bt)
+{
+	del_timer_sync(&bt->timer);
+}
+
+static void op_arm_expire(struct bench_timer *bt)
+{
+	bt->timeout = random_timeout(expire_range);
+	mod_timer(&bt->timer, jiffies + bt->timeout);
+}
+
+static int bench_expiry(void)
+{
+	struct bench_timer *timers;
+	unsigned long i;
+	long left;
+	u64 arm;
+
+	timers = vmalloc(nr_expire * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_expire; i++)
+		setup_timer(&timers[i].timer, bench_expire,
+			    (unsigned long)&timers[i]);
+
+	atomic_set(&nr_pending, nr_expire);
+	arm = bench_timers(timers, nr_expire, op_arm_expire);
+
+	left = wait_for_completion_timeout(&expire_done,
+					   expire_range + 60 * HZ);
+	if (!left) {
+		printk(KERN_ERR "timerbench: %d timers did not expire\n",
+		       atomic_read(&nr_pending));
+	}
+	bench_timers(timers, nr_expire, op_sync);
+
+	printk(KERN_INFO "timerbench: %lu expiring timers: arm %llu ns, "
+	       "max late %lu jiffies (%lu permille of timeout)\n",
+	       nr_expire, (unsigned long long)arm, max_late, max_late_permille);
+	for (i = 0; i < LATE_SLOTS; i++) {
+		if (!atomic_read(&late_hist[i]))
+			continue;
+		printk(KERN_INFO "timerbench:   late %5lu%s jiffies: %d\n",
+		       i ? 1UL << (i - 1) : 0, i == LATE_SLOTS - 1 ? "+" : "",
+		       atomic_read(&late_hist[i]));
+	}
+
+	vfree(timers);
+	return 0;
+}
+
+static int __init timerbench_init(void)
+{
+	struct bench_timer *timers;
+	u64 arm, rearm, cancel;
+	unsigned long i;
+	int ret;
+
+	if (!nr_timers || !max_timeout || !nr_expire || !expire_range)
+		return -EINVAL;
+
+	timers = vmalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_timers; i++)
+		setup_timer(&timers[i].timer, bench_noop, 0);
+
+	arm = bench_timers(timers, nr_timers, op_arm);
+	rearm = bench_timers(timers, nr_timers, op_arm);
+
+	/* Let the short timers expire with all of the above pending */
+	ret = bench_expiry();
+
+	cancel = bench_timers(timers, nr_timers, op_cancel);
+	bench_timers(timers, nr_timers, op_sync);
+
+	printk(KERN_INFO "timerbench: %lu timers (max timeout %lu jiffies): "
+	       "arm %llu ns, rearm %llu ns, cancel %llu ns\n",
+	       nr_timers, max_timeout, (unsigned long long)arm,
+	       (unsigned long long)rearm, (unsigned long long)cancel);
+
+	vfree(timers);
+	return ret;
+}
+
+static void __exit timerbench_exit(void)
+{
+}
+
+module_init(timerbench_init);
+module_exit(timerbench_exit);
@@ -33,23 +33,131 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
 
+#include "workqueue_sched.h"
+
+/*
+ * Worker pools.
+ *
+ * The work items of workqueues created with create_workqueue() are not
+ * executed by threads of their own.  Every cpu has a pool of workers
+ * that serves all of them, and that pool is concurrency managed: the
+ * scheduler tells it when one of its workers goes to sleep and when it
+ * wakes up again (see wq_worker_sleeping() and wq_worker_waking_up()),
+ * and an idle worker is only woken up to process pending work when no
+ * other worker of the pool is runnable.  A work item that blocks thus
+ * doesn't stall the work queued behind it, while normally no more than
+ * one worker per cpu is running.  So that a worker is at hand when that
+ * happens, a worker about to start processing work first creates a new
+ * one if the pool has no idle workers left.  Idle workers beyond
+ * MAX_IDLE_WORKERS are destroyed again after IDLE_WORKER_TIMEOUT.
+ *
+ * A cwq still runs at most max_active of its work items at a time, in
+ * queueing order.  That is one for create_workqueue() users, so their
+ * works stay serialized per cpu, while keventd runs up to WQ_DFL_ACTIVE
+ * of them concurrently.
+ *
+ * Single threaded, freezeable and realtime workqueues keep a private
+ * pool with one dedicated worker for each of their cwqs.
+ *
+ * Creating a worker may need memory, and so may wait on works that
+ * reclaim depends on, such as those of kblockd.  Every workqueue served
+ * by the pools therefore has a rescuer thread of its own.  When a pool
+ * has works pending but neither a runnable nor an idle worker for
+ * MAYDAY_INITIAL_TIMEOUT, it calls the rescuers of the workqueues with
+ * pending works (see pool_mayday_timeout()), and each rescuer runs the
+ * works of its cwq on the pool's cpu.
+ *
+ * pool->lock protects the pool and all the cwqs it serves.
+ */
+enum {
+	/* pool flags */
+	POOL_PRIVATE		= 1 << 0,	/* serves a single cwq */
+	POOL_FREEZEABLE		= 1 << 1,	/* workers freeze on suspend */
+	POOL_DISASSOCIATED	= 1 << 2,	/* cpu is going down or gone */
+	POOL_MANAGING		= 1 << 3,	/* a worker creates another */
+
+	/* worker flags */
+	WORKER_IDLE		= 1 << 0,	/* on the idle list */
+	WORKER_PREP		= 1 << 1,	/* not processing works */
+	WORKER_UNMANAGED	= 1 << 2,	/* not concurrency managed */
+	WORKER_DIE		= 1 << 3,	/* exit instead of idling */
+	WORKER_RESCUER		= 1 << 4,	/* rescuer of a workqueue */
+
+	WORKER_NOT_RUNNING	= WORKER_IDLE | WORKER_PREP | WORKER_UNMANAGED |
+				  WORKER_RESCUER,
+
+	MAX_IDLE_WORKERS	= 2,		/* kept without a timeout */
+	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* destroy idle workers after */
+
+	MAYDAY_INITIAL_TIMEOUT	= HZ / 100 >= 2 ? HZ / 100 : 2,
+						/* call the rescuers after */
+	MAYDAY_INTERVAL		= HZ / 10,	/* and again after */
+
+	WQ_DFL_ACTIVE		= 256,		/* max_active of keventd */
+};
+
+struct worker_pool {
+	spinlock_t		lock;
+	struct list_head	worklist;	/* cwqs with works to start */
+	struct list_head	idle_list;	/* idle workers, LIFO */
+	struct list_head	busy_list;	/* workers running a work */
+	struct list_head	workers;	/* all started workers */
+	unsigned int		flags;
+	int			cpu;		/* -1 if not bound */
+	int			nr_workers;
+	int			nr_idle;
+	atomic_t		nr_running;	/* managed, runnable workers */
+	int			next_id;
+	struct worker		*first_worker;	/* created on CPU_UP_PREPARE */
+	struct workqueue_struct	*wq;		/* owner of a private pool */
+	struct timer_list	idle_timer;
+	struct timer_list	mayday_timer;	/* no worker left to run works */
+	wait_queue_head_t	exit_wait;	/* workers exiting */
+
+	/* statistics, see /sys/kernel/debug/workqueue/pools */
+	int			max_workers;
+	unsigned long		workers_created;
+	unsigned long		workers_destroyed;
+	unsigned long		wakeups;	/* for blocked workers */
+	unsigned long		maydays;	/* rescuers called */
+	unsigned long		works_executed;
+} ____cacheline_aligned_in_smp;
+
+struct worker {
+	struct list_head	entry;		/* idle_list or busy_list */
+	struct list_head	node;		/* pool->workers */
+	struct work_struct	*current_work;
+	struct cpu_workqueue_struct *current_cwq;
+	unsigned long		current_seq;
+	struct task_struct	*task;
+	struct worker_pool	*pool;		/* or the one being rescued */
+	unsigned long		last_active;	/* when it became idle */
+	unsigned int		flags;
+	struct workqueue_struct	*rescue_wq;	/* for a rescuer */
+};
+
 /*
  * The per-CPU workqueue (if single thread, we always use the first
  * possible cpu).
  */
 struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+	struct worker_pool *pool;
 
 	struct list_head worklist;
-	wait_queue_head_t more_work;
-	struct work_struct *current_work;
+	struct list_head pool_entry;	/* on pool->worklist */
+	wait_queue_head_t done_wait;	/* works completing */
+	unsigned long seq;		/* works started so far */
+	int nr_active;			/* works running */
+	int max_active;
+	int mayday;			/* the rescuer is wanted */
 
 	struct workqueue_struct *wq;
-	struct task_struct *thread;
 } ____cacheline_aligned;
 
 /*
@@ -58,6 +166,8 @@ struct cpu_workqueue_struct {
  */
 struct workqueue_struct {
 	struct cpu_workqueue_struct *cpu_wq;
+	struct worker_pool *pools;	/* private pools, if any */
+	struct worker *rescuer;		/* if served by the shared pools */
 	struct list_head list;
 	const char *name;
 	int singlethread;
@@ -68,6 +178,8 @@ struct workqueue_struct {
 #endif
 };
 
+static DEFINE_PER_CPU(struct worker_pool, worker_pools);
+
 /* Serializes the accesses to the list of workqueues. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
@@ -89,6 +201,12 @@ static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 	return wq->singlethread;
 }
 
+/* Is @wq served by the per-cpu worker pools? */
+static inline int is_wq_shared(struct workqueue_struct *wq)
+{
+	return !wq->singlethread && !wq->freezeable && !wq->rt;
+}
+
 static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
 {
 	return is_wq_single_threaded(wq)
@@ -125,10 +243,404 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+/* Workers of private or disassociated pools are not managed. */
+static inline int pool_unmanaged(struct worker_pool *pool)
+{
+	return pool->flags & (POOL_PRIVATE | POOL_DISASSOCIATED);
+}
+
+/* Does @pool need a worker to be woken up for its pending works? */
+static inline int need_more_worker(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		(pool_unmanaged(pool) || !atomic_read(&pool->nr_running));
+}
+
+/* Should a running worker go on with the next work? */
+static inline int keep_working(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) &&
+		(pool_unmanaged(pool) || atomic_read(&pool->nr_running) <= 1);
+}
+
+/* Is there an idle worker to take over if the current one blocks? */
+static inline int may_start_working(struct worker_pool *pool)
+{
+	return pool->nr_idle || (pool->flags & POOL_PRIVATE);
+}
+
+/* A worker left over from before its cpu went down and came back. */
+static inline int worker_is_rogue(struct worker *worker)
+{
+	return (worker->flags & WORKER_UNMANAGED) &&
+		!pool_unmanaged(worker->pool);
+}
+
+static struct worker *first_idle_worker(struct worker_pool *pool)
+{
+	if (unlikely(list_empty(&pool->idle_list)))
+		return NULL;
+
+	return list_first_entry(&pool->idle_list, struct worker, entry);
+}
+
+/*
+ * Call the rescuers unless a worker turns up in time.  Called with
+ * pool->lock held.
+ */
+static void pool_arm_mayday(struct worker_pool *pool)
+{
+	if (!(pool->flags & POOL_PRIVATE) && !timer_pending(&pool->mayday_timer))
+		mod_timer(&pool->mayday_timer,
+			  jiffies + MAYDAY_INITIAL_TIMEOUT);
+}
+
+static void wake_up_worker(struct worker_pool *pool)
+{
+	struct worker *worker = first_idle_worker(pool);
+
+	if (likely(worker))
+		wake_up_process(worker->task);
+	else
+		pool_arm_mayday(pool);
+}
+
+static struct worker *current_wq_worker(void)
+{
+	if (current->flags & PF_WQ_WORKER)
+		return kthread_data(current);
+	return NULL;
+}
+
+/**
+ * wq_worker_waking_up - a worker is waking up
+ * @task: task waking up
+ * @cpu: CPU @task is waking up to
+ *
+ * This function is called during try_to_wake_up() when a worker is
+ * being awoken.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ */
+void wq_worker_waking_up(struct task_struct *task, unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task);
+
+	if (!(worker->flags & WORKER_NOT_RUNNING))
+		atomic_inc(&worker->pool->nr_running);
+}
+
+/**
+ * wq_worker_sleeping - a worker is going to sleep
+ * @task: task going to sleep
+ * @cpu: CPU in question, must be the current CPU number
+ *
+ * This function is called during schedule() when a busy worker is
+ * going to sleep.  Worker on the same cpu can be woken up by
+ * returning pointer to its task.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * RETURNS:
+ * Worker task on @cpu to wake up, %NULL if none.
+ */
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task), *to_wakeup = NULL;
+	struct worker_pool *pool = worker->pool;
+
+	if (worker->flags & WORKER_NOT_RUNNING)
+		return NULL;
+
+	/* this can only happen on the local cpu */
+	BUG_ON(cpu != raw_smp_processor_id());
+
+	/*
+	 * The counterpart of the following dec_and_test, implied mb,
+	 * worklist not empty test sequence is in insert_work().
+	 *
+	 * The worker is managed, so it is bound to and running on this
+	 * cpu with rq lock held and irqs disabled.  The idle list is
+	 * only changed under pool->lock, with irqs disabled, by code
+	 * running on this cpu too, so it is safe to look at it here.
+	 */
+	if (atomic_dec_and_test(&pool->nr_running) &&
+	    !list_empty(&pool->worklist)) {
+		to_wakeup = first_idle_worker(pool);
+		if (to_wakeup)
+			pool->wakeups++;
+	}
+	return to_wakeup ? to_wakeup->task : NULL;
+}
+
+/*
+ * Worker flags are only changed under pool->lock, by the worker itself
+ * or, to stop managing them, by the cpu hotplug callbacks.
+ */
+static inline void worker_set_flags(struct worker *worker, unsigned int flags)
+{
+	if ((flags & WORKER_NOT_RUNNING) &&
+	    !(worker->flags & WORKER_NOT_RUNNING))
+		atomic_dec(&worker->pool->nr_running);
+	worker->flags |= flags;
+}
+
+static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
+{
+	unsigned int oflags = worker->flags;
+
+	worker->flags &= ~flags;
+	if ((oflags & WORKER_NOT_RUNNING) &&
+	    !(worker->flags & WORKER_NOT_RUNNING))
+		atomic_inc(&worker->pool->nr_running);
+}
+
+static void worker_enter_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	worker_set_flags(worker, WORKER_IDLE);
+	pool->nr_idle++;
+	worker->last_active = jiffies;
+	list_add(&worker->entry, &pool->idle_list);
+
+	if (pool->nr_idle > MAX_IDLE_WORKERS && !(pool->flags & POOL_PRIVATE) &&
+	    !timer_pending(&pool->idle_timer))
+		mod_timer_pinned(&pool->idle_timer,
+				 jiffies + IDLE_WORKER_TIMEOUT);
+}
+
+static void worker_leave_idle(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	worker_clr_flags(worker, WORKER_IDLE);
+	pool->nr_idle--;
+	list_del_init(&worker->entry);
+}
+
+/*
+ * Tell @worker to exit.  An idle worker is woken up to do so, a busy
+ * one exits once it runs out of work.  Called with pool->lock held.
+ */
+static void retire_worker(struct worker *worker)
+{
+	worker->flags |= WORKER_DIE;
+	if (worker->flags & WORKER_IDLE) {
+		worker->pool->nr_idle--;
+		list_del_init(&worker->entry);
+		wake_up_process(worker->task);
+	}
+}
+
+static void retire_idle_workers(struct worker_pool *pool)
+{
+	struct worker *worker, *tmp;
+
+	list_for_each_entry_safe(worker, tmp, &pool->idle_list, entry)
+		retire_worker(worker);
+}
+
+static void idle_worker_timeout(unsigned long __pool)
+{
+	struct worker_pool *pool = (void *)__pool;
+
+	spin_lock_irq(&pool->lock);
+	while (pool->nr_idle > MAX_IDLE_WORKERS) {
+		struct worker *worker;
+		unsigned long expires;
+
+		/* the idle list is LIFO, its last worker idled longest */
+		worker = list_entry(pool->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+		if (time_before(jiffies, expires)) {
+			mod_timer_pinned(&pool->idle_timer, expires);
+			break;
+		}
+		retire_worker(worker);
+	}
+	spin_unlock_irq(&pool->lock);
+}
+
+static void send_mayday(struct cpu_workqueue_struct *cwq)
+{
+	struct worker *rescuer = cwq->wq->rescuer;
+
+	if (!rescuer || cwq->mayday)
+		return;
+	cwq->mayday = 1;
+	cwq->pool->maydays++;
+	wake_up_process(rescuer->task);
+}
+
+/*
+ * The pool had works pending and no idle worker for a while: as long
+ * as no worker is runnable either, the workers are all blocked or stuck
+ * creating a new one, possibly on the very works which are pending.
+ * Hand those over to the rescuers of their workqueues.
+ */
+static void pool_mayday_timeout(unsigned long __pool)
+{
+	struct worker_pool *pool = (void *)__pool;
+	struct cpu_workqueue_struct *cwq;
+
+	spin_lock_irq(&pool->lock);
+	if (!pool->nr_idle && !list_empty(&pool->worklist)) {
+		if (need_more_worker(pool))
+			list_for_each_entry(cwq, &pool->worklist, pool_entry)
+				send_mayday(cwq);
+		mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INTERVAL);
+	}
+	spin_unlock_irq(&pool->lock);
+}
+
+static int worker_thread(void *__worker);
+
+static struct worker *create_worker(struct worker_pool *pool)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	struct workqueue_struct *wq = pool->wq;
+	struct worker *worker;
+	struct task_struct *p;
+	int id;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+	INIT_LIST_HEAD(&worker->entry);
+	INIT_LIST_HEAD(&worker->node);
+	worker->pool = pool;
+	worker->flags = WORKER_PREP;
+
+	spin_lock_irq(&pool->lock);
+	id = pool->next_id++;
+	spin_unlock_irq(&pool->lock);
+
+	if (!wq)
+		p = kthread_create(worker_thread, worker, "kworker/%d:%d",
+				   pool->cpu, id);
+	else if (is_wq_single_threaded(wq))
+		p = kthread_create(worker_thread, worker, "%s", wq->name);
+	else
+		p = kthread_create(worker_thread, worker, "%s/%d",
+				   wq->name, pool->cpu);
+	if (IS_ERR(p)) {
+		kfree(worker);
+		return NULL;
+	}
+	if (wq && wq->rt)
+		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+	p->flags |= PF_WQ_WORKER;
+	worker->task = p;
+
+	trace_workqueue_creation(p, pool->cpu);
+
+	return worker;
+}
+
+/*
+ * Add the freshly created @worker to its pool as an idle worker and let
+ * it run.  Called with pool->lock held.
+ */
+static void start_worker(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	if (pool_unmanaged(pool))
+		worker->flags |= WORKER_UNMANAGED;
+	list_add_tail(&worker->node, &pool->workers);
+	pool->nr_workers++;
+	pool->workers_created++;
+	if (pool->nr_workers > pool->max_workers)
+		pool->max_workers = pool->nr_workers;
+	worker_enter_idle(worker);
+	wake_up_process(worker->task);
+}
+
+/*
+ * Create an idle worker to take over if @worker blocks.  pool->lock is
+ * dropped and reacquired, the caller must recheck the pool.
+ */
+static void manage_workers(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct worker *new;
+	int bind;
+
+	if (pool->flags & POOL_MANAGING)
+		return;
+	pool->flags |= POOL_MANAGING;
+	bind = !(pool->flags & POOL_DISASSOCIATED);
+	spin_unlock_irq(&pool->lock);
+
+	new = create_worker(pool);
+	if (new && bind)
+		kthread_bind(new->task, pool->cpu);
+
+	spin_lock_irq(&pool->lock);
+	pool->flags &= ~POOL_MANAGING;
+	if (new)
+		start_worker(new);
+	else if (printk_ratelimit())
+		printk(KERN_WARNING "workqueue: failed to create a worker "
+		       "for cpu %d\n", pool->cpu);
+}
+
+/*
+ * Called by @worker itself, with pool->lock held, which is released.
+ */
+static void worker_exit(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+
+	list_del(&worker->node);
+	pool->nr_workers--;
+	pool->workers_destroyed++;
+	trace_workqueue_destruction(worker->task);
+	/* the scheduler hooks mustn't look at @worker any more */
+	current->flags &= ~PF_WQ_WORKER;
+	wake_up(&pool->exit_wait);
+	spin_unlock_irq(&pool->lock);
+
+	kfree(worker);
+}
+
+/*
+ * A cwq is on the worklist of its pool while it has works which may be
+ * started, that is while less than max_active of its works are running.
+ */
+static void cwq_update_runnable(struct cpu_workqueue_struct *cwq)
+{
+	int runnable = !list_empty(&cwq->worklist) &&
+		cwq->nr_active < cwq->max_active;
+
+	if (runnable && list_empty(&cwq->pool_entry))
+		list_add_tail(&cwq->pool_entry, &cwq->pool->worklist);
+	else if (!runnable && !list_empty(&cwq->pool_entry))
+		list_del_init(&cwq->pool_entry);
+}
+
+static struct worker *find_worker_executing_work(struct worker_pool *pool,
+						 struct cpu_workqueue_struct *cwq,
+						 struct work_struct *work)
+{
+	struct worker *worker;
+
+	list_for_each_entry(worker, &pool->busy_list, entry)
+		if (worker->current_work == work && worker->current_cwq == cwq)
+			return worker;
+	return NULL;
+}
+
 static void insert_work(struct cpu_workqueue_struct *cwq,
 			struct work_struct *work, struct list_head *head)
 {
-	trace_workqueue_insertion(cwq->thread, work);
+	struct worker_pool *pool = cwq->pool;
+
+	trace_workqueue_insertion(cwq->wq->name, pool->cpu, work);
 
 	set_wq_data(work, cwq);
 	/*
@@ -137,7 +649,18 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+	cwq_update_runnable(cwq);
+
+	/*
+	 * Ensure either wq_worker_sleeping() sees the above
+	 * list_add_tail() or we see zero nr_running to avoid
+	 * workers lying around lazily while there are works to be
+	 * processed.
+	 */
+	smp_mb();
+
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
@@ -145,9 +668,9 @@ static void __queue_work(struct cpu_workqueue_struct *cwq,
 {
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
+	spin_lock_irqsave(&cwq->pool->lock, flags);
 	insert_work(cwq, work, &cwq->worklist);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	spin_unlock_irqrestore(&cwq->pool->lock, flags);
 }
 
 /**
@@ -261,116 +784,296 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+struct wq_barrier {
+	struct work_struct	work;
+	struct completion	done;
+	struct work_struct	*target;	/* NULL: all earlier works */
+};
+
+static void wq_barrier_func(struct work_struct *work)
+{
+	struct wq_barrier *barr = container_of(work, struct wq_barrier, work);
+	complete(&barr->done);
+}
+
+static int cwq_busy_before(struct cpu_workqueue_struct *cwq, unsigned long seq)
+{
+	struct worker *worker;
+
+	list_for_each_entry(worker, &cwq->pool->busy_list, entry)
+		if (worker->current_cwq == cwq &&
+		    (long)(worker->current_seq - seq) < 0)
+			return 1;
+	return 0;
+}
+
+/*
+ * A barrier on a cwq which runs several works at a time may start
+ * before the works queued ahead of it are finished.  The barrier of
+ * flush_workqueue() waits for all the works started before it; the one
+ * of flush_work() or cancel_work_sync() only for its target, since the
+ * others may be the very work which is flushing.
+ */
+static void wait_for_barrier_works(struct worker *worker,
+				   struct wq_barrier *barr)
+{
+	struct cpu_workqueue_struct *cwq = worker->current_cwq;
+	struct worker_pool *pool = worker->pool;
+	DEFINE_WAIT(wait);
+	int busy;
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		prepare_to_wait(&cwq->done_wait, &wait, TASK_UNINTERRUPTIBLE);
+		if (barr->target)
+			busy = !!find_worker_executing_work(pool, cwq,
+							    barr->target);
+		else
+			busy = cwq_busy_before(cwq, worker->current_seq);
+		if (!busy)
+			break;
+		spin_unlock_irq(&pool->lock);
+		schedule();
+		spin_lock_irq(&pool->lock);
+	}
+	spin_unlock_irq(&pool->lock);
+	finish_wait(&cwq->done_wait, &wait);
+}
+
+/*
+ * Run the first work of @cwq.  Called with pool->lock held, which is
+ * dropped while the work runs.
+ */
+static void process_one_work(struct worker *worker,
+			     struct cpu_workqueue_struct *cwq)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
+	struct worker_pool *pool = worker->pool;
+	struct work_struct *work = list_first_entry(&cwq->worklist,
 						struct work_struct, entry);
-		work_func_t f = work->func;
+	work_func_t f = work->func;
 #ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
 #endif
-		trace_workqueue_execution(cwq->thread, work);
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
-
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
-
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+	/*
+	 * A work which was queued again while it runs must not run
+	 * concurrently with itself.  Leave the cwq alone until the
+	 * worker running it puts the cwq back on the pool.
+	 */
+	if (cwq->max_active > 1 &&
+	    find_worker_executing_work(pool, cwq, work)) {
+		list_del_init(&cwq->pool_entry);
+		return;
+	}
+
+	trace_workqueue_execution(worker->task, work);
+	list_del_init(&work->entry);
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	worker->current_seq = cwq->seq++;
+	list_add(&worker->entry, &pool->busy_list);
+	cwq->nr_active++;
+	/* requeue the cwq at the tail, so that workqueues take turns */
+	list_del_init(&cwq->pool_entry);
+	cwq_update_runnable(cwq);
+	spin_unlock_irq(&pool->lock);
+
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	if (unlikely(f == wq_barrier_func) && cwq->max_active > 1)
+		wait_for_barrier_works(worker,
+				container_of(work, struct wq_barrier, work));
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
 	}
-	spin_unlock_irq(&cwq->lock);
+
+	spin_lock_irq(&pool->lock);
+	list_del_init(&worker->entry);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	cwq->nr_active--;
+	pool->works_executed++;
+	cwq_update_runnable(cwq);
+	if (waitqueue_active(&cwq->done_wait))
+		wake_up(&cwq->done_wait);
 }
 
-static int worker_thread(void *__cwq)
+static int worker_thread(void *__worker)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DEFINE_WAIT(wait);
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
+	int tried;
 
-	if (cwq->wq->freezeable)
+	if (pool->flags & POOL_FREEZEABLE)
 		set_freezable();
+woke_up:
+	spin_lock_irq(&pool->lock);
+	if (unlikely(worker->flags & WORKER_DIE)) {
+		worker_exit(worker);
+		return 0;
+	}
+	worker_leave_idle(worker);
+	tried = 0;
+recheck:
+	if (!need_more_worker(pool))
+		goto sleep;
+
+	if (unlikely(!may_start_working(pool)) && !tried &&
+	    !worker_is_rogue(worker)) {
+		tried = 1;
+		pool_arm_mayday(pool);
+		manage_workers(worker);
+		goto recheck;
+	}
 
-	for (;;) {
-		prepare_to_wait(&cwq->more_work, &wait, TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !kthread_should_stop() &&
-		    list_empty(&cwq->worklist))
-			schedule();
-		finish_wait(&cwq->more_work, &wait);
+	worker_clr_flags(worker, WORKER_PREP);
+	do {
+		process_one_work(worker, list_first_entry(&pool->worklist,
+				struct cpu_workqueue_struct, pool_entry));
+	} while (keep_working(pool));
+	worker_set_flags(worker, WORKER_PREP);
+sleep:
+	if (unlikely((worker->flags & WORKER_DIE) || worker_is_rogue(worker))) {
+		worker_exit(worker);
+		return 0;
+	}
+	worker_enter_idle(worker);
+	__set_current_state(TASK_INTERRUPTIBLE);
+	spin_unlock_irq(&pool->lock);
+	if (!freezing(current))
+		schedule();
+	__set_current_state(TASK_RUNNING);
+	try_to_freeze();
+	goto woke_up;
+}
 
-		try_to_freeze();
+/*
+ * Run the works which were pending on @cwq when its rescuer was called,
+ * on behalf of its pool.
+ */
+static void rescue_cwq(struct worker *rescuer, struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+	struct list_head *pos;
+	int nr = 0;
+
+	/* fails if the cpu is gone, the works then run wherever we are */
+	set_cpus_allowed_ptr(current, cpumask_of(pool->cpu));
+
+	spin_lock_irq(&pool->lock);
+	cwq->mayday = 0;
+	rescuer->pool = pool;
+	list_for_each(pos, &cwq->worklist)
+		nr++;
+	while (nr-- && !list_empty(&cwq->pool_entry))
+		process_one_work(rescuer, cwq);
+	rescuer->pool = NULL;
+	/* leave the rest to the workers, if one is there by now */
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+	spin_unlock_irq(&pool->lock);
+}
 
+static int rescuer_thread(void *__rescuer)
+{
+	struct worker *rescuer = __rescuer;
+	struct workqueue_struct *wq = rescuer->rescue_wq;
+	int cpu;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
 		if (kthread_should_stop())
 			break;
 
-		run_workqueue(cwq);
+		for_each_possible_cpu(cpu) {
+			struct cpu_workqueue_struct *cwq;
+
+			cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+			if (!ACCESS_ONCE(cwq->mayday))
+				continue;
+			__set_current_state(TASK_RUNNING);
+			rescue_cwq(rescuer, cwq);
+		}
+		schedule();
 	}
+	__set_current_state(TASK_RUNNING);
 
 	return 0;
 }
 
-struct wq_barrier {
-	struct work_struct	work;
-	struct completion	done;
-};
-
-static void wq_barrier_func(struct work_struct *work)
+static int create_rescuer(struct workqueue_struct *wq)
 {
-	struct wq_barrier *barr = container_of(work, struct wq_barrier, work);
-	complete(&barr->done);
+	struct worker *rescuer;
+	struct task_struct *p;
+
+	rescuer = kzalloc(sizeof(*rescuer), GFP_KERNEL);
+	if (!rescuer)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&rescuer->entry);
+	INIT_LIST_HEAD(&rescuer->node);
+	rescuer->flags = WORKER_RESCUER;
+	rescuer->rescue_wq = wq;
+
+	p = kthread_create(rescuer_thread, rescuer, "%s", wq->name);
+	if (IS_ERR(p)) {
+		kfree(rescuer);
+		return PTR_ERR(p);
+	}
+	p->flags |= PF_WQ_WORKER;
+	rescuer->task = p;
+	wq->rescuer = rescuer;
+	wake_up_process(p);
+
+	return 0;
 }
 
 static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
-			struct wq_barrier *barr, struct list_head *head)
+			struct wq_barrier *barr, struct list_head *head,
+			struct work_struct *target)
 {
 	INIT_WORK(&barr->work, wq_barrier_func);
 	__set_bit(WORK_STRUCT_PENDING, work_data_bits(&barr->work));
 
 	init_completion(&barr->done);
+	barr->target = target;
 
 	insert_work(cwq, &barr->work, head);
 }
 
 static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 {
+	struct worker *worker = current_wq_worker();
 	int active = 0;
 	struct wq_barrier barr;
 
-	WARN_ON(cwq->thread == current);
+	WARN_ON(worker && worker->current_cwq == cwq);
 
-	spin_lock_irq(&cwq->lock);
-	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
-		insert_wq_barrier(cwq, &barr, &cwq->worklist);
+	spin_lock_irq(&cwq->pool->lock);
+	if (!list_empty(&cwq->worklist) || cwq->nr_active) {
+		insert_wq_barrier(cwq, &barr, &cwq->worklist, NULL);
 		active = 1;
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&cwq->pool->lock);
 
 	if (active)
 		wait_for_completion(&barr.done);
@@ -429,7 +1132,7 @@ int flush_work(struct work_struct *work)
 	lock_map_release(&cwq->wq->lockdep_map);
 
 	prev = NULL;
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&cwq->pool->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
@@ -440,13 +1143,13 @@ int flush_work(struct work_struct *work)
 			goto out;
 		prev = &work->entry;
 	} else {
-		if (cwq->current_work != work)
+		if (!find_worker_executing_work(cwq->pool, cwq, work))
 			goto out;
 		prev = &cwq->worklist;
 	}
-	insert_wq_barrier(cwq, &barr, prev->next);
+	insert_wq_barrier(cwq, &barr, prev->next, work);
 out:
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&cwq->pool->lock);
 	if (!prev)
 		return 0;
 
@@ -476,7 +1179,7 @@ static int try_to_grab_pending(struct work_struct *work)
 	if (!cwq)
 		return ret;
 
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&cwq->pool->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * This work is queued, but perhaps we locked the wrong cwq.
@@ -486,10 +1189,11 @@ static int try_to_grab_pending(struct work_struct *work)
 		smp_rmb();
 		if (cwq == get_wq_data(work)) {
 			list_del_init(&work->entry);
+			cwq_update_runnable(cwq);
 			ret = 1;
 		}
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&cwq->pool->lock);
 
 	return ret;
 }
@@ -500,12 +1204,12 @@ static void wait_on_cpu_work(struct cpu_workqueue_struct *cwq,
 	struct wq_barrier barr;
 	int running = 0;
 
-	spin_lock_irq(&cwq->lock);
-	if (unlikely(cwq->current_work == work)) {
-		insert_wq_barrier(cwq, &barr, cwq->worklist.next);
+	spin_lock_irq(&cwq->pool->lock);
+	if (unlikely(find_worker_executing_work(cwq->pool, cwq, work))) {
+		insert_wq_barrier(cwq, &barr, cwq->worklist.next, work);
 		running = 1;
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&cwq->pool->lock);
 
 	if (unlikely(running))
 		wait_for_completion(&barr.done);
@@ -759,18 +1463,34 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = raw_smp_processor_id(); /* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct worker *worker = current_wq_worker();
 
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
+}
 
+static void init_worker_pool(struct worker_pool *pool, int cpu,
+			     struct workqueue_struct *wq)
+{
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->worklist);
+	INIT_LIST_HEAD(&pool->idle_list);
+	INIT_LIST_HEAD(&pool->busy_list);
+	INIT_LIST_HEAD(&pool->workers);
+	setup_timer(&pool->idle_timer, idle_worker_timeout,
+		    (unsigned long)pool);
+	setup_timer(&pool->mayday_timer, pool_mayday_timeout,
+		    (unsigned long)pool);
+	init_waitqueue_head(&pool->exit_wait);
+	pool->cpu = cpu;
+	pool->wq = wq;
+	if (wq)
+		pool->flags = POOL_PRIVATE |
+			(wq->freezeable ? POOL_FREEZEABLE : 0);
+	else
+		pool->flags = POOL_DISASSOCIATED;
 }
 
 static struct cpu_workqueue_struct *
@@ -779,49 +1499,121 @@ init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
 	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
 
 	cwq->wq = wq;
-	spin_lock_init(&cwq->lock);
 	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
+	INIT_LIST_HEAD(&cwq->pool_entry);
+	init_waitqueue_head(&cwq->done_wait);
+	cwq->max_active = 1;
+
+	if (is_wq_shared(wq)) {
+		cwq->pool = &per_cpu(worker_pools, cpu);
+	} else {
+		cwq->pool = per_cpu_ptr(wq->pools, cpu);
+		init_worker_pool(cwq->pool,
+				 is_wq_single_threaded(wq) ? -1 : cpu, wq);
+	}
 
 	return cwq;
 }
 
-static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+/*
+ * Create the first worker of @pool, to be started by associate_pool()
+ * once its cpu is online.
+ */
+static int prepare_pool(struct worker_pool *pool)
 {
-	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
-	struct workqueue_struct *wq = cwq->wq;
-	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
-	struct task_struct *p;
+	struct worker *worker;
 
-	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
-	/*
-	 * Nobody can add the work_struct to this cwq,
-	 *	if (caller is __create_workqueue)
-	 *		nobody should see this wq
-	 *	else // caller is CPU_UP_PREPARE
-	 *		cpu is not on cpu_online_map
-	 * so we can abort safely.
-	 */
-	if (IS_ERR(p))
-		return PTR_ERR(p);
-	if (cwq->wq->rt)
-		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
-	cwq->thread = p;
-
-	trace_workqueue_creation(cwq->thread, cpu);
+	worker = create_worker(pool);
+	if (!worker)
+		return -ENOMEM;
+	if (pool->cpu >= 0)
+		kthread_bind(worker->task, pool->cpu);
+	pool->first_worker = worker;
 
 	return 0;
 }
 
-static void start_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+static void cancel_pool(struct worker_pool *pool)
 {
-	struct task_struct *p = cwq->thread;
+	struct worker *worker = pool->first_worker;
+
+	if (worker) {
+		/* never woken up, so it won't run worker_thread() */
+		kthread_stop(worker->task);
+		kfree(worker);
+		pool->first_worker = NULL;
+	}
+}
 
-	if (p != NULL) {
-		if (cpu >= 0)
-			kthread_bind(p, cpu);
-		wake_up_process(p);
+/*
+ * CPU_ONLINE or CPU_DOWN_FAILED: from now on the workers of @pool are
+ * bound to its cpu and managed again.  Idle workers left over from the
+ * time the pool was disassociated are retired right away, busy ones
+ * once they run out of work (see worker_is_rogue()).
+ */
+static void associate_pool(struct worker_pool *pool)
+{
+	del_timer_sync(&pool->idle_timer);
+
+	spin_lock_irq(&pool->lock);
+	pool->flags &= ~POOL_DISASSOCIATED;
+	atomic_set(&pool->nr_running, 0);
+	retire_idle_workers(pool);
+	if (pool->first_worker) {
+		start_worker(pool->first_worker);
+		pool->first_worker = NULL;
 	}
+	spin_unlock_irq(&pool->lock);
+}
+
+/*
+ * CPU_DOWN_PREPARE: the workers of @pool are about to lose their cpu.
+ * Stop managing them, so that they simply process the works queued
+ * until CPU_POST_DEAD flushes the cwqs of the cpu.
+ */
+static void disassociate_pool(struct worker_pool *pool)
+{
+	struct worker *worker;
+
+	spin_lock_irq(&pool->lock);
+	pool->flags |= POOL_DISASSOCIATED;
+	list_for_each_entry(worker, &pool->workers, node)
+		worker->flags |= WORKER_UNMANAGED;
+	if (need_more_worker(pool))
+		wake_up_worker(pool);
+	spin_unlock_irq(&pool->lock);
+}
+
+static int start_private_worker(struct cpu_workqueue_struct *cwq)
+{
+	int err;
+
+	err = prepare_pool(cwq->pool);
+	if (!err)
+		associate_pool(cwq->pool);
+	return err;
+}
+
+static int cwq_idle(struct cpu_workqueue_struct *cwq)
+{
+	int ret;
+
+	spin_lock_irq(&cwq->pool->lock);
+	ret = list_empty(&cwq->worklist) && !cwq->nr_active;
+	spin_unlock_irq(&cwq->pool->lock);
+
+	return ret;
+}
+
+static int pool_workers_gone(struct worker_pool *pool)
+{
+	int ret;
+
+	spin_lock_irq(&pool->lock);
+	ret = !pool->nr_workers;
+	spin_unlock_irq(&pool->lock);
+
+	return ret;
 }
 
 struct workqueue_struct *__create_workqueue_key(const char *name,
@@ -839,12 +1631,6 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	if (!wq)
 		return NULL;
 
-	wq->cpu_wq = alloc_percpu(struct cpu_workqueue_struct);
-	if (!wq->cpu_wq) {
-		kfree(wq);
-		return NULL;
-	}
-
 	wq->name = name;
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	wq->singlethread = singlethread;
@@ -852,17 +1638,27 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	wq->rt = rt;
 	INIT_LIST_HEAD(&wq->list);
 
+	wq->cpu_wq = alloc_percpu(struct cpu_workqueue_struct);
+	if (!wq->cpu_wq)
+		goto free_wq;
+	if (!is_wq_shared(wq)) {
+		wq->pools = alloc_percpu(struct worker_pool);
+		if (!wq->pools)
+			goto free_cpu_wq;
+	} else if (create_rescuer(wq)) {
+		goto free_cpu_wq;
+	}
+
 	if (singlethread) {
 		cwq = init_cpu_workqueue(wq, singlethread_cpu);
-		err = create_workqueue_thread(cwq, singlethread_cpu);
-		start_workqueue_thread(cwq, -1);
+		err = start_private_worker(cwq);
 	} else {
 		cpu_maps_update_begin();
 		/*
 		 * We must place this wq on list even if the code below fails.
 		 * cpu_down(cpu) can remove cpu from cpu_populated_map before
 		 * destroy_workqueue() takes the lock, in that case we leak
-		 * cwq[cpu]->thread.
+		 * the worker of cwq[cpu]->pool.
 		 */
 		spin_lock(&workqueue_lock);
 		list_add(&wq->list, &workqueues);
@@ -875,10 +1671,9 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 		 */
 		for_each_possible_cpu(cpu) {
 			cwq = init_cpu_workqueue(wq, cpu);
-			if (err || !cpu_online(cpu))
+			if (err || !cpu_online(cpu) || is_wq_shared(wq))
 				continue;
-			err = create_workqueue_thread(cwq, cpu);
-			start_workqueue_thread(cwq, cpu);
+			err = start_private_worker(cwq);
 		}
 		cpu_maps_update_done();
 	}
@@ -888,16 +1683,25 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 		wq = NULL;
 	}
 	return wq;
+
+free_cpu_wq:
+	free_percpu(wq->cpu_wq);
+free_wq:
+	kfree(wq);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
-static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
+static void cleanup_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 {
+	struct worker_pool *pool = cwq->pool;
+	struct worker *worker;
+
 	/*
 	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
-	 * cpu_add_remove_lock protects cwq->thread.
+	 * cpu_add_remove_lock protects the workers of a private pool.
 	 */
-	if (cwq->thread == NULL)
+	if ((pool->flags & POOL_PRIVATE) && !pool->nr_workers)
 		return;
 
 	lock_map_acquire(&cwq->wq->lockdep_map);
@@ -907,16 +1711,22 @@ static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 	/*
 	 * If the caller is CPU_POST_DEAD and cwq->worklist was not empty,
 	 * a concurrent flush_workqueue() can insert a barrier after us.
-	 * However, in that case run_workqueue() won't return and check
-	 * kthread_should_stop() until it flushes all work_struct's.
-	 * When ->worklist becomes empty it is safe to exit because no
-	 * more work_structs can be queued on this cwq: flush_workqueue
-	 * checks list_empty(), and a "normal" queue_work() can't use
-	 * a dead CPU.
+	 * However, in that case the workers don't go idle, and so don't
+	 * exit, until they have processed all work_struct's.  When
+	 * ->worklist becomes empty no more work_structs can be queued on
+	 * this cwq: flush_workqueue checks list_empty(), and a "normal"
+	 * queue_work() can't use a dead CPU.
 	 */
-	trace_workqueue_destruction(cwq->thread);
-	kthread_stop(cwq->thread);
-	cwq->thread = NULL;
+	if (pool->flags & POOL_PRIVATE) {
+		spin_lock_irq(&pool->lock);
+		list_for_each_entry(worker, &pool->workers, node)
+			retire_worker(worker);
+		spin_unlock_irq(&pool->lock);
+		wait_event(pool->exit_wait, pool_workers_gone(pool));
+	} else {
+		/* the last worker may still be looking at the cwq */
+		wait_event(cwq->done_wait, cwq_idle(cwq));
+	}
 }
 
 /**
@@ -936,9 +1746,14 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	spin_unlock(&workqueue_lock);
 
 	for_each_cpu(cpu, cpu_map)
-		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
+		cleanup_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, cpu));
  	cpu_maps_update_done();
 
+	if (wq->rescuer) {
+		kthread_stop(wq->rescuer->task);
+		kfree(wq->rescuer);
+	}
+	free_percpu(wq->pools);
 	free_percpu(wq->cpu_wq);
 	kfree(wq);
 }
@@ -949,6 +1764,7 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
 	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
 	int ret = NOTIFY_OK;
@@ -958,6 +1774,16 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 	switch (action) {
 	case CPU_UP_PREPARE:
 		cpumask_set_cpu(cpu, cpu_populated_map);
+		if (!prepare_pool(pool))
+			break;
+		printk(KERN_ERR "workqueue: worker pool for %i failed\n", cpu);
+		action = CPU_UP_CANCELED;
+		ret = NOTIFY_BAD;
+		break;
+
+	case CPU_DOWN_PREPARE:
+		disassociate_pool(pool);
+		break;
 	}
 undo:
 	list_for_each_entry(wq, &workqueues, list) {
@@ -965,7 +1791,7 @@ undo:
 
 		switch (action) {
 		case CPU_UP_PREPARE:
-			if (!create_workqueue_thread(cwq, cpu))
+			if (is_wq_shared(wq) || !prepare_pool(cwq->pool))
 				break;
 			printk(KERN_ERR "workqueue [%s] for %i failed\n",
 				wq->name, cpu);
@@ -974,26 +1800,95 @@ undo:
 			goto undo;
 
 		case CPU_ONLINE:
-			start_workqueue_thread(cwq, cpu);
+			if (!is_wq_shared(wq))
+				associate_pool(cwq->pool);
 			break;
 
 		case CPU_UP_CANCELED:
-			start_workqueue_thread(cwq, -1);
+			if (!is_wq_shared(wq))
+				cancel_pool(cwq->pool);
+			break;
+
 		case CPU_POST_DEAD:
-			cleanup_workqueue_thread(cwq);
+			cleanup_cpu_workqueue(cwq);
 			break;
 		}
 	}
 
 	switch (action) {
+	case CPU_DOWN_FAILED:
+		/* a new worker takes over, the old ones are not bound */
+		prepare_pool(pool);
+	case CPU_ONLINE:
+		associate_pool(pool);
+		break;
+
 	case CPU_UP_CANCELED:
+		cancel_pool(pool);
+		cpumask_clear_cpu(cpu, cpu_populated_map);
+		break;
+
 	case CPU_POST_DEAD:
+		spin_lock_irq(&pool->lock);
+		retire_idle_workers(pool);
+		spin_unlock_irq(&pool->lock);
 		cpumask_clear_cpu(cpu, cpu_populated_map);
+		break;
 	}
 
 	return ret;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int worker_pools_show(struct seq_file *m, void *v)
+{
+	int cpu;
+
+	seq_printf(m, "%-4s %7s %5s %7s %7s %7s %9s %7s %7s %10s\n",
+		   "cpu", "workers", "idle", "running", "max", "created",
+		   "destroyed", "wakeups", "maydays", "executed");
+	for_each_possible_cpu(cpu) {
+		struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+
+		spin_lock_irq(&pool->lock);
+		if (pool->nr_workers)
+			seq_printf(m, "%-4d %7d %5d %7d %7d %7lu %9lu %7lu "
+				   "%7lu %10lu\n", cpu, pool->nr_workers,
+				   pool->nr_idle,
+				   atomic_read(&pool->nr_running),
+				   pool->max_workers, pool->workers_created,
+				   pool->workers_destroyed, pool->wakeups,
+				   pool->maydays, pool->works_executed);
+		spin_unlock_irq(&pool->lock);
+	}
+	return 0;
+}
+
+static int worker_pools_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, worker_pools_show, NULL);
+}
+
+static const struct file_operations worker_pools_fops = {
+	.open		= worker_pools_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init workqueue_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (dir)
+		debugfs_create_file("pools", 0444, dir, NULL,
+				    &worker_pools_fops);
+	return 0;
+}
+late_initcall(workqueue_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 #ifdef CONFIG_SMP
 
 struct work_for_cpu {
@@ -1043,12 +1938,25 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
 
 void __init init_workqueues(void)
 {
+	int cpu;
+
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
 
 	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+	for_each_possible_cpu(cpu) {
+		struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+
+		init_worker_pool(pool, cpu, NULL);
+		if (!cpu_online(cpu))
+			continue;
+		BUG_ON(prepare_pool(pool));
+		associate_pool(pool);
+	}
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(keventd_wq->cpu_wq, cpu)->max_active = WQ_DFL_ACTIVE;
 }
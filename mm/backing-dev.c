@@ -64,6 +64,7 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
 	unsigned long nr_dirty, nr_io, nr_more_io, nr_wb;
+	unsigned long ra_pages, ra_hit, ra_miss;
 	struct inode *inode;
 
 	/*
@@ -84,6 +85,9 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 	spin_unlock(&inode_lock);
 
 	get_dirty_limits(&background_thresh, &dirty_thresh, &bdi_thresh, bdi);
+	ra_pages = bdi_stat(bdi, BDI_RA_PAGES);
+	ra_hit = bdi_stat(bdi, BDI_RA_HIT);
+	ra_miss = bdi_stat(bdi, BDI_RA_MISS);
 
 #define K(x) ((x) << (PAGE_SHIFT - 10))
 	seq_printf(m,
@@ -92,6 +96,16 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtyThresh:   %8lu kB\n"
 		   "DirtyThresh:      %8lu kB\n"
 		   "BackgroundThresh: %8lu kB\n"
+		   "BdiWritten:       %8lu kB\n"
+		   "BdiWriteBandwidth: %8lu kBps\n"
+		   "BdiAvgWriteBandwidth: %8lu kBps\n"
+		   "DirtyPauses:      %8lu\n"
+		   "DirtyPausedMs:    %8u\n"
+		   "LastPauseMs:      %8u\n"
+		   "BdiReadahead:     %8lu kB\n"
+		   "BdiReadaheadHit:  %8lu kB\n"
+		   "BdiReadaheadMiss: %8lu kB\n"
+		   "ReadaheadEfficiency: %5lu %%\n"
 		   "WritebackThreads: %8lu\n"
 		   "b_dirty:          %8lu\n"
 		   "b_io:             %8lu\n"
@@ -104,7 +118,14 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
 		   K(bdi_thresh), K(dirty_thresh),
-		   K(background_thresh), nr_wb, nr_dirty, nr_io, nr_more_io,
+		   K(background_thresh),
+		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
+		   K(bdi->write_bandwidth), K(bdi->avg_write_bandwidth),
+		   bdi->dirty_pauses, jiffies_to_msecs(bdi->dirty_paused),
+		   jiffies_to_msecs(bdi->last_pause),
+		   K(ra_pages), K(ra_hit), K(ra_miss),
+		   ra_pages ? min(ra_hit * 100 / ra_pages, 100UL) : 0,
+		   nr_wb, nr_dirty, nr_io, nr_more_io,
 		   !list_empty(&bdi->bdi_list), bdi->state, bdi->wb_mask,
 		   !list_empty(&bdi->wb_list), bdi->wb_cnt);
 #undef K
@@ -673,6 +694,16 @@ int bdi_init(struct backing_dev_info *bdi)
 	}
 
 	bdi->dirty_exceeded = 0;
+
+	spin_lock_init(&bdi->bw_lock);
+	bdi->bw_time_stamp = jiffies;
+	bdi->written_stamp = 0;
+	bdi->write_bandwidth = INIT_BW;
+	bdi->avg_write_bandwidth = INIT_BW;
+	bdi->dirty_pauses = 0;
+	bdi->dirty_paused = 0;
+	bdi->last_pause = 0;
+
 	err = prop_local_init_percpu(&bdi->completions);
 
 	if (err) {
@@ -143,17 +143,16 @@ unsigned long __init init_bootmem(unsigned long start, unsigned long pages)
 	return init_bootmem_core(NODE_DATA(0)->bdata, start, 0, pages);
 }
 
-static unsigned long __init free_all_bootmem_core(bootmem_data_t *bdata)
+/*
+ * Release the free pages in [start, end) to the buddy allocator.  start
+ * must be at a word boundary of the bitmap.
+ */
+static unsigned long __init free_bootmem_range(bootmem_data_t *bdata,
+					unsigned long start, unsigned long end)
 {
 	int aligned;
 	struct page *page;
-	unsigned long start, end, pages, count = 0;
-
-	if (!bdata->node_bootmem_map)
-		return 0;
-
-	start = bdata->node_min_pfn;
-	end = bdata->node_low_pfn;
+	unsigned long count = 0;
 
 	/*
 	 * If the start is aligned to the machines wordsize, we might
@@ -192,13 +191,89 @@ static unsigned long __init free_all_bootmem_core(bootmem_data_t *bdata)
 		start += BITS_PER_LONG;
 	}
 
+	return count;
+}
+
+static unsigned long __init free_bootmem_map(bootmem_data_t *bdata)
+{
+	struct page *page;
+	unsigned long i, pages;
+
 	page = virt_to_page(bdata->node_bootmem_map);
 	pages = bdata->node_low_pfn - bdata->node_min_pfn;
 	pages = bootmem_bootmap_pages(pages);
-	count += pages;
-	while (pages--)
+	for (i = 0; i < pages; i++)
 		__free_pages_bootmem(page++, 0);
 
+	return pages;
+}
+
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/*
+ * The struct pages from first_deferred_pfn on are not initialised yet,
+ * leave them, and the bitmap describing them, for the pgdatinit thread.
+ * Stop at the bitmap word boundary below first_deferred_pfn so that the
+ * thread can pick up from there.
+ */
+static unsigned long __init bootmem_deferred_start(bootmem_data_t *bdata)
+{
+	pg_data_t *pgdat = NODE_DATA(bdata - bootmem_node_data);
+	unsigned long pfn = pgdat->first_deferred_pfn;
+
+	if (pfn >= bdata->node_low_pfn)
+		return bdata->node_low_pfn;
+	if (pfn < bdata->node_min_pfn)
+		return bdata->node_min_pfn;
+	return bdata->node_min_pfn +
+		((pfn - bdata->node_min_pfn) & ~(BITS_PER_LONG - 1));
+}
+
+/**
+ * free_all_bootmem_deferred - release the rest of a node's free pages
+ * @pgdat: node whose struct pages have just been initialised
+ *
+ * Releases the free pages free_all_bootmem_node() left behind, followed
+ * by the bootmem bitmap of the node.
+ *
+ * Returns the number of pages actually released.
+ */
+unsigned long __init free_all_bootmem_deferred(pg_data_t *pgdat)
+{
+	bootmem_data_t *bdata = pgdat->bdata;
+	unsigned long count;
+
+	if (!bdata->node_bootmem_map)
+		return 0;
+
+	count = free_bootmem_range(bdata, bootmem_deferred_start(bdata),
+				   bdata->node_low_pfn);
+	count += free_bootmem_map(bdata);
+
+	bdebug("nid=%td released=%lx\n", bdata - bootmem_node_data, count);
+
+	return count;
+}
+#else
+static inline unsigned long bootmem_deferred_start(bootmem_data_t *bdata)
+{
+	return bdata->node_low_pfn;
+}
+#endif
+
+static unsigned long __init free_all_bootmem_core(bootmem_data_t *bdata)
+{
+	unsigned long end, count;
+
+	if (!bdata->node_bootmem_map)
+		return 0;
+
+	end = bootmem_deferred_start(bdata);
+	count = free_bootmem_range(bdata, bdata->node_min_pfn, end);
+
+	/* The bitmap is still needed for the deferred pages */
+	if (end == bdata->node_low_pfn)
+		count += free_bootmem_map(bdata);
+
 	bdebug("nid=%td released=%lx\n", bdata - bootmem_node_data, count);
 
 	return count;
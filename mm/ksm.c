@@ -74,6 +74,15 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * Unless merge_across_nodes is set, there is one stable and one unstable
+ * tree per NUMA node, and a page is only ever compared with pages of its
+ * own node: so a merge never leaves tasks on one node sharing a ksm page
+ * allocated on another.
+ *
+ * The checksum used to detect volatile pages only samples some cache lines
+ * spread over the page: a change it misses costs nothing but a wasted tree
+ * walk, since merging is always decided by a full memcmp_pages().
  */
 
 /**
@@ -115,11 +124,15 @@ struct ksm_scan {
  * @node: rb_node of this rmap_item in either unstable or stable tree
  * @next: next rmap_item hanging off the same node of the stable tree
  * @prev: previous rmap_item hanging off the same node of the stable tree
+ * @nid: index of the stable or unstable tree this rmap_item is a node of
  */
 struct rmap_item {
 	struct list_head link;
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
+#ifdef CONFIG_NUMA
+	int nid;
+#endif
 	union {
 		unsigned int oldchecksum;		/* when unstable */
 		struct rmap_item *next;			/* when stable */
@@ -134,9 +147,11 @@ struct rmap_item {
 #define NODE_FLAG	0x100	/* is a node of unstable or stable tree */
 #define STABLE_FLAG	0x200	/* is a node or list item of stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/* The stable and unstable tree heads, one of each per node if NUMA */
+static struct rb_root one_stable_tree[1] = { RB_ROOT };
+static struct rb_root one_unstable_tree[1] = { RB_ROOT };
+static struct rb_root *root_stable_tree = one_stable_tree;
+static struct rb_root *root_unstable_tree = one_unstable_tree;
 
 #define MM_SLOTS_HASH_HEADS 1024
 static struct hlist_head *mm_slots_hash;
@@ -172,6 +187,41 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Ceiling for the sleep when ksmd backs off after unproductive scans */
+static unsigned int ksm_thread_max_sleep_millisecs = 1000;
+
+/* How many times the sleep has been doubled since the last good scan */
+static unsigned int ksm_sleep_shift;
+
+/*
+ * A full scan is unproductive if it merges fewer than one in every
+ * KSM_LOW_YIELD_RATIO pages scanned.
+ */
+#define KSM_LOW_YIELD_RATIO	1024
+#define KSM_MAX_SLEEP_SHIFT	10
+
+/* Pages scanned and merged during the current full scan */
+static unsigned long ksm_scan_pages;
+static unsigned long ksm_scan_merged;
+
+/* Pages merged during the last completed full scan */
+static unsigned long ksm_last_scan_merged;
+
+/* Total pages scanned by ksmd */
+static unsigned long ksm_pages_scanned;
+
+/* Pages passed over because their checksum had changed */
+static unsigned long ksm_pages_skipped;
+
+#ifdef CONFIG_NUMA
+/* Zero to only merge pages which are on the same NUMA node */
+static unsigned int ksm_merge_across_nodes;
+static int ksm_nr_node_ids = 1;
+#else
+#define ksm_merge_across_nodes	1U
+#define ksm_nr_node_ids		1
+#endif
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -285,6 +335,33 @@ static inline int in_stable_tree(struct rmap_item *rmap_item)
 	return rmap_item->address & STABLE_FLAG;
 }
 
+/* Index of the stable and unstable trees @page is to be sorted into */
+static inline int get_page_tree_nid(struct page *page)
+{
+	return ksm_merge_across_nodes ? 0 : page_to_nid(page);
+}
+
+#ifdef CONFIG_NUMA
+static inline int rmap_item_nid(struct rmap_item *rmap_item)
+{
+	return rmap_item->nid;
+}
+
+static inline void set_rmap_item_nid(struct rmap_item *rmap_item, int nid)
+{
+	rmap_item->nid = nid;
+}
+#else
+static inline int rmap_item_nid(struct rmap_item *rmap_item)
+{
+	return 0;
+}
+
+static inline void set_rmap_item_nid(struct rmap_item *rmap_item, int nid)
+{
+}
+#endif
+
 /*
  * ksmd, and unmerge_and_remove_all_rmap_items(), must not touch an mm's
  * page tables after it has passed through ksm_exit() - which, if necessary,
@@ -431,14 +508,18 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		struct rmap_item *next_item = rmap_item->next;
 
 		if (rmap_item->address & NODE_FLAG) {
+			struct rb_root *root = root_stable_tree +
+						rmap_item_nid(rmap_item);
+
 			if (next_item) {
 				rb_replace_node(&rmap_item->node,
-						&next_item->node,
-						&root_stable_tree);
+						&next_item->node, root);
 				next_item->address |= NODE_FLAG;
+				set_rmap_item_nid(next_item,
+						  rmap_item_nid(rmap_item));
 				ksm_pages_sharing--;
 			} else {
-				rb_erase(&rmap_item->node, &root_stable_tree);
+				rb_erase(&rmap_item->node, root);
 				ksm_pages_shared--;
 			}
 		} else {
@@ -467,7 +548,8 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node, root_unstable_tree +
+					rmap_item_nid(rmap_item));
 		ksm_pages_unshared--;
 	}
 
@@ -583,11 +665,25 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only has to tell a page which keeps being written to from
+ * one which has settled down: hash KSM_CHECKSUM_SAMPLES cache lines spread
+ * evenly over the page, rather than all of it.
+ */
+#define KSM_CHECKSUM_SAMPLES	16
+#define KSM_CHECKSUM_STRIDE	(PAGE_SIZE / KSM_CHECKSUM_SAMPLES)
+#define KSM_CHECKSUM_WORDS	(min_t(unsigned int, L1_CACHE_BYTES,	\
+				       KSM_CHECKSUM_STRIDE) / sizeof(u32))
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u32 checksum = 17;
+	char *addr = kmap_atomic(page, KM_USER0);
+	int i;
+
+	for (i = 0; i < KSM_CHECKSUM_SAMPLES; i++)
+		checksum = jhash2((u32 *)(addr + i * KSM_CHECKSUM_STRIDE),
+				  KSM_CHECKSUM_WORDS, checksum);
 	kunmap_atomic(addr, KM_USER0);
 	return checksum;
 }
@@ -835,7 +931,15 @@ static int try_to_merge_two_pages(struct mm_struct *mm1, unsigned long addr1,
 	    ksm_max_kernel_pages <= ksm_pages_shared)
 		return err;
 
-	kpage = alloc_page(GFP_HIGHUSER);
+	/*
+	 * The stable tree of the node the merged page lands on is where
+	 * it gets filed: keep it on the node of the pages it replaces.
+	 */
+	if (ksm_merge_across_nodes)
+		kpage = alloc_page(GFP_HIGHUSER);
+	else
+		kpage = alloc_pages_node(page_to_nid(page1),
+					 GFP_HIGHUSER | GFP_THISNODE, 0);
 	if (!kpage)
 		return err;
 
@@ -885,7 +989,8 @@ static struct rmap_item *stable_tree_search(struct page *page,
 					    struct page **page2,
 					    struct rmap_item *rmap_item)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	int nid = get_page_tree_nid(page);
+	struct rb_node *node = root_stable_tree[nid].rb_node;
 
 	while (node) {
 		struct rmap_item *tree_rmap_item, *next_rmap_item;
@@ -934,7 +1039,9 @@ static struct rmap_item *stable_tree_search(struct page *page,
 static struct rmap_item *stable_tree_insert(struct page *page,
 					    struct rmap_item *rmap_item)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	int nid = get_page_tree_nid(page);
+	struct rb_root *root = root_stable_tree + nid;
+	struct rb_node **new = &root->rb_node;
 	struct rb_node *parent = NULL;
 
 	while (*new) {
@@ -976,8 +1083,9 @@ static struct rmap_item *stable_tree_insert(struct page *page,
 
 	rmap_item->address |= NODE_FLAG | STABLE_FLAG;
 	rmap_item->next = NULL;
+	set_rmap_item_nid(rmap_item, nid);
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_stable_tree);
+	rb_insert_color(&rmap_item->node, root);
 
 	ksm_pages_shared++;
 	return rmap_item;
@@ -1005,7 +1113,9 @@ static struct rmap_item *unstable_tree_search_insert(struct page *page,
 						struct page **page2,
 						struct rmap_item *rmap_item)
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	int nid = get_page_tree_nid(page);
+	struct rb_root *root = root_unstable_tree + nid;
+	struct rb_node **new = &root->rb_node;
 	struct rb_node *parent = NULL;
 
 	while (*new) {
@@ -1027,6 +1137,15 @@ static struct rmap_item *unstable_tree_search_insert(struct page *page,
 			return NULL;
 		}
 
+		/*
+		 * The tree page may have been migrated to another node
+		 * since it was inserted: don't merge across nodes then.
+		 */
+		if (get_page_tree_nid(page2[0]) != nid) {
+			put_page(page2[0]);
+			return NULL;
+		}
+
 		ret = memcmp_pages(page, page2[0]);
 
 		parent = *new;
@@ -1043,8 +1162,9 @@ static struct rmap_item *unstable_tree_search_insert(struct page *page,
 
 	rmap_item->address |= NODE_FLAG;
 	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	set_rmap_item_nid(rmap_item, nid);
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, root);
 
 	ksm_pages_unshared++;
 	return NULL;
@@ -1068,6 +1188,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->address |= STABLE_FLAG;
 
 	ksm_pages_sharing++;
+	ksm_scan_merged++;
 }
 
 /*
@@ -1128,6 +1249,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		ksm_pages_skipped++;
 		return;
 	}
 
@@ -1143,7 +1265,8 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		 * tree, and insert it instead as new node in the stable tree.
 		 */
 		if (!err) {
-			rb_erase(&tree_rmap_item->node, &root_unstable_tree);
+			rb_erase(&tree_rmap_item->node, root_unstable_tree +
+					rmap_item_nid(tree_rmap_item));
 			tree_rmap_item->address &= ~NODE_FLAG;
 			ksm_pages_unshared--;
 
@@ -1197,6 +1320,37 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Called at the end of each full scan: if the scan merged hardly anything,
+ * double ksmd's sleep between batches (up to max_sleep_millisecs), so that
+ * a host with little to merge does not keep burning a cpu on it; go back
+ * to sleep_millisecs as soon as a scan is productive again.
+ */
+static void ksm_update_backoff(void)
+{
+	if (ksm_scan_merged * KSM_LOW_YIELD_RATIO < ksm_scan_pages) {
+		if (ksm_sleep_shift < KSM_MAX_SLEEP_SHIFT)
+			ksm_sleep_shift++;
+	} else
+		ksm_sleep_shift = 0;
+
+	ksm_last_scan_merged = ksm_scan_merged;
+	ksm_scan_merged = 0;
+	ksm_scan_pages = 0;
+}
+
+static unsigned int ksm_sleep_millisecs(void)
+{
+	unsigned int msecs = ksm_thread_sleep_millisecs;
+	unsigned int max = ksm_thread_max_sleep_millisecs;
+
+	if (!ksm_sleep_shift || msecs >= max)
+		return msecs;
+	if (msecs > (max >> ksm_sleep_shift))
+		return max;
+	return msecs << ksm_sleep_shift;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1209,7 +1363,10 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 
 	slot = ksm_scan.mm_slot;
 	if (slot == &ksm_mm_head) {
-		root_unstable_tree = RB_ROOT;
+		int nid;
+
+		for (nid = 0; nid < ksm_nr_node_ids; nid++)
+			root_unstable_tree[nid] = RB_ROOT;
 
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
@@ -1304,6 +1461,7 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
+	ksm_update_backoff();
 	return NULL;
 }
 
@@ -1321,6 +1479,8 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_scan_pages++;
+		ksm_pages_scanned++;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		else if (page_mapcount(page) == 1) {
@@ -1352,7 +1512,7 @@ static int ksm_scan_thread(void *nothing)
 
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
-				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+				msecs_to_jiffies(ksm_sleep_millisecs()));
 		} else {
 			wait_event_interruptible(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1429,6 +1589,9 @@ int __ksm_enter(struct mm_struct *mm)
 	set_bit(MMF_VM_MERGEABLE, &mm->flags);
 	atomic_inc(&mm->mm_count);
 
+	/* A new area to merge: scan at full speed again */
+	ksm_sleep_shift = 0;
+
 	if (needs_wakeup)
 		wake_up_interruptible(&ksm_thread_wait);
 
@@ -1507,6 +1670,36 @@ static ssize_t sleep_millisecs_store(struct kobject *kobj,
 }
 KSM_ATTR(sleep_millisecs);
 
+static ssize_t max_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_thread_max_sleep_millisecs);
+}
+
+static ssize_t max_sleep_millisecs_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	ksm_thread_max_sleep_millisecs = msecs;
+
+	return count;
+}
+KSM_ATTR(max_sleep_millisecs);
+
+static ssize_t cur_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_sleep_millisecs());
+}
+KSM_ATTR_RO(cur_sleep_millisecs);
+
 static ssize_t pages_to_scan_show(struct kobject *kobj,
 				  struct kobj_attribute *attr, char *buf)
 {
@@ -1600,6 +1793,46 @@ static ssize_t max_kernel_pages_show(struct kobject *kobj,
 }
 KSM_ATTR(max_kernel_pages);
 
+#ifdef CONFIG_NUMA
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err)
+		return err;
+	if (knob > 1)
+		return -EINVAL;
+
+	/*
+	 * The stable trees cannot be resorted while they hold ksm pages:
+	 * unmerge everything first (echo 2 >run).
+	 */
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_merge_across_nodes != knob) {
+		if (ksm_pages_shared)
+			err = -EBUSY;
+		else if (!knob && ksm_nr_node_ids < nr_node_ids)
+			err = -ENOMEM;	/* per-node trees were not allocated */
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+#endif
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1645,16 +1878,45 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t last_scan_merged_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_last_scan_merged);
+}
+KSM_ATTR_RO(last_scan_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
+	&max_sleep_millisecs_attr.attr,
+	&cur_sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
 	&run_attr.attr,
 	&max_kernel_pages_attr.attr,
+#ifdef CONFIG_NUMA
+	&merge_across_nodes_attr.attr,
+#endif
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
+	&last_scan_merged_attr.attr,
 	NULL,
 };
 
@@ -1679,6 +1941,22 @@ static int __init ksm_init(void)
 	if (err)
 		goto out_free1;
 
+#ifdef CONFIG_NUMA
+	if (nr_node_ids > 1) {
+		struct rb_root *buf;
+
+		/* RB_ROOT is all zeroes */
+		buf = kzalloc(2 * nr_node_ids * sizeof(*buf), GFP_KERNEL);
+		if (buf) {
+			root_stable_tree = buf;
+			root_unstable_tree = buf + nr_node_ids;
+			ksm_nr_node_ids = nr_node_ids;
+		} else
+			ksm_merge_across_nodes = 1;
+	} else
+		ksm_merge_across_nodes = 1;
+#endif
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -1701,6 +1979,10 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free2:
+#ifdef CONFIG_NUMA
+	if (root_stable_tree != one_stable_tree)
+		kfree(root_stable_tree);
+#endif
 	mm_slots_hash_free();
 out_free1:
 	ksm_slab_free();
@@ -56,6 +56,8 @@
 #include <linux/kallsyms.h>
 #include <linux/swapops.h>
 #include <linux/elf.h>
+#include <linux/mempolicy.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -145,6 +147,504 @@ void pmd_clear_bad(pmd_t *pmd)
 	pmd_clear(pmd);
 }
 
+#ifdef CONFIG_SHARED_PAGE_TABLES
+/*
+ * Sharing of pte pages between shared file mappings.
+ *
+ * When many processes map the same file with MAP_SHARED, their ptes for
+ * it are identical wherever the mappings have the same flags and the
+ * same alignment within a pmd.  Such a pmd range is then mapped through
+ * a single pte page, found through the file's i_mmap tree on the first
+ * fault (or copied at fork), and refcounted by the mms mapping it, like
+ * the pmd pages shared between hugetlb mappings.
+ *
+ * The pte lock lives in the pte page, so all sharers serialize on it.
+ * Taking a new reference, and dropping one that is not the last, is
+ * done under i_mmap_lock; the last reference is dropped by
+ * free_pte_range() once the vma is off the i_mmap tree.  A pmd is only
+ * cleared with mmap_sem held for write, see unshare_pte_tables(), or
+ * replaced by a private pte page before an anonymous page goes in, see
+ * pte_table_make_private().
+ */
+static int vma_pte_table_shareable(struct vm_area_struct *vma)
+{
+	if (!USE_SPLIT_PTLOCKS)
+		return 0;
+	if (!(vma->vm_flags & VM_MAYSHARE) || !vma->vm_file || vma->anon_vma)
+		return 0;
+	/* A forced write (ptrace) into a read-only shared mapping COWs */
+	if ((vma->vm_flags & (VM_MAYWRITE | VM_WRITE)) == VM_MAYWRITE)
+		return 0;
+	if (vma->vm_flags & (VM_NONLINEAR | VM_HUGETLB | VM_PFNMAP |
+			     VM_MIXEDMAP | VM_INSERTPAGE | VM_IO))
+		return 0;
+	return 1;
+}
+
+static int pte_table_shareable(struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long base = addr & PMD_MASK;
+	unsigned long end = base + PMD_SIZE;
+
+	return vma_pte_table_shareable(vma) &&
+		vma->vm_start <= base && end <= vma->vm_end;
+}
+
+/*
+ * Returns the address at which @svma maps file page @idx, if its pte
+ * page there can map @addr of @vma too.
+ */
+static unsigned long pte_table_match(struct vm_area_struct *svma,
+				     struct vm_area_struct *vma,
+				     unsigned long addr, pgoff_t idx)
+{
+	unsigned long saddr = ((idx - svma->vm_pgoff) << PAGE_SHIFT) +
+				svma->vm_start;
+	unsigned long sbase = saddr & PMD_MASK;
+	unsigned long s_end = sbase + PMD_SIZE;
+
+	/* Allow segments to share if only one is marked locked */
+	unsigned long vm_flags = vma->vm_flags & ~VM_LOCKED;
+	unsigned long svm_flags = svma->vm_flags & ~VM_LOCKED;
+
+	if ((addr & ~PMD_MASK) != (saddr & ~PMD_MASK) ||
+	    vm_flags != svm_flags || svma->anon_vma ||
+	    sbase < svma->vm_start || svma->vm_end < s_end)
+		return 0;
+
+	return saddr;
+}
+
+static pmd_t *pte_table_pmd(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, addr);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Find an mm mapping the pte page @page that @vma mapped at @addr
+ * before its pmd was cleared.  The flags of @vma may have changed since
+ * (mprotect), so only look at where the others map the file page.
+ * Called under i_mmap_lock.
+ */
+static struct mm_struct *pte_table_sharer(struct vm_area_struct *vma,
+					  unsigned long addr, struct page *page)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pgoff_t idx = ((addr - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	struct prio_tree_iter iter;
+	struct vm_area_struct *svma;
+	unsigned long saddr;
+	pmd_t *spmd;
+
+	vma_prio_tree_foreach(svma, &iter, &mapping->i_mmap, idx, idx) {
+		saddr = ((idx - svma->vm_pgoff) << PAGE_SHIFT) + svma->vm_start;
+		if ((addr & ~PMD_MASK) != (saddr & ~PMD_MASK))
+			continue;
+		spmd = pte_table_pmd(svma->vm_mm, saddr);
+		if (spmd && pmd_page(*spmd) == page)
+			return svma->vm_mm;
+	}
+	return NULL;
+}
+
+/*
+ * Move the rss charge of the pages mapped through @page from or to
+ * @mm, its only user, as a second mm starts or the last but one mm
+ * stops sharing it.  File pages under migration stay charged, so their
+ * migration entries count too.
+ */
+static void pte_table_charge(struct page *page, struct mm_struct *mm,
+			     int charge)
+{
+	spinlock_t *ptl = __pte_lockptr(page);
+	pte_t *pte = page_address(page);
+	long nr = 0;
+	int i;
+
+	spin_lock(ptl);
+	if (!!(page->index & PTE_TABLE_CHARGED) == charge)
+		goto out;
+	for (i = 0; i < PTRS_PER_PTE; i++) {
+		pte_t ptent = pte[i];
+
+		if (pte_present(ptent) ||
+		    (!pte_none(ptent) && !pte_file(ptent) &&
+		     is_migration_entry(pte_to_swp_entry(ptent))))
+			nr++;
+	}
+	if (charge) {
+		add_mm_counter(mm, file_rss, nr);
+		page->index |= PTE_TABLE_CHARGED;
+	} else {
+		add_mm_counter(mm, file_rss, -nr);
+		page->index &= ~PTE_TABLE_CHARGED;
+	}
+out:
+	spin_unlock(ptl);
+}
+
+/*
+ * Drop the reference of the mm of @vma to @page, whose pmd at @addr it
+ * no longer maps, and charge the pages to the remaining user if there
+ * is only one left.  Called under i_mmap_lock.
+ */
+static void pte_table_detach(struct vm_area_struct *vma, unsigned long addr,
+			     struct page *page)
+{
+	struct mm_struct *sharer;
+
+	put_page(page);
+	dec_zone_page_state(page, NR_PAGETABLE_SAVED);
+	count_vm_event(PGTABLE_UNSHARE);
+	if (page_count(page) != 1)
+		return;
+	sharer = pte_table_sharer(vma, addr, page);
+	if (sharer)
+		pte_table_charge(page, sharer, 1);
+}
+
+/*
+ * Populate @pmd for a fault in a shareable range: with the pte page of
+ * another mm mapping the same part of the file if there is one, or
+ * else with a new pte page that others can share from now on.
+ */
+static int __pte_alloc_shared(struct mm_struct *mm, struct vm_area_struct *vma,
+			      pmd_t *pmd, unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pgoff_t idx = ((address - vma->vm_start) >> PAGE_SHIFT) +
+			vma->vm_pgoff;
+	struct prio_tree_iter iter;
+	struct vm_area_struct *svma;
+	struct mm_struct *smm = NULL;
+	struct page *page = NULL;
+	unsigned long saddr;
+	pgtable_t new;
+
+	spin_lock(&mapping->i_mmap_lock);
+	vma_prio_tree_foreach(svma, &iter, &mapping->i_mmap, idx, idx) {
+		pmd_t *spmd;
+
+		if (svma == vma)
+			continue;
+		saddr = pte_table_match(svma, vma, address, idx);
+		if (!saddr)
+			continue;
+		spmd = pte_table_pmd(svma->vm_mm, saddr);
+		if (spmd && pte_table_shareable_page(pmd_page(*spmd))) {
+			page = pmd_page(*spmd);
+			smm = svma->vm_mm;
+			break;
+		}
+	}
+
+	if (page) {
+		/* Nobody is charged for the pages once it is shared */
+		pte_table_charge(page, smm, 0);
+		get_page(page);
+		spin_lock(&mm->page_table_lock);
+		if (!pmd_present(*pmd)) {
+			mm->nr_ptes++;
+			pmd_populate(mm, pmd, page);
+			inc_zone_page_state(page, NR_PAGETABLE_SAVED);
+			count_vm_event(PGTABLE_SHARE);
+			page = NULL;
+		}
+		spin_unlock(&mm->page_table_lock);
+		if (page) {
+			put_page(page);
+			if (page_count(page) == 1)
+				pte_table_charge(page, smm, 1);
+		}
+		spin_unlock(&mapping->i_mmap_lock);
+		return 0;
+	}
+	spin_unlock(&mapping->i_mmap_lock);
+
+	new = pte_alloc_one(mm, address);
+	if (!new)
+		return -ENOMEM;
+	new->index = PTE_TABLE_SHAREABLE | PTE_TABLE_CHARGED;
+
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&mm->page_table_lock);
+	if (!pmd_present(*pmd)) {
+		mm->nr_ptes++;
+		pmd_populate(mm, pmd, new);
+		new = NULL;
+	}
+	spin_unlock(&mm->page_table_lock);
+	if (new)
+		pte_free(mm, new);
+	return 0;
+}
+
+/*
+ * Let the child map the parent's shareable pte pages, instead of
+ * faulting its own back in one by one.  Both mmap_sems are held for
+ * write, so the parent's pte pages stay put.
+ */
+static void share_pte_tables(struct mm_struct *dst_mm,
+			     struct mm_struct *src_mm,
+			     struct vm_area_struct *vma)
+{
+	unsigned long addr = (vma->vm_start + PMD_SIZE - 1) & PMD_MASK;
+	struct address_space *mapping;
+	pmd_t *src_pmd, *dst_pmd;
+	struct page *page;
+	pud_t *dst_pud;
+
+	if (!vma_pte_table_shareable(vma))
+		return;
+	mapping = vma->vm_file->f_mapping;
+
+	for (; addr && addr + PMD_SIZE <= vma->vm_end; addr += PMD_SIZE) {
+		src_pmd = pte_table_pmd(src_mm, addr);
+		if (!src_pmd || !pte_table_shareable_page(pmd_page(*src_pmd)))
+			continue;
+		dst_pud = pud_alloc(dst_mm, pgd_offset(dst_mm, addr), addr);
+		if (!dst_pud)
+			return;
+		dst_pmd = pmd_alloc(dst_mm, dst_pud, addr);
+		if (!dst_pmd)
+			return;
+
+		page = pmd_page(*src_pmd);
+		spin_lock(&mapping->i_mmap_lock);
+		pte_table_charge(page, src_mm, 0);
+		get_page(page);
+		spin_lock(&dst_mm->page_table_lock);
+		if (pmd_none(*dst_pmd)) {
+			dst_mm->nr_ptes++;
+			pmd_populate(dst_mm, dst_pmd, page);
+			inc_zone_page_state(page, NR_PAGETABLE_SAVED);
+			count_vm_event(PGTABLE_SHARE);
+			page = NULL;
+		}
+		spin_unlock(&dst_mm->page_table_lock);
+		if (page) {
+			put_page(page);
+			if (page_count(page) == 1)
+				pte_table_charge(page, src_mm, 1);
+		}
+		spin_unlock(&mapping->i_mmap_lock);
+	}
+}
+
+/*
+ * Drop the last reference to a pte page being freed, or just this mm's
+ * one if others still map it.  Returns 1 in the latter case.
+ */
+static int pte_table_put(struct page *page)
+{
+	if (!pte_table_shareable_page(page) ||
+	    !atomic_add_unless(&page->_count, -1, 1))
+		return 0;
+	dec_zone_page_state(page, NR_PAGETABLE_SAVED);
+	count_vm_event(PGTABLE_UNSHARE);
+	return 1;
+}
+
+/**
+ * pte_table_make_private - give an mm its own pte page before a COW
+ * @vma: the vma faulting
+ * @pmd: the pmd mapping @address
+ * @address: the faulting address
+ *
+ * An anonymous page must never go into a pte page that other mms map
+ * as well, they would all see it.  So before a COW in a shareable range
+ * (a vma normally is not shareable when it can COW, but it may have
+ * been when its pte pages were set up), replace a shared pte page with
+ * an empty private one, faults repopulate it.  A shareable pte page that
+ * only this mm maps just stops being shareable.  The caller then gives
+ * the vma an anon_vma, which keeps it from being shared again.
+ *
+ * Called with mmap_sem held for read and no pte lock.  Returns -ENOMEM
+ * if a new pte page could not be allocated, 0 otherwise.
+ */
+int pte_table_make_private(struct vm_area_struct *vma, pmd_t *pmd,
+			   unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping;
+	unsigned long base = address & PMD_MASK;
+	struct page *page;
+	pgtable_t new;
+
+	if (!pmd_present(*pmd) || !pte_table_shareable_page(pmd_page(*pmd)))
+		return 0;
+	mapping = vma->vm_file->f_mapping;
+
+	new = pte_alloc_one(mm, address);
+	if (!new)
+		return -ENOMEM;
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&mapping->i_mmap_lock);
+	page = pmd_page(*pmd);
+	if (!pte_table_shareable_page(page)) {
+		/* Another thread of ours got here first */
+	} else if (page_count(page) == 1) {
+		pte_table_charge(page, mm, 1);
+		page->index = 0;
+	} else {
+		spin_lock(&mm->page_table_lock);
+		pmd_populate(mm, pmd, new);
+		spin_unlock(&mm->page_table_lock);
+		new = NULL;
+		flush_tlb_range(vma, base, base + PMD_SIZE);
+		pte_table_detach(vma, base, page);
+	}
+	spin_unlock(&mapping->i_mmap_lock);
+
+	if (new)
+		pte_free(mm, new);
+	return 0;
+}
+
+/**
+ * pte_table_flush_page - flush a pte cleared in a shared pte page
+ * @vma: the vma through which the pte was cleared and flushed
+ * @address: the address of the pte in @vma
+ * @pte: the pte
+ *
+ * The other mms mapping the pte page may have the pte in their TLBs:
+ * flush it on the cpus of each of them.  Called by rmap with the pte
+ * lock and i_mmap_lock held.
+ */
+void pte_table_flush_page(struct vm_area_struct *vma, unsigned long address,
+			  pte_t *pte)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pgoff_t idx = ((address - vma->vm_start) >> PAGE_SHIFT) +
+			vma->vm_pgoff;
+	struct page *page = virt_to_page(pte);
+	struct prio_tree_iter iter;
+	struct vm_area_struct *svma;
+	unsigned long saddr;
+	pmd_t *spmd;
+
+	if (!pte_table_shared(page))
+		return;
+
+	vma_prio_tree_foreach(svma, &iter, &mapping->i_mmap, idx, idx) {
+		if (svma == vma)
+			continue;
+		saddr = pte_table_match(svma, vma, address, idx);
+		if (!saddr)
+			continue;
+		spmd = pte_table_pmd(svma->vm_mm, saddr);
+		if (spmd && pmd_page(*spmd) == page)
+			flush_tlb_page(svma, saddr);
+	}
+}
+
+/*
+ * Ptes zapped in a pte page that other mms map as well (on truncation,
+ * or when one attached to it meanwhile) may still be cached in their
+ * TLBs, and we don't know which mms they are: flush all TLBs before the
+ * pages can be freed.
+ */
+static void pte_table_flush_sharers(pmd_t *pmd)
+{
+	smp_mb();
+	if (pte_table_shared(pmd_page(*pmd)))
+		flush_tlb_all();
+}
+
+/**
+ * unshare_pte_tables - stop sharing the pte pages of a range
+ * @vma: the first vma of the range
+ * @start: start address of the range
+ * @end: end address of the range
+ *
+ * Clear the pmds which map pte pages that other mms map as well, so
+ * that the caller can unmap, move or change the protection of the ptes
+ * without affecting them.  The whole pmd range is dropped, later faults
+ * repopulate it.  Called with mmap_sem held for write.
+ *
+ * Whether a pte page is shared is decided from the page alone: mprotect
+ * may already have given the vma flags that could never share, and the
+ * ptes mapped through it must still be kept from the other mms.
+ */
+void unshare_pte_tables(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping;
+	unsigned long addr, vend;
+	struct page *page;
+	int unshared = 0;
+	pmd_t *pmd;
+
+	for (; vma && vma->vm_start < end; vma = vma->vm_next) {
+		if (!vma->vm_file || is_vm_hugetlb_page(vma))
+			continue;
+		mapping = vma->vm_file->f_mapping;
+		addr = max(start, vma->vm_start) & PMD_MASK;
+		vend = min(end, vma->vm_end);
+		for (; addr && addr < vend; addr += PMD_SIZE) {
+			pmd = pte_table_pmd(mm, addr);
+			if (!pmd || !pte_table_shared(pmd_page(*pmd)))
+				continue;
+			spin_lock(&mapping->i_mmap_lock);
+			page = pmd_page(*pmd);
+			if (page_count(page) > 1) {
+				pmd_clear(pmd);
+				mm->nr_ptes--;
+				pte_table_detach(vma, addr, page);
+				unshared = 1;
+			}
+			spin_unlock(&mapping->i_mmap_lock);
+		}
+	}
+	if (unshared)
+		flush_tlb_mm(mm);
+}
+#else
+static inline int pte_table_shareable(struct vm_area_struct *vma,
+				      unsigned long addr)
+{
+	return 0;
+}
+
+static inline int __pte_alloc_shared(struct mm_struct *mm,
+				     struct vm_area_struct *vma,
+				     pmd_t *pmd, unsigned long address)
+{
+	return 0;
+}
+
+static inline void share_pte_tables(struct mm_struct *dst_mm,
+				    struct mm_struct *src_mm,
+				    struct vm_area_struct *vma)
+{
+}
+
+static inline int pte_table_put(struct page *page)
+{
+	return 0;
+}
+
+static inline void pte_table_flush_sharers(pmd_t *pmd)
+{
+}
+#endif /* CONFIG_SHARED_PAGE_TABLES */
+
 /*
  * Note: this doesn't free the actual pages themselves. That
  * has been handled earlier when unmapping all the memory regions.
@@ -153,8 +653,12 @@ static void free_pte_range(struct mmu_gather *tlb, pmd_t *pmd,
 			   unsigned long addr)
 {
 	pgtable_t token = pmd_pgtable(*pmd);
+	struct page *page = pmd_page(*pmd);
+
 	pmd_clear(pmd);
-	pte_free_tlb(tlb, token, addr);
+	/* Still mapped by other mms if shared, see unshare_pte_tables() */
+	if (!pte_table_put(page))
+		pte_free_tlb(tlb, token, addr);
 	tlb->mm->nr_ptes--;
 }
 
@@ -749,8 +1253,10 @@ int copy_page_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	 * efficient than faulting.
 	 */
 	if (!(vma->vm_flags & (VM_HUGETLB|VM_NONLINEAR|VM_PFNMAP|VM_INSERTPAGE))) {
-		if (!vma->anon_vma)
+		if (!vma->anon_vma) {
+			share_pte_tables(dst_mm, src_mm, vma);
 			return 0;
+		}
 	}
 
 	if (is_vm_hugetlb_page(vma))
@@ -805,8 +1311,10 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	spinlock_t *ptl;
 	int file_rss = 0;
 	int anon_rss = 0;
+	int uncharged;
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	uncharged = pte_in_uncharged_table(pte);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -880,6 +1388,8 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 		pte_clear_not_present_full(mm, addr, pte, tlb->fullmm);
 	} while (pte++, addr += PAGE_SIZE, (addr != end && *zap_work > 0));
 
+	if (uncharged)
+		file_rss = 0;
 	add_mm_rss(mm, file_rss, anon_rss);
 	arch_leave_lazy_mmu_mode();
 	pte_unmap_unlock(pte - 1, ptl);
@@ -904,6 +1414,7 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		}
 		next = zap_pte_range(tlb, vma, pmd, addr, next,
 						zap_work, details);
+		pte_table_flush_sharers(pmd);
 	} while (pmd++, addr = next, (addr != end && *zap_work > 0));
 
 	return addr;
@@ -2123,6 +2634,8 @@ reuse:
 gotten:
 	pte_unmap_unlock(page_table, ptl);
 
+	if (unlikely(pte_table_make_private(vma, pmd, address)))
+		goto oom;
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
 
@@ -2790,7 +3303,8 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (flags & FAULT_FLAG_WRITE) {
 		if (!(vma->vm_flags & VM_SHARED)) {
 			anon = 1;
-			if (unlikely(anon_vma_prepare(vma))) {
+			if (unlikely(pte_table_make_private(vma, pmd, address) ||
+				     anon_vma_prepare(vma))) {
 				ret = VM_FAULT_OOM;
 				goto out;
 			}
@@ -2868,7 +3382,8 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			inc_mm_counter(mm, anon_rss);
 			page_add_new_anon_rmap(page, vma, address);
 		} else {
-			inc_mm_counter(mm, file_rss);
+			if (!pte_in_uncharged_table(page_table))
+				inc_mm_counter(mm, file_rss);
 			page_add_file_rmap(page);
 			if (flags & FAULT_FLAG_WRITE) {
 				dirty_page = page;
@@ -2965,6 +3480,62 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault: the scanner made this pte inaccessible to find out
+ * who is using the page.  Restore the pte, tell the scheduler which node
+ * the memory lives on, and move the page to the faulting node if the
+ * memory policy says it is misplaced.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *pte, pmd_t *pmd, pte_t entry)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	int page_nid, target_nid;
+	int migrated = 0;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*pte, entry))) {
+		pte_unmap_unlock(pte, ptl);
+		return 0;
+	}
+
+	/* The hardware never cached the PROT_NONE pte, no flush needed */
+	entry = pte_mkyoung(pte_modify(entry, vma->vm_page_prot));
+	set_pte_at(mm, address, pte, entry);
+	update_mmu_cache(vma, address, entry);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(pte, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(pte, ptl);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	page_nid = page_to_nid(page);
+	if (page_nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	target_nid = mpol_misplaced(page, vma, address);
+	if (target_nid == -1) {
+		put_page(page);
+		goto out;
+	}
+
+	/* Consumes our reference, so that the page can be moved at all */
+	migrated = migrate_misplaced_page(page, target_nid);
+	if (migrated)
+		page_nid = target_nid;
+out:
+	task_numa_fault(page_nid, 1, migrated);
+	return 0;
+}
+#endif
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3003,6 +3574,12 @@ static inline int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* A PROT_NONE pte in an inaccessible vma is not a hinting fault */
+	if (pte_numa(entry) && (vma->vm_flags & (VM_READ|VM_WRITE|VM_EXEC)))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+#endif
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3046,6 +3623,14 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	count_vm_event(PGFAULT);
 
+	/*
+	 * The oom reaper has torn down the anonymous memory of this mm:
+	 * a refault would silently hand out a zeroed page instead of the
+	 * lost data, e.g. to a write() of the dying task.  Fail it.
+	 */
+	if (unlikely(test_bit(MMF_OOM_REAPED, &mm->flags)))
+		return VM_FAULT_SIGBUS;
+
 	if (unlikely(is_vm_hugetlb_page(vma)))
 		return hugetlb_fault(mm, vma, address, flags);
 
@@ -3056,6 +3641,9 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
+	if (pmd_none(*pmd) && pte_table_shareable(vma, address) &&
+	    __pte_alloc_shared(mm, vma, pmd, address))
+		return VM_FAULT_OOM;
 	pte = pte_alloc_map(mm, pmd, address);
 	if (!pte)
 		return VM_FAULT_OOM;
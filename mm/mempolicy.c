@@ -1670,6 +1670,67 @@ struct page *alloc_pages_current(gfp_t gfp, unsigned order)
 }
 EXPORT_SYMBOL(alloc_pages_current);
 
+#ifdef CONFIG_NUMA_BALANCING
+/**
+ * change_prot_numa - prepare a range for NUMA hinting faults
+ * @vma: the vma the range belongs to
+ * @addr: start of the range
+ * @end: end of the range
+ *
+ * Make the present ptes in the range PROT_NONE, so that the next access
+ * takes a fault that tells us which node the page is used from.  The
+ * fault restores the protection of @vma.  Returns the number of pages
+ * in the range.
+ *
+ * Called with mmap_sem held for read.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			       unsigned long addr, unsigned long end)
+{
+	unsigned long nr_pages = (end - addr) >> PAGE_SHIFT;
+
+	change_protection(vma, addr, end, PAGE_NONE, 0, 1);
+	count_vm_events(NUMA_PTE_UPDATES, nr_pages);
+	return nr_pages;
+}
+
+/**
+ * mpol_misplaced - check whether a page is on the node it should be on
+ * @page: page that took a NUMA hinting fault
+ * @vma: vma mapping @page
+ * @addr: faulting address
+ *
+ * Only local allocation and preferred node policies say where a page
+ * should be; explicit interleave and bind placements are left alone.
+ *
+ * Returns the node @page should be migrated to, or -1 if it is fine where
+ * it is.  Called with mmap_sem held for read.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int polnid = -1;
+	int ret = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol->mode != MPOL_PREFERRED)
+		goto out;
+
+	if (pol->flags & MPOL_F_LOCAL)
+		polnid = numa_node_id();
+	else
+		polnid = pol->v.preferred_node;
+
+	if (polnid != curnid && node_isset(polnid, cpuset_current_mems_allowed))
+		ret = polnid;
+out:
+	mpol_cond_put(pol);
+	return ret;
+}
+#endif
+
 /*
  * If mpol_dup() sees current->cpuset == cpuset_being_rebound, then it
  * rebinds the mempolicy its copying by calling mpol_rebind_policy()
@@ -31,6 +31,7 @@
 #include <linux/security.h>
 #include <linux/memcontrol.h>
 #include <linux/syscalls.h>
+#include <linux/ksm.h>
 
 #include "internal.h"
 
@@ -1159,4 +1160,76 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	}
  	return err;
 }
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Don't migrate onto a node that is short of memory itself: that would
+ * only push its own pages out, if the allocation succeeded at all.
+ */
+static int migrate_balanced_node(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone_watermark_ok(zone, 0, high_wmark_pages(zone), 0, 0))
+			return 1;
+	}
+	return 0;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data, int **result)
+{
+	int nid = (int)data;
+
+	return alloc_pages_exact_node(nid, GFP_HIGHUSER_MOVABLE |
+				      GFP_THISNODE | __GFP_NOMEMALLOC, 0);
+}
+
+/**
+ * migrate_misplaced_page - move a page to the node it is used from
+ * @page: page that took a NUMA hinting fault, the caller holds a reference
+ * @node: destination node
+ *
+ * Only pages mapped by a single process are moved: shared library text
+ * and other shared pages would otherwise bounce between the nodes of
+ * their users.  The caller's reference is dropped in all cases.  Returns 1
+ * if the page was migrated, 0 otherwise.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+
+	if (page_mapcount(page) != 1 || PageKsm(page))
+		goto out;
+	if (!migrate_balanced_node(node))
+		goto out;
+	if (isolate_lru_page(page))
+		goto out;
+
+	/*
+	 * Isolation holds its own reference.  Drop the caller's now: the
+	 * mapping can only be moved once the page count is back to what
+	 * the mappers and the isolation account for.
+	 */
+	put_page(page);
+
+	/* migrate_pages() puts the page back on the lru if it fails */
+	list_add(&page->lru, &migratepages);
+	if (migrate_pages(&migratepages, alloc_misplaced_dst_page, node))
+		return 0;
+
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif
 #endif
@@ -138,6 +138,8 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 
 	old_end = old_addr + len;
 	flush_cache_range(vma, old_addr, old_end);
+	/* Moving ptes out of a shared pte page would move them for all */
+	unshare_pte_tables(vma, old_addr, old_end);
 
 	for (; old_addr < old_end; old_addr += extent, new_addr += extent) {
 		cond_resched();
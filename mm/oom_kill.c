@@ -27,6 +27,11 @@
 #include <linux/notifier.h>
 #include <linux/memcontrol.h>
 #include <linux/security.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/oom.h>
 
 int sysctl_panic_on_oom;
 int sysctl_oom_kill_allocating_task;
@@ -337,6 +342,195 @@ static void dump_tasks(const struct mem_cgroup *mem)
 	} while_each_thread(g, p);
 }
 
+#ifdef CONFIG_MMU
+/*
+ * The oom reaper.
+ *
+ * An oom victim only gives its memory back once it gets to exit_mmap(),
+ * which can take a long time when it is blocked on a lock or in
+ * uninterruptible I/O, while the rest of the system keeps thrashing.
+ * So as soon as a victim is chosen, the reaper kthread tears down its
+ * private anonymous memory, which is usually the bulk of what it owns
+ * and which nobody else can need once the victim is dead.  Like
+ * MADV_DONTNEED, this only needs mmap_sem for read.
+ */
+#define OOM_REAP_QUEUE_SIZE	16
+#define OOM_REAP_RETRIES	10	/* mmap_sem attempts, HZ/10 apart */
+
+struct oom_reap_request {
+	struct mm_struct *mm;		/* pinned with mm_count */
+	pid_t pid;
+	ktime_t killed;
+};
+
+static struct oom_reap_request oom_reap_queue[OOM_REAP_QUEUE_SIZE];
+static unsigned int oom_reap_head, oom_reap_tail;
+static DEFINE_SPINLOCK(oom_reap_lock);
+static DECLARE_WAIT_QUEUE_HEAD(oom_reaper_wait);
+static struct task_struct *oom_reaper_th;
+
+/*
+ * Private mappings with an anon_vma hold anonymous pages.  Mlocked and
+ * hugetlb memory is left to exit_mmap(), which knows how to undo it.
+ */
+static int oom_reapable_vma(struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & (VM_SHARED | VM_LOCKED | VM_HUGETLB |
+			     VM_PFNMAP | VM_IO | VM_MIXEDMAP))
+		return 0;
+	return vma->anon_vma != NULL;
+}
+
+static void oom_reap_mm(struct oom_reap_request *req)
+{
+	struct mm_struct *mm = req->mm;
+	struct vm_area_struct *vma;
+	unsigned long anon_rss, freed;
+	int attempts = 0;
+
+	/* Nothing left to do if the victim got through exit_mmap() already */
+	if (!atomic_inc_not_zero(&mm->mm_users)) {
+		trace_skip_task_reaping(req->pid, "exited");
+		goto out;
+	}
+
+	/*
+	 * The victim may be stuck while holding mmap_sem for write, and
+	 * then a queued down_read() would get us stuck behind it as well.
+	 */
+	while (!down_read_trylock(&mm->mmap_sem)) {
+		if (++attempts > OOM_REAP_RETRIES) {
+			trace_skip_task_reaping(req->pid, "mmap_sem");
+			printk(KERN_INFO "oom_reaper: unable to reap process %d\n",
+			       req->pid);
+			goto out_put;
+		}
+		schedule_timeout_interruptible(HZ / 10);
+	}
+
+	trace_start_task_reaping(req->pid,
+				 ktime_us_delta(ktime_get(), req->killed));
+	anon_rss = get_mm_counter(mm, anon_rss);
+
+	/* Refaults after this point fail, see handle_mm_fault() */
+	set_bit(MMF_OOM_REAPED, &mm->flags);
+	for (vma = mm->mmap; vma; vma = vma->vm_next)
+		if (oom_reapable_vma(vma))
+			zap_page_range(vma, vma->vm_start,
+				       vma->vm_end - vma->vm_start, NULL);
+	freed = anon_rss - min(anon_rss, get_mm_counter(mm, anon_rss));
+	up_read(&mm->mmap_sem);
+
+	trace_finish_task_reaping(req->pid, freed,
+				  ktime_us_delta(ktime_get(), req->killed));
+	printk(KERN_INFO "oom_reaper: reaped process %d, freed %lukB\n",
+	       req->pid, freed << (PAGE_SHIFT - 10));
+out_put:
+	/* This may be the last user, in which case we do the exit_mmap() */
+	mmput(mm);
+out:
+	mmdrop(mm);
+}
+
+static int oom_reaper(void *unused)
+{
+	struct oom_reap_request req;
+
+	for (;;) {
+		wait_event_interruptible(oom_reaper_wait,
+					 oom_reap_head != oom_reap_tail);
+
+		spin_lock(&oom_reap_lock);
+		if (oom_reap_head == oom_reap_tail) {
+			spin_unlock(&oom_reap_lock);
+			continue;
+		}
+		req = oom_reap_queue[oom_reap_tail % OOM_REAP_QUEUE_SIZE];
+		oom_reap_tail++;
+		spin_unlock(&oom_reap_lock);
+
+		oom_reap_mm(&req);
+	}
+	return 0;
+}
+
+/*
+ * Queue the mm of a freshly killed task for the reaper.  The mm must not
+ * be reaped while somebody outside the victim's thread group, who is not
+ * dying as well, still uses it: vfork() children, CLONE_VM processes and
+ * kernel threads borrowing it with use_mm().
+ *
+ * Call with tasklist_lock held for read.
+ */
+static void queue_oom_reaper(struct task_struct *p)
+{
+	struct oom_reap_request *req;
+	struct task_struct *q;
+	struct mm_struct *mm;
+	unsigned int i;
+
+	if (!oom_reaper_th)
+		return;
+
+	task_lock(p);
+	mm = p->mm;
+	if (!mm || test_bit(MMF_OOM_REAPED, &mm->flags)) {
+		task_unlock(p);
+		return;
+	}
+	atomic_inc(&mm->mm_count);
+	task_unlock(p);
+
+	for_each_process(q) {
+		if (q->mm != mm || same_thread_group(q, p))
+			continue;
+		if (!fatal_signal_pending(q)) {
+			trace_skip_task_reaping(task_pid_nr(p), "shared mm");
+			goto drop;
+		}
+	}
+
+	spin_lock(&oom_reap_lock);
+	for (i = oom_reap_tail; i != oom_reap_head; i++)
+		if (oom_reap_queue[i % OOM_REAP_QUEUE_SIZE].mm == mm)
+			goto unlock_drop;
+	if (oom_reap_head - oom_reap_tail >= OOM_REAP_QUEUE_SIZE) {
+		trace_skip_task_reaping(task_pid_nr(p), "queue full");
+		goto unlock_drop;
+	}
+	req = &oom_reap_queue[oom_reap_head % OOM_REAP_QUEUE_SIZE];
+	req->mm = mm;
+	req->pid = task_pid_nr(p);
+	req->killed = ktime_get();
+	oom_reap_head++;
+	spin_unlock(&oom_reap_lock);
+
+	wake_up(&oom_reaper_wait);
+	return;
+
+unlock_drop:
+	spin_unlock(&oom_reap_lock);
+drop:
+	mmdrop(mm);
+}
+
+static int __init oom_reaper_init(void)
+{
+	oom_reaper_th = kthread_run(oom_reaper, NULL, "oom_reaper");
+	if (IS_ERR(oom_reaper_th)) {
+		printk(KERN_ERR "oom_reaper: unable to start, error %ld\n",
+		       PTR_ERR(oom_reaper_th));
+		oom_reaper_th = NULL;
+	}
+	return 0;
+}
+subsys_initcall(oom_reaper_init);
+#else
+static inline void queue_oom_reaper(struct task_struct *p)
+{
+}
+#endif /* CONFIG_MMU */
+
 /*
  * Send SIGKILL to the selected  process irrespective of  CAP_SYS_RAW_IO
  * flag though it's unlikely that  we select a process with CAP_SYS_RAW_IO
@@ -367,8 +561,10 @@ static void __oom_kill_task(struct task_struct *p, int verbose)
 	 */
 	p->rt.time_slice = HZ;
 	set_tsk_thread_flag(p, TIF_MEMDIE);
+	trace_mark_victim(task_pid_nr(p));
 
 	force_sig(SIGKILL, p);
+	queue_oom_reaper(p);
 }
 
 static int oom_kill_task(struct task_struct *p)
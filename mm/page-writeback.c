@@ -34,6 +34,8 @@
 #include <linux/syscalls.h>
 #include <linux/buffer_head.h>
 #include <linux/pagevec.h>
+#define CREATE_TRACE_POINTS
+#include <trace/events/writeback.h>
 
 /*
  * After a CPU has dirtied this many pages, balance_dirty_pages_ratelimited
@@ -42,18 +44,14 @@
 static long ratelimit_pages = 32;
 
 /*
- * When balance_dirty_pages decides that the caller needs to perform some
- * non-background writeback, this is how many pages it will attempt to write.
- * It should be somewhat larger than dirtied pages to ensure that reasonably
- * large amounts of I/O are submitted.
+ * Sleep at most 200ms at a time in balance_dirty_pages().
  */
-static inline long sync_writeback_pages(unsigned long dirtied)
-{
-	if (dirtied < ratelimit_pages)
-		dirtied = ratelimit_pages;
+#define MAX_PAUSE		max(HZ/5, 1)
 
-	return dirtied + dirtied / 2;
-}
+/*
+ * Estimate write bandwidth at 200ms intervals.
+ */
+#define BANDWIDTH_INTERVAL	max(HZ/5, 1)
 
 /* The following parameters are exported via /proc/sys/vm */
 
@@ -218,6 +216,7 @@ int dirty_bytes_handler(struct ctl_table *table, int write,
  */
 static inline void __bdi_writeout_inc(struct backing_dev_info *bdi)
 {
+	__inc_bdi_stat(bdi, BDI_WRITTEN);
 	__prop_inc_percpu_max(&vm_completions, &bdi->completions,
 			      bdi->max_prop_frac);
 }
@@ -473,74 +472,172 @@ get_dirty_limits(unsigned long *pbackground, unsigned long *pdirty,
 	}
 }
 
+static void __bdi_update_write_bandwidth(struct backing_dev_info *bdi,
+					 unsigned long elapsed,
+					 unsigned long written)
+{
+	const unsigned long period = roundup_pow_of_two(3 * HZ);
+	unsigned long avg = bdi->avg_write_bandwidth;
+	unsigned long old = bdi->write_bandwidth;
+	u64 bw;
+
+	/*
+	 * bw = written * HZ / elapsed
+	 *
+	 *                   bw * elapsed + write_bandwidth * (period - elapsed)
+	 * write_bandwidth = ---------------------------------------------------
+	 *                                          period
+	 */
+	bw = written - bdi->written_stamp;
+	bw *= HZ;
+	if (unlikely(elapsed > period)) {
+		do_div(bw, elapsed);
+		avg = bw;
+		goto out;
+	}
+	bw += (u64)bdi->write_bandwidth * (period - elapsed);
+	bw >>= ilog2(period);
+
+	/*
+	 * One more level of smoothing, for filtering out sudden spikes:
+	 * only follow write_bandwidth when it is not moving back towards
+	 * the average.
+	 */
+	if (avg > old && old >= (unsigned long)bw)
+		avg -= (avg - old) >> 3;
+
+	if (avg < old && old <= (unsigned long)bw)
+		avg += (old - avg) >> 3;
+
+out:
+	bdi->write_bandwidth = bw;
+	bdi->avg_write_bandwidth = avg;
+}
+
+/**
+ * bdi_update_bandwidth - update the write bandwidth estimation of a bdi
+ * @bdi: the backing device
+ * @start_time: when the caller started writing or dirtying
+ *
+ * Called by throttled dirtiers and by the flusher thread while it is
+ * writing.  The estimate is updated at most once per BANDWIDTH_INTERVAL,
+ * from the number of pages whose writeback completed since the last
+ * update.
+ */
+void bdi_update_bandwidth(struct backing_dev_info *bdi,
+			  unsigned long start_time)
+{
+	unsigned long now = jiffies;
+	unsigned long elapsed = now - bdi->bw_time_stamp;
+	unsigned long written;
+
+	if (elapsed < BANDWIDTH_INTERVAL)
+		return;
+
+	/* Someone else is doing the update */
+	if (!spin_trylock(&bdi->bw_lock))
+		return;
+
+	elapsed = now - bdi->bw_time_stamp;
+	if (elapsed < BANDWIDTH_INTERVAL)
+		goto unlock;
+
+	written = percpu_counter_read_positive(&bdi->bdi_stat[BDI_WRITTEN]);
+
+	/*
+	 * Skip quiet periods when the disk bandwidth is under-utilized:
+	 * if nothing was updated for a second and the caller only became
+	 * active after that, the elapsed time says nothing about the disk.
+	 */
+	if (elapsed > HZ && time_before(bdi->bw_time_stamp, start_time))
+		goto snapshot;
+
+	__bdi_update_write_bandwidth(bdi, elapsed, written);
+	trace_bdi_dirty_bandwidth(bdi, written - bdi->written_stamp, elapsed);
+
+snapshot:
+	bdi->written_stamp = written;
+	bdi->bw_time_stamp = now;
+unlock:
+	spin_unlock(&bdi->bw_lock);
+}
+
+/*
+ * How long a task that just dirtied @pages_dirtied pages should sleep
+ * while its bdi is still below its dirty limit.
+ *
+ * The task is allowed to dirty at the bdi's write bandwidth when the bdi
+ * is 1/8 below its limit.  The closer the bdi gets to the limit, the lower
+ * the allowed rate, down to zero at bdi_thresh; below 7/8 of the limit
+ * tasks get to dirty faster than the disk writes.
+ */
+static unsigned long bdi_dirty_pause(struct backing_dev_info *bdi,
+				     unsigned long pages_dirtied,
+				     unsigned long bdi_dirty,
+				     unsigned long bdi_thresh)
+{
+	unsigned long pause;
+	u64 bw;
+
+	if (bdi_dirty >= bdi_thresh)
+		return MAX_PAUSE;
+
+	bw = bdi->avg_write_bandwidth;
+	bw *= bdi_thresh - bdi_dirty;
+	do_div(bw, bdi_thresh / 8 + 1);
+
+	pause = HZ * pages_dirtied / ((unsigned long)bw + 1);
+	return min_t(unsigned long, pause, MAX_PAUSE);
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
- * data.  It looks at the number of dirty pages in the machine and will force
- * the caller to perform writeback if the system is over `vm_dirty_ratio'.
- * If we're over `background_thresh' then the writeback threads are woken to
- * perform some writeout.
+ * data.  It looks at the number of dirty pages in the machine and will pause
+ * the caller, for a time derived from the write bandwidth of its bdi, if the
+ * system is getting close to `vm_dirty_ratio'.  The caller never writes back
+ * pages itself: if we're over `background_thresh' then the writeback threads
+ * are woken to perform some writeout, and they are the only ones submitting
+ * the IO.  This keeps the IO pattern sequential when many tasks are dirtying
+ * pages at the same time.
  */
 static void balance_dirty_pages(struct address_space *mapping,
-				unsigned long write_chunk)
+				unsigned long pages_dirtied)
 {
 	long nr_reclaimable, bdi_nr_reclaimable;
 	long nr_writeback, bdi_nr_writeback;
+	unsigned long nr_dirty, bdi_dirty;
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long pages_written = 0;
-	unsigned long pause = 1;
+	unsigned long start_time = jiffies;
+	unsigned long pause;
+	bool dirty_exceeded = false;
 
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
 
 	for (;;) {
-		struct writeback_control wbc = {
-			.bdi		= bdi,
-			.sync_mode	= WB_SYNC_NONE,
-			.older_than_this = NULL,
-			.nr_to_write	= write_chunk,
-			.range_cyclic	= 1,
-		};
-
 		get_dirty_limits(&background_thresh, &dirty_thresh,
 				&bdi_thresh, bdi);
 
+		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
+		 * Unstable writes are a feature of certain networked
+		 * filesystems (i.e. NFS) in which data may have been
+		 * written to the server's write cache, but has not yet
+		 * been flushed to permanent storage.
+		 */
 		nr_reclaimable = global_page_state(NR_FILE_DIRTY) +
 					global_page_state(NR_UNSTABLE_NFS);
 		nr_writeback = global_page_state(NR_WRITEBACK);
-
-		bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
-		bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
-
-		if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
-			break;
+		nr_dirty = nr_reclaimable + nr_writeback;
 
 		/*
 		 * Throttle it only when the background writeback cannot
 		 * catch-up. This avoids (excessively) small writeouts
 		 * when the bdi limits are ramping up.
 		 */
-		if (nr_reclaimable + nr_writeback <
-				(background_thresh + dirty_thresh) / 2)
+		if (nr_dirty <= (background_thresh + dirty_thresh) / 2) {
+			dirty_exceeded = false;
 			break;
-
-		if (!bdi->dirty_exceeded)
-			bdi->dirty_exceeded = 1;
-
-		/* Note: nr_reclaimable denotes nr_dirty + nr_unstable.
-		 * Unstable writes are a feature of certain networked
-		 * filesystems (i.e. NFS) in which data may have been
-		 * written to the server's write cache, but has not yet
-		 * been flushed to permanent storage.
-		 * Only move pages to writeback if this bdi is over its
-		 * threshold otherwise wait until the disk writes catch
-		 * up.
-		 */
-		if (bdi_nr_reclaimable > bdi_thresh) {
-			writeback_inodes_wbc(&wbc);
-			pages_written += write_chunk - wbc.nr_to_write;
-			get_dirty_limits(&background_thresh, &dirty_thresh,
-				       &bdi_thresh, bdi);
 		}
 
 		/*
@@ -556,30 +653,59 @@ static void balance_dirty_pages(struct address_space *mapping,
 		if (bdi_thresh < 2*bdi_stat_error(bdi)) {
 			bdi_nr_reclaimable = bdi_stat_sum(bdi, BDI_RECLAIMABLE);
 			bdi_nr_writeback = bdi_stat_sum(bdi, BDI_WRITEBACK);
-		} else if (bdi_nr_reclaimable) {
+		} else {
 			bdi_nr_reclaimable = bdi_stat(bdi, BDI_RECLAIMABLE);
 			bdi_nr_writeback = bdi_stat(bdi, BDI_WRITEBACK);
 		}
+		bdi_dirty = bdi_nr_reclaimable + bdi_nr_writeback;
+
+		dirty_exceeded = bdi_dirty > bdi_thresh ||
+				 nr_dirty > dirty_thresh;
+		if (dirty_exceeded && !bdi->dirty_exceeded)
+			bdi->dirty_exceeded = 1;
+
+		/*
+		 * The flusher thread does all the writeout; make sure it
+		 * is working while we wait.  In laptop mode, leave the
+		 * disk alone until we hit the hard limit.
+		 */
+		if (dirty_exceeded || !laptop_mode)
+			bdi_start_background_writeback(bdi);
 
-		if (bdi_nr_reclaimable + bdi_nr_writeback <= bdi_thresh)
+		bdi_update_bandwidth(bdi, start_time);
+
+		if (dirty_exceeded)
+			pause = MAX_PAUSE;
+		else
+			pause = bdi_dirty_pause(bdi, pages_dirtied,
+						bdi_dirty, bdi_thresh);
+
+		trace_balance_dirty_pages(bdi, dirty_thresh, nr_dirty,
+					  bdi_thresh, bdi_dirty,
+					  pages_dirtied, pause);
+		if (!pause)
 			break;
-		if (pages_written >= write_chunk)
-			break;		/* We've done our duty */
 
-		__set_current_state(TASK_INTERRUPTIBLE);
+		__set_current_state(TASK_KILLABLE);
 		io_schedule_timeout(pause);
 
+		/* Statistics only, races are harmless */
+		bdi->dirty_pauses++;
+		bdi->dirty_paused += pause;
+		bdi->last_pause = pause;
+
 		/*
-		 * Increase the delay for each loop, up to our previous
-		 * default of taking a 100ms nap.
+		 * Below the limits a single pause per call is enough to
+		 * keep the task at the rate the bdi can sustain.  Over
+		 * them, keep waiting until the flusher catches up.
 		 */
-		pause <<= 1;
-		if (pause > HZ / 10)
-			pause = HZ / 10;
+		if (!dirty_exceeded)
+			break;
+		if (fatal_signal_pending(current))
+			break;
 	}
 
-	if (bdi_nr_reclaimable + bdi_nr_writeback < bdi_thresh &&
-			bdi->dirty_exceeded)
+	if (!dirty_exceeded && bdi->dirty_exceeded)
 		bdi->dirty_exceeded = 0;
 
 	if (writeback_in_progress(bdi))
@@ -593,11 +719,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 	 * In normal mode, we start background writeout at the lower
 	 * background_thresh, to keep the amount of dirty memory low.
 	 */
-	if ((laptop_mode && pages_written) ||
-	    (!laptop_mode && ((global_page_state(NR_FILE_DIRTY)
-			       + global_page_state(NR_UNSTABLE_NFS))
-					  > background_thresh)))
-		bdi_start_writeback(bdi, NULL, 0);
+	if (!laptop_mode && nr_reclaimable > background_thresh)
+		bdi_start_background_writeback(bdi);
 }
 
 void set_page_dirty_balance(struct page *page, int page_mkwrite)
@@ -629,11 +752,15 @@ static DEFINE_PER_CPU(unsigned long, bdp_ratelimits) = 0;
 void balance_dirty_pages_ratelimited_nr(struct address_space *mapping,
 					unsigned long nr_pages_dirtied)
 {
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
 	unsigned long ratelimit;
 	unsigned long *p;
 
+	if (!bdi_cap_account_dirty(bdi))
+		return;
+
 	ratelimit = ratelimit_pages;
-	if (mapping->backing_dev_info->dirty_exceeded)
+	if (bdi->dirty_exceeded)
 		ratelimit = 8;
 
 	/*
@@ -644,10 +771,10 @@ void balance_dirty_pages_ratelimited_nr(struct address_space *mapping,
 	p =  &__get_cpu_var(bdp_ratelimits);
 	*p += nr_pages_dirtied;
 	if (unlikely(*p >= ratelimit)) {
-		ratelimit = sync_writeback_pages(*p);
+		nr_pages_dirtied = *p;
 		*p = 0;
 		preempt_enable();
-		balance_dirty_pages(mapping, ratelimit);
+		balance_dirty_pages(mapping, nr_pages_dirtied);
 		return;
 	}
 	preempt_enable();
@@ -48,6 +48,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/kmemleak.h>
+#include <linux/kthread.h>
 #include <trace/events/kmem.h>
 
 #include <asm/tlbflush.h>
@@ -694,6 +695,7 @@ static int prep_new_page(struct page *page, int order, gfp_t gfp_flags)
 		struct page *p = page + i;
 		if (unlikely(check_new_page(p)))
 			return 1;
+		__reset_page_idle_age(p);
 	}
 
 	set_page_private(page, 0);
@@ -1845,8 +1847,12 @@ restart:
 	page = get_page_from_freelist(gfp_mask, nodemask, order, zonelist,
 			high_zoneidx, alloc_flags & ~ALLOC_NO_WATERMARKS,
 			preferred_zone, migratetype);
-	if (page)
+	if (page) {
+		/* Background reclaim kept up, no need to stall */
+		if (wait && !(p->flags & PF_MEMALLOC))
+			count_vm_event(ALLOCSTALL_AVOIDED);
 		goto got_pg;
+	}
 
 rebalance:
 	/* Allocate without watermarks if the context allows */
@@ -2940,6 +2946,60 @@ static void setup_zone_migrate_reserve(struct zone *zone)
 	}
 }
 
+static void __meminit __init_single_page(struct page *page, unsigned long pfn,
+					 unsigned long zone, int nid)
+{
+	set_page_links(page, zone, nid, pfn);
+	mminit_verify_page_links(page, zone, nid, pfn);
+	init_page_count(page);
+	reset_page_mapcount(page);
+	SetPageReserved(page);
+	INIT_LIST_HEAD(&page->lru);
+#ifdef WANT_PAGE_VIRTUAL
+	/* The shift won't overflow because ZONE_NORMAL is below 4G. */
+	/*if (!is_highmem_idx(zone))
+		set_page_address(page, __va(pfn << PAGE_SHIFT));*/
+#endif
+}
+
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/*
+ * Number of struct pages in the highest zone of each node that are
+ * initialised early; the kernel has to get by with these until the
+ * pgdatinit threads are done.
+ */
+#define DEFERRED_INIT_PAGES	(2UL << (30 - PAGE_SHIFT))
+
+/*
+ * Returns the pfn at which early initialisation of the memmap of a zone
+ * stops.  Only the highest zone of a node is deferred, so that the memory
+ * of the lower, address-constrained zones is available right away.  The
+ * boundary is MAX_ORDER aligned, so no buddy pair straddles it.
+ */
+static unsigned long __meminit deferred_init_start(int nid,
+		unsigned long start_pfn, unsigned long end_pfn)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	unsigned long pfn;
+
+	if (end_pfn < pgdat->node_start_pfn + pgdat->node_spanned_pages)
+		return end_pfn;
+
+	pfn = ALIGN(start_pfn + DEFERRED_INIT_PAGES, MAX_ORDER_NR_PAGES);
+	if (pfn >= end_pfn)
+		return end_pfn;
+
+	pgdat->first_deferred_pfn = pfn;
+	return pfn;
+}
+#else
+static inline unsigned long deferred_init_start(int nid,
+		unsigned long start_pfn, unsigned long end_pfn)
+{
+	return end_pfn;
+}
+#endif
+
 /*
  * Initially all pages are reserved - free ones are freed
  * up by free_all_bootmem() once the early boot process is
@@ -2957,6 +3017,9 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		highest_memmap_pfn = end_pfn - 1;
 
 	z = &NODE_DATA(nid)->node_zones[zone];
+	if (context == MEMMAP_EARLY)
+		end_pfn = deferred_init_start(nid, start_pfn, end_pfn);
+
 	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
 		/*
 		 * There can be holes in boot-time mem_map[]s
@@ -2970,11 +3033,7 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 				continue;
 		}
 		page = pfn_to_page(pfn);
-		set_page_links(page, zone, nid, pfn);
-		mminit_verify_page_links(page, zone, nid, pfn);
-		init_page_count(page);
-		reset_page_mapcount(page);
-		SetPageReserved(page);
+		__init_single_page(page, pfn, zone, nid);
 		/*
 		 * Mark the block movable so that blocks are reserved for
 		 * movable at startup. This will force kernel allocations
@@ -2993,13 +3052,6 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		    && (pfn < z->zone_start_pfn + z->spanned_pages)
 		    && !(pfn & (pageblock_nr_pages - 1)))
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-
-		INIT_LIST_HEAD(&page->lru);
-#ifdef WANT_PAGE_VIRTUAL
-		/* The shift won't overflow because ZONE_NORMAL is below 4G. */
-		/*if (!is_highmem_idx(zone))
-			set_page_address(page, __va(pfn << PAGE_SHIFT));*/
-#endif
 	}
 }
 
@@ -3926,6 +3978,9 @@ void __paginginit free_area_init_node(int nid, unsigned long *zones_size,
 
 	pgdat->node_id = nid;
 	pgdat->node_start_pfn = node_start_pfn;
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	pgdat->first_deferred_pfn = ULONG_MAX;
+#endif
 	calculate_node_totalpages(pgdat, zones_size, zholes_size);
 
 	//alloc_node_mem_map(pgdat);
@@ -4513,6 +4568,104 @@ void __init page_alloc_init(void)
 	hotcpu_notifier(page_alloc_cpu_notify, 0);
 }
 
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+static atomic_t pgdat_init_n_undone __initdata;
+static __initdata DECLARE_COMPLETION(pgdat_init_all_done_comp);
+static atomic_long_t pgdat_init_freed __initdata;
+
+static void __init pgdat_init_report_one_done(void)
+{
+	if (atomic_dec_and_test(&pgdat_init_n_undone))
+		complete(&pgdat_init_all_done_comp);
+}
+
+/*
+ * Initialise the struct pages memmap_init_zone() left out, and hand the
+ * free ones among them to the buddy allocator.
+ */
+static int __init deferred_init_memmap(void *data)
+{
+	pg_data_t *pgdat = data;
+	int nid = pgdat->node_id;
+	const struct cpumask *cpumask = cpumask_of_node(nid);
+	unsigned long start = jiffies;
+	unsigned long pfn, end_pfn, nr_pages;
+	struct zone *zone;
+	int zid;
+
+	/* Bind memory initialisation thread to a local node if possible */
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	for (zid = MAX_NR_ZONES - 1; zid >= 0; zid--) {
+		zone = pgdat->node_zones + zid;
+		if (zone->zone_start_pfn <= pgdat->first_deferred_pfn &&
+		    pgdat->first_deferred_pfn <
+				zone->zone_start_pfn + zone->spanned_pages)
+			break;
+	}
+	BUG_ON(zid < 0);
+
+	end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+	for (pfn = pgdat->first_deferred_pfn; pfn < end_pfn; pfn++) {
+		struct page *page;
+
+		if (!(pfn & (MAX_ORDER_NR_PAGES - 1)))
+			cond_resched();
+		if (!early_pfn_valid(pfn))
+			continue;
+		if (!early_pfn_in_nid(pfn, nid))
+			continue;
+
+		page = pfn_to_page(pfn);
+		__init_single_page(page, pfn, zid, nid);
+		if (!(pfn & (pageblock_nr_pages - 1)))
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+
+	nr_pages = free_all_bootmem_deferred(pgdat);
+	atomic_long_add(nr_pages, &pgdat_init_freed);
+
+	printk(KERN_INFO "node %d initialised, %lu pages in %ums\n", nid,
+	       nr_pages, jiffies_to_msecs(jiffies - start));
+
+	pgdat_init_report_one_done();
+	return 0;
+}
+
+/**
+ * page_alloc_init_late - finish the deferred memmap initialisation
+ *
+ * Starts a pgdatinit thread for every node with struct pages left to
+ * initialise, so that the nodes are done in parallel, and waits for all
+ * of them.  Called once the secondary cpus are up, before the initcalls.
+ */
+void __init page_alloc_init_late(void)
+{
+	struct task_struct *tsk;
+	int nid;
+
+	/* There will be num_node_state(N_HIGH_MEMORY) threads at most */
+	atomic_set(&pgdat_init_n_undone, 1);
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (pgdat->first_deferred_pfn == ULONG_MAX)
+			continue;
+
+		atomic_inc(&pgdat_init_n_undone);
+		tsk = kthread_run(deferred_init_memmap, pgdat,
+				  "pgdatinit%d", nid);
+		if (IS_ERR(tsk))
+			deferred_init_memmap(pgdat);
+	}
+	pgdat_init_report_one_done();
+	wait_for_completion(&pgdat_init_all_done_comp);
+
+	totalram_pages += atomic_long_read(&pgdat_init_freed);
+}
+#endif
+
 /*
  * calculate_totalreserve_pages - called when sysctl_lower_zone_reserve_ratio
  *	or min_free_kbytes changes.
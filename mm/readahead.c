@@ -170,7 +170,7 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
 		page = page_cache_alloc_cold(mapping);
@@ -248,6 +248,8 @@ unsigned long ra_submit(struct file_ra_state *ra,
 
 	actual = __do_page_cache_readahead(mapping, filp,
 					ra->start, ra->size, ra->async_size);
+	if (actual > 0)
+		__add_bdi_stat(mapping->backing_dev_info, BDI_RA_PAGES, actual);
 
 	return actual;
 }
@@ -327,7 +329,76 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * The maximum itself, ra->ra_pages, adapts to how well readahead works for
+ * the file.  Each time a stream reaches the readahead marker, the pages it
+ * read since the previous marker are counted as hits; those past the marker
+ * only count once it gets to the next one.  A stream that reaches
+ * RA_GROW_WINDOWS markers in a row gets its maximum doubled, up to what
+ * POSIX_FADV_SEQUENTIAL would give it.  Pages that were read ahead and
+ * evicted before the stream got to them (thrashing) are counted as misses
+ * and halve the maximum, down to MIN_RA_PAGES.  Nothing else counts as a
+ * miss: a cache miss elsewhere in the file may just be another stream on
+ * the same file descriptor, whose reads must not shrink the window of this
+ * one.
+ */
+
+#define RA_GROW_WINDOWS	4
+#define MIN_RA_PAGES	((VM_MIN_READAHEAD * 1024) / PAGE_CACHE_SIZE)
+
+/*
+ * The stream got to the readahead marker: @nr_pages were used since it
+ * got to the previous one.  The pages of the window past the marker
+ * are left for the next call.
  */
+static void ra_account_hit(struct address_space *mapping,
+			   struct file_ra_state *ra, unsigned long nr_pages)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned int max = bdi->ra_pages * 2;
+
+	ra->hit += nr_pages;
+	__add_bdi_stat(bdi, BDI_RA_HIT, nr_pages);
+
+	if (++ra->seq_windows < RA_GROW_WINDOWS)
+		return;
+	ra->seq_windows = 0;
+	if (ra->ra_pages < max)
+		ra->ra_pages = min(ra->ra_pages * 2, max);
+}
+
+/*
+ * Count the pages of the window from @offset to @end that are no longer
+ * cached: readahead brought them in, so they were evicted unused.  An
+ * evicted page may have left a shadow entry behind.
+ */
+static unsigned long count_evicted_pages(struct address_space *mapping,
+					 pgoff_t offset, pgoff_t end)
+{
+	unsigned long nr = 0;
+	struct page *page;
+
+	rcu_read_lock();
+	for (; offset < end; offset++) {
+		page = radix_tree_lookup(&mapping->page_tree, offset);
+		if (!page || radix_tree_exceptional_entry(page))
+			nr++;
+	}
+	rcu_read_unlock();
+
+	return nr;
+}
+
+static void ra_account_miss(struct address_space *mapping,
+			    struct file_ra_state *ra, unsigned long nr_pages)
+{
+	ra->miss += nr_pages;
+	__add_bdi_stat(mapping->backing_dev_info, BDI_RA_MISS, nr_pages);
+
+	ra->seq_windows = 0;
+	if (ra->ra_pages > MIN_RA_PAGES)
+		ra->ra_pages = max_t(unsigned int, ra->ra_pages / 2, MIN_RA_PAGES);
+}
 
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
@@ -342,7 +413,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -405,6 +476,13 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		/*
+		 * The stream has read the window up to @offset, and all of
+		 * the previous window past its marker.
+		 */
+		ra_account_hit(mapping, ra, offset - ra->start + ra->unread);
+		ra->unread = ra->start + ra->size - offset;
+		max = max_sane_readahead(ra->ra_pages);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -421,12 +499,19 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
 			return 0;
 
+		/*
+		 * How much of the window before the marker was read is
+		 * unknown here, and ra->unread may be another stream's.
+		 */
+		ra_account_hit(mapping, ra, 0);
+		ra->unread = start - offset;
+		max = max_sane_readahead(ra->ra_pages);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -435,6 +520,19 @@ ondemand_readahead(struct address_space *mapping,
 		goto readit;
 	}
 
+	/*
+	 * A sequential cache miss inside the current window: the pages we
+	 * read ahead were evicted before the stream got to them.  Retry with
+	 * a smaller window.
+	 */
+	if (ra_has_index(ra, offset) &&
+	    offset - (ra->prev_pos >> PAGE_CACHE_SHIFT) <= 1UL) {
+		ra_account_miss(mapping, ra, count_evicted_pages(mapping,
+					offset, ra->start + ra->size));
+		max = max_sane_readahead(ra->ra_pages);
+		goto initial_readahead;
+	}
+
 	/*
 	 * oversize read
 	 */
@@ -461,6 +559,7 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra->unread = 0;
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
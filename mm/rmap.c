@@ -556,6 +556,7 @@ static int page_mkclean_one(struct page *page, struct vm_area_struct *vma)
 
 		flush_cache_page(vma, address, pte_pfn(*pte));
 		entry = ptep_clear_flush_notify(vma, address, pte);
+		pte_table_flush_page(vma, address, pte);
 		entry = pte_wrprotect(entry);
 		entry = pte_mkclean(entry);
 		set_pte_at(mm, address, pte, entry);
@@ -799,6 +800,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush_notify(vma, address, pte);
+	pte_table_flush_page(vma, address, pte);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
@@ -810,7 +812,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	if (PageHWPoison(page) && !(flags & TTU_IGNORE_HWPOISON)) {
 		if (PageAnon(page))
 			dec_mm_counter(mm, anon_rss);
-		else
+		else if (!pte_in_uncharged_table(pte))
 			dec_mm_counter(mm, file_rss);
 		set_pte_at(mm, address, pte,
 				swp_entry_to_pte(make_hwpoison_entry(page)));
@@ -846,7 +848,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		swp_entry_t entry;
 		entry = make_migration_entry(page, pte_write(pteval));
 		set_pte_at(mm, address, pte, swp_entry_to_pte(entry));
-	} else
+	} else if (!pte_in_uncharged_table(pte))
 		dec_mm_counter(mm, file_rss);
 
 
@@ -0,0 +1,169 @@
+/*
+ * mm/shared-pt-test.c
+ *
+ * Boot time test of shared pte pages.  Two mms map the same 2MB of a
+ * shmem file MAP_SHARED at the same address, and so fault through one
+ * pte page.  One of them then changes the protection of the range: it
+ * must get a pte page of its own, and the ptes of the other must stay
+ * as they were.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/sched.h>
+#include <linux/file.h>
+#include <linux/err.h>
+#include <linux/syscalls.h>
+#include <linux/mmu_context.h>
+#include <asm/uaccess.h>
+#include <asm/pgtable.h>
+
+#define TEST_ADDR	(1UL << 30)
+#define TEST_PAGES	(PMD_SIZE >> PAGE_SHIFT)
+
+static pmd_t * __init test_pmd(struct mm_struct *mm)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, TEST_ADDR);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, TEST_ADDR);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, TEST_ADDR);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/* Map the file into @mm and write to every page of it */
+static int __init test_map(struct mm_struct *mm, struct file *file)
+{
+	unsigned long addr, i;
+	int err = 0;
+
+	use_mm(mm);
+	down_write(&mm->mmap_sem);
+	addr = do_mmap(file, TEST_ADDR, PMD_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_FIXED, 0);
+	up_write(&mm->mmap_sem);
+	if (addr != TEST_ADDR) {
+		err = IS_ERR_VALUE(addr) ? addr : -EINVAL;
+		goto out;
+	}
+	for (i = 0; i < TEST_PAGES; i++) {
+		if (put_user(i, (unsigned long __user *)(addr + i * PAGE_SIZE))) {
+			err = -EFAULT;
+			break;
+		}
+	}
+out:
+	unuse_mm(mm);
+	return err;
+}
+
+/* Count the ptes of @mm that are no longer present and writable */
+static int __init test_count_changed(struct mm_struct *mm)
+{
+	spinlock_t *ptl;
+	pte_t *pte;
+	pmd_t *pmd;
+	int i, changed = 0;
+
+	down_read(&mm->mmap_sem);
+	pmd = test_pmd(mm);
+	if (!pmd) {
+		up_read(&mm->mmap_sem);
+		return TEST_PAGES;
+	}
+	pte = pte_offset_map_lock(mm, pmd, TEST_ADDR, &ptl);
+	for (i = 0; i < TEST_PAGES; i++)
+		if (!pte_present(pte[i]) || !pte_write(pte[i]))
+			changed++;
+	pte_unmap_unlock(pte, ptl);
+	up_read(&mm->mmap_sem);
+
+	return changed;
+}
+
+static int __init test_mprotect(unsigned long prot)
+{
+	struct mm_struct *mm[2] = { NULL, NULL };
+	struct file *file;
+	pmd_t *pmd0, *pmd1;
+	int i, changed, err;
+
+	file = shmem_file_setup("shared-pt-test", PMD_SIZE, 0);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	for (i = 0; i < 2; i++) {
+		err = -ENOMEM;
+		mm[i] = mm_alloc();
+		if (!mm[i])
+			goto out;
+		arch_pick_mmap_layout(mm[i]);
+		err = test_map(mm[i], file);
+		if (err)
+			goto out;
+	}
+
+	err = -EINVAL;
+	pmd0 = test_pmd(mm[0]);
+	pmd1 = test_pmd(mm[1]);
+	if (!pmd0 || !pmd1 || pmd_page(*pmd0) != pmd_page(*pmd1)) {
+		printk(KERN_ERR "shared-pt-test: pte page not shared\n");
+		goto out;
+	}
+
+	use_mm(mm[0]);
+	err = sys_mprotect(TEST_ADDR, PMD_SIZE, prot);
+	unuse_mm(mm[0]);
+	if (err)
+		goto out;
+
+	pmd0 = test_pmd(mm[0]);
+	if (pmd0 && pmd_page(*pmd0) == pmd_page(*pmd1)) {
+		printk(KERN_ERR "shared-pt-test: prot %lx: pte page still "
+		       "shared\n", prot);
+		err = -EINVAL;
+	}
+	changed = test_count_changed(mm[1]);
+	if (changed) {
+		printk(KERN_ERR "shared-pt-test: prot %lx: %d ptes of the "
+		       "other mm changed\n", prot, changed);
+		err = -EINVAL;
+	}
+out:
+	for (i = 0; i < 2; i++)
+		if (mm[i])
+			mmput(mm[i]);
+	fput(file);
+	return err;
+}
+
+static int __init shared_pt_test(void)
+{
+	static const unsigned long prots[] __initconst = {
+		PROT_READ, PROT_NONE,
+	};
+	int i, err, failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(prots); i++) {
+		err = test_mprotect(prots[i]);
+		if (err) {
+			printk(KERN_ERR "shared-pt-test: mprotect(%lx) test "
+			       "failed: %d\n", prots[i], err);
+			failed++;
+		}
+	}
+	if (!failed)
+		printk(KERN_INFO "shared-pt-test: passed\n");
+	return 0;
+}
+late_initcall(shared_pt_test);
@@ -0,0 +1,234 @@
+/*
+ *  linux/mm/swap_slots.c
+ *
+ *  Per-cpu caches of swap slots.
+ *
+ *  Allocating a swap slot and freeing it again both used to take a swap
+ *  device lock for every single page.  With many CPUs swapping at once
+ *  that lock is the bottleneck, and slots handed out one at a time to
+ *  whichever CPU asks next scatter the pages of one reclaimer across the
+ *  device.
+ *
+ *  Instead, each CPU keeps a small cache of slots.  An empty allocation
+ *  cache is refilled with a batch of slots taken sequentially from one
+ *  device's current cluster (see get_swap_pages()), so pages swapped out
+ *  together by one CPU are also written out together.  Freed slots stay
+ *  reserved in a per-cpu return cache and are given back to their
+ *  devices in batches (see swapcache_free_entries()).
+ *
+ *  A cached slot is marked SWAP_HAS_CACHE without any users or swap cache
+ *  page.  The caches are drained before a device is swapped off, and they
+ *  are deactivated when free swap space gets low, so that slots parked on
+ *  some CPUs cannot cause allocation failures on others.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/cpu.h>
+#include <linux/notifier.h>
+#include <linux/init.h>
+
+#define SWAP_SLOTS_CACHE_SIZE			64
+#define THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE	(5 * SWAP_SLOTS_CACHE_SIZE)
+#define THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE	(2 * SWAP_SLOTS_CACHE_SIZE)
+
+struct swap_slots_cache {
+	/* Slots ready to be handed out by get_swap_page() */
+	struct mutex	alloc_lock;	/* may sleep while refilling */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	int		nr;
+	int		cur;
+	/* Freed slots waiting to be returned to their devices */
+	spinlock_t	free_lock;
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+	int		n_ret;
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+static int swap_slot_cache_enabled;	/* set once the caches are set up */
+static int swap_slot_cache_active;	/* enough free swap to use them */
+
+#define SLOTS_CACHE	0x1
+#define SLOTS_CACHE_RET	0x2
+
+static void drain_slots_cache_cpu(unsigned int cpu, unsigned int type)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	if (type & SLOTS_CACHE) {
+		mutex_lock(&cache->alloc_lock);
+		swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+		cache->cur = 0;
+		cache->nr = 0;
+		mutex_unlock(&cache->alloc_lock);
+	}
+	if (type & SLOTS_CACHE_RET) {
+		spin_lock(&cache->free_lock);
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+		spin_unlock(&cache->free_lock);
+	}
+}
+
+static void __drain_swap_slots_cache(unsigned int type)
+{
+	unsigned int cpu;
+
+	/*
+	 * The caches are statically allocated for all possible cpus,
+	 * so no need to synchronize against cpu hotplug here: the cache
+	 * of a cpu going down is drained by the cpu notifier anyway.
+	 */
+	for_each_possible_cpu(cpu)
+		drain_slots_cache_cpu(cpu, type);
+}
+
+/**
+ * drain_swap_slots_caches - return all cached swap slots to their devices
+ *
+ * Called by swapoff once the device has stopped taking allocations, so
+ * that no slot of it is left parked in a cache.
+ */
+void drain_swap_slots_caches(void)
+{
+	if (!swap_slot_cache_enabled)
+		return;
+	mutex_lock(&swap_slots_cache_mutex);
+	__drain_swap_slots_cache(SLOTS_CACHE | SLOTS_CACHE_RET);
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static void deactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = 0;
+	__drain_swap_slots_cache(SLOTS_CACHE | SLOTS_CACHE_RET);
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static void reactivate_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_active = 1;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+/*
+ * Only use the caches while free swap space is plentiful compared to
+ * what all the cpus could hold in their caches.
+ */
+static int check_cache_active(void)
+{
+	long pages;
+
+	if (!swap_slot_cache_enabled)
+		return 0;
+
+	pages = get_nr_swap_pages();
+	if (!swap_slot_cache_active) {
+		if (pages > num_online_cpus() *
+		    THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE)
+			reactivate_swap_slots_cache();
+		goto out;
+	}
+
+	if (pages < num_online_cpus() * THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE)
+		deactivate_swap_slots_cache();
+out:
+	return swap_slot_cache_active;
+}
+
+/**
+ * free_swap_slot - give back a swap slot which has no users left
+ * @entry: the slot, reserved as SWAP_HAS_CACHE by swap_entry_free()
+ */
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+	struct swap_info_struct *si;
+
+	cache = &per_cpu(swp_slots, raw_smp_processor_id());
+	si = get_swap_info_struct(swp_type(entry));
+
+	spin_lock(&cache->free_lock);
+	/*
+	 * Slots of a device being swapped off must not be parked: swapoff
+	 * clears SWP_WRITEOK before it drains the caches under this lock.
+	 */
+	if (!swap_slot_cache_active || !(si->flags & SWP_WRITEOK)) {
+		spin_unlock(&cache->free_lock);
+		swapcache_free_entries(&entry, 1);
+		return;
+	}
+	if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+		/* Return the whole batch; slots of one device are adjacent */
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	cache->slots_ret[cache->n_ret++] = entry;
+	spin_unlock(&cache->free_lock);
+}
+
+/**
+ * get_swap_page - allocate a swap slot for the swap cache
+ *
+ * Returns the slot, or an entry of 0 if there is no free swap space.
+ */
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry = { 0 };
+
+	if (!check_cache_active())
+		goto direct;
+
+	/*
+	 * The mutex keeps the cache consistent if we get preempted and
+	 * migrated: we then simply keep using the old cpu's cache.
+	 */
+	cache = &per_cpu(swp_slots, raw_smp_processor_id());
+	mutex_lock(&cache->alloc_lock);
+	if (!cache->nr && swap_slot_cache_active) {
+		cache->cur = 0;
+		cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+	}
+	if (cache->nr) {
+		entry = cache->slots[cache->cur++];
+		cache->nr--;
+	}
+	mutex_unlock(&cache->alloc_lock);
+	if (entry.val)
+		return entry;
+
+direct:
+	get_swap_pages(1, &entry);
+	return entry;
+}
+
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nfb,
+					     unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_slots_cache_cpu((long)hcpu, SLOTS_CACHE | SLOTS_CACHE_RET);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	swap_slot_cache_enabled = 1;
+	return 0;
+}
+subsys_initcall(swap_slots_init);
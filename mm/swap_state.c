@@ -62,7 +62,7 @@ void show_swap_cache_info(void)
 	printk("Swap cache stats: add %lu, delete %lu, find %lu/%lu\n",
 		swap_cache_info.add_total, swap_cache_info.del_total,
 		swap_cache_info.find_success, swap_cache_info.find_total);
-	printk("Free swap  = %ldkB\n", nr_swap_pages << (PAGE_SHIFT - 10));
+	printk("Free swap  = %ldkB\n", get_nr_swap_pages() << (PAGE_SHIFT - 10));
 	printk("Total swap = %lukB\n", total_swap_pages << (PAGE_SHIFT - 10));
 }
 
@@ -313,6 +313,15 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = swapcache_prepare(entry);
 		if (err == -EEXIST) {	/* seems racy */
 			radix_tree_preload_end();
+			/*
+			 * A slot without users may be parked in a per-cpu
+			 * slot cache, and no swap cache page is coming for
+			 * it.  swapoff drains those caches, so it can wait.
+			 */
+			if (!__swap_count(entry) &&
+			    (get_swap_info_struct(swp_type(entry))->flags &
+			     SWP_WRITEOK))
+				break;
 			continue;
 		}
 		if (err) {		/* swp entry is obsolete ? */
@@ -37,7 +37,7 @@
 
 static DEFINE_SPINLOCK(swap_lock);
 static unsigned int nr_swapfiles;
-long nr_swap_pages;
+atomic_long_t nr_swap_pages;
 long total_swap_pages;
 static int swap_overflow;
 static int least_priority;
@@ -254,7 +254,7 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 			/*
 			 * Start range check on racing allocations, in case
 			 * they overlap the cluster we eventually decide on
-			 * (we scan without swap_lock to allow preemption).
+			 * (we scan without si->lock to allow preemption).
 			 * It's hardly conceivable that cluster_nr could be
 			 * wrapped during our scan, but don't depend on it.
 			 */
@@ -263,7 +263,7 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 			si->lowest_alloc = si->max;
 			si->highest_alloc = 0;
 		}
-		spin_unlock(&swap_lock);
+		spin_unlock(&si->lock);
 
 		/*
 		 * If seek is expensive, start searching for new cluster from
@@ -282,7 +282,7 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 			if (si->swap_map[offset])
 				last_in_cluster = offset + SWAPFILE_CLUSTER;
 			else if (offset == last_in_cluster) {
-				spin_lock(&swap_lock);
+				spin_lock(&si->lock);
 				offset -= SWAPFILE_CLUSTER - 1;
 				si->cluster_next = offset;
 				si->cluster_nr = SWAPFILE_CLUSTER - 1;
@@ -303,7 +303,7 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 			if (si->swap_map[offset])
 				last_in_cluster = offset + SWAPFILE_CLUSTER;
 			else if (offset == last_in_cluster) {
-				spin_lock(&swap_lock);
+				spin_lock(&si->lock);
 				offset -= SWAPFILE_CLUSTER - 1;
 				si->cluster_next = offset;
 				si->cluster_nr = SWAPFILE_CLUSTER - 1;
@@ -317,7 +317,7 @@ static inline unsigned long scan_swap_map(struct swap_info_struct *si,
 		}
 
 		offset = scan_base;
-		spin_lock(&swap_lock);
+		spin_lock(&si->lock);
 		si->cluster_nr = SWAPFILE_CLUSTER - 1;
 		si->lowest_alloc = 0;
 	}
@@ -335,9 +335,9 @@ checks:
 		&& cache == SWAP_CACHE
 		&& si->swap_map[offset] == SWAP_HAS_CACHE) {
 		int swap_was_freed;
-		spin_unlock(&swap_lock);
+		spin_unlock(&si->lock);
 		swap_was_freed = __try_to_reclaim_swap(si, offset);
-		spin_lock(&swap_lock);
+		spin_lock(&si->lock);
 		/* entry was freed successfully, try to use this again */
 		if (swap_was_freed)
 			goto checks;
@@ -380,13 +380,13 @@ checks:
 			    si->lowest_alloc <= last_in_cluster)
 				last_in_cluster = si->lowest_alloc - 1;
 			si->flags |= SWP_DISCARDING;
-			spin_unlock(&swap_lock);
+			spin_unlock(&si->lock);
 
 			if (offset < last_in_cluster)
 				discard_swap_cluster(si, offset,
 					last_in_cluster - offset + 1);
 
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			si->lowest_alloc = 0;
 			si->flags &= ~SWP_DISCARDING;
 
@@ -400,10 +400,10 @@ checks:
 			 * could defer that delay until swap_writepage,
 			 * but it's easier to keep this self-contained.
 			 */
-			spin_unlock(&swap_lock);
+			spin_unlock(&si->lock);
 			wait_on_bit(&si->flags, ilog2(SWP_DISCARDING),
 				wait_for_discard, TASK_UNINTERRUPTIBLE);
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 		} else {
 			/*
 			 * Note pages allocated by racing tasks while
@@ -419,14 +419,14 @@ checks:
 	return offset;
 
 scan:
-	spin_unlock(&swap_lock);
+	spin_unlock(&si->lock);
 	while (++offset <= si->highest_bit) {
 		if (!si->swap_map[offset]) {
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			goto checks;
 		}
 		if (vm_swap_full() && si->swap_map[offset] == SWAP_HAS_CACHE) {
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			goto checks;
 		}
 		if (unlikely(--latency_ration < 0)) {
@@ -437,11 +437,11 @@ scan:
 	offset = si->lowest_bit;
 	while (++offset < scan_base) {
 		if (!si->swap_map[offset]) {
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			goto checks;
 		}
 		if (vm_swap_full() && si->swap_map[offset] == SWAP_HAS_CACHE) {
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			goto checks;
 		}
 		if (unlikely(--latency_ration < 0)) {
@@ -449,24 +449,35 @@ scan:
 			latency_ration = LATENCY_LIMIT;
 		}
 	}
-	spin_lock(&swap_lock);
+	spin_lock(&si->lock);
 
 no_page:
 	si->flags -= SWP_SCANNING;
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap slots for the swap cache, taken sequentially
+ * from the current cluster of the first usable device, so that a batch
+ * handed to one cpu's slot cache is also contiguous on disk.
+ * Returns the number of slots stored in @slots.
+ */
+int get_swap_pages(int n, swp_entry_t slots[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int n_ret = 0;
+	long avail;
 
 	spin_lock(&swap_lock);
-	if (nr_swap_pages <= 0)
+	avail = get_nr_swap_pages();
+	if (avail <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	if (n > avail)
+		n = avail;
+	atomic_long_sub(n, &nr_swap_pages);
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info + type;
@@ -483,19 +494,37 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
-		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		/*
+		 * The device is scanned under its own lock only, so that
+		 * other cpus can allocate from other devices and free slots
+		 * meanwhile.  swapoff cannot free si: it waits for
+		 * SWP_SCANNING, which scan_swap_map() sets under si->lock.
+		 */
+		spin_lock(&si->lock);
+		spin_unlock(&swap_lock);
+		while (n_ret < n) {
+			/* This is called for allocating swap entry for cache */
+			offset = scan_swap_map(si, SWAP_CACHE);
+			if (!offset)
+				break;
+			slots[n_ret++] = swp_entry(type, offset);
 		}
+		spin_unlock(&si->lock);
+		if (n_ret)
+			goto out;
+		spin_lock(&swap_lock);
 		next = swap_list.next;
 	}
+	spin_unlock(&swap_lock);
+
+out:
+	if (n_ret < n)
+		atomic_long_add(n - n_ret, &nr_swap_pages);
+	return n_ret;
 
-	nr_swap_pages++;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return 0;
 }
 
 /* The only caller of this function is now susupend routine */
@@ -504,19 +533,19 @@ swp_entry_t get_swap_page_of_type(int type)
 	struct swap_info_struct *si;
 	pgoff_t offset;
 
-	spin_lock(&swap_lock);
 	si = swap_info + type;
+	spin_lock(&si->lock);
 	if (si->flags & SWP_WRITEOK) {
-		nr_swap_pages--;
+		atomic_long_dec(&nr_swap_pages);
 		/* This is called for allocating swap entry, not cache */
 		offset = scan_swap_map(si, SWAP_MAP);
 		if (offset) {
-			spin_unlock(&swap_lock);
+			spin_unlock(&si->lock);
 			return swp_entry(type, offset);
 		}
-		nr_swap_pages++;
+		atomic_long_inc(&nr_swap_pages);
 	}
-	spin_unlock(&swap_lock);
+	spin_unlock(&si->lock);
 	return (swp_entry_t) {0};
 }
 
@@ -538,7 +567,7 @@ static struct swap_info_struct * swap_info_get(swp_entry_t entry)
 		goto bad_offset;
 	if (!p->swap_map[offset])
 		goto bad_free;
-	spin_lock(&swap_lock);
+	spin_lock(&p->lock);
 	return p;
 
 bad_free:
@@ -556,6 +585,12 @@ out:
 	return NULL;
 }
 
+/*
+ * Drop one reference to the slot.  A slot left without any reference
+ * is not released here but stays reserved as SWAP_HAS_CACHE, and 0 is
+ * returned: the caller must then pass it on to free_swap_slot() after
+ * dropping p->lock, so that it can be released in a batch.
+ */
 static int swap_entry_free(struct swap_info_struct *p,
 			   swp_entry_t ent, int cache)
 {
@@ -577,22 +612,64 @@ static int swap_entry_free(struct swap_info_struct *p,
 	}
 	/* return code. */
 	count = p->swap_map[offset];
-	/* free if no reference */
-	if (!count) {
-		if (offset < p->lowest_bit)
-			p->lowest_bit = offset;
-		if (offset > p->highest_bit)
-			p->highest_bit = offset;
-		if (p->prio > swap_info[swap_list.next].prio)
-			swap_list.next = p - swap_info;
-		nr_swap_pages++;
-		p->inuse_pages--;
-	}
+	/* keep it reserved until free_swap_slot() gets to it */
+	if (!count)
+		p->swap_map[offset] = SWAP_HAS_CACHE;
 	if (!swap_count(count))
 		mem_cgroup_uncharge_swap(ent);
 	return count;
 }
 
+/* Called with p->lock held, for a slot reserved by swap_entry_free() */
+static void swap_entry_release(struct swap_info_struct *p,
+			       unsigned long offset)
+{
+	VM_BUG_ON(p->swap_map[offset] != SWAP_HAS_CACHE);
+	p->swap_map[offset] = 0;
+	if (offset < p->lowest_bit)
+		p->lowest_bit = offset;
+	if (offset > p->highest_bit)
+		p->highest_bit = offset;
+	atomic_long_inc(&nr_swap_pages);
+	p->inuse_pages--;
+}
+
+/**
+ * swapcache_free_entries - release a batch of unused swap slots
+ * @entries: slots reserved by swap_entry_free()
+ * @n: number of slots
+ *
+ * Consecutive slots of the same device are released under a single
+ * acquisition of its lock.
+ */
+void swapcache_free_entries(swp_entry_t *entries, int n)
+{
+	struct swap_info_struct *p, *prev = NULL;
+	int i;
+
+	if (n <= 0)
+		return;
+
+	for (i = 0; i < n; i++) {
+		p = &swap_info[swp_type(entries[i])];
+		if (p != prev) {
+			if (prev)
+				spin_unlock(&prev->lock);
+			spin_lock(&p->lock);
+			prev = p;
+		}
+		swap_entry_release(p, swp_offset(entries[i]));
+	}
+	spin_unlock(&prev->lock);
+
+	/* Prefer this device for the next allocation, as before */
+	spin_lock(&swap_lock);
+	if ((prev->flags & SWP_WRITEOK) &&
+	    prev->prio > swap_info[swap_list.next].prio)
+		swap_list.next = prev - swap_info;
+	spin_unlock(&swap_lock);
+}
+
 /*
  * Caller has made sure that the swapdevice corresponding to entry
  * is still around or has not been recycled.
@@ -600,11 +677,14 @@ static int swap_entry_free(struct swap_info_struct *p,
 void swap_free(swp_entry_t entry)
 {
 	struct swap_info_struct * p;
+	int ret;
 
 	p = swap_info_get(entry);
 	if (p) {
-		swap_entry_free(p, entry, SWAP_MAP);
-		spin_unlock(&swap_lock);
+		ret = swap_entry_free(p, entry, SWAP_MAP);
+		spin_unlock(&p->lock);
+		if (!ret)
+			free_swap_slot(entry);
 	}
 }
 
@@ -627,11 +707,23 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 				swapout = false; /* no more swap users! */
 			mem_cgroup_uncharge_swapcache(page, entry, swapout);
 		}
-		spin_unlock(&swap_lock);
+		spin_unlock(&p->lock);
+		if (!ret)
+			free_swap_slot(entry);
 	}
 	return;
 }
 
+/*
+ * Raw usage count of the slot, without taking the device lock.
+ */
+int __swap_count(swp_entry_t entry)
+{
+	struct swap_info_struct *p = &swap_info[swp_type(entry)];
+
+	return swap_count(p->swap_map[swp_offset(entry)]);
+}
+
 /*
  * How many references to page are currently swapped out?
  */
@@ -645,7 +737,7 @@ static inline int page_swapcount(struct page *page)
 	p = swap_info_get(entry);
 	if (p) {
 		count = swap_count(p->swap_map[swp_offset(entry)]);
-		spin_unlock(&swap_lock);
+		spin_unlock(&p->lock);
 	}
 	return count;
 }
@@ -700,20 +792,24 @@ int free_swap_and_cache(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 	struct page *page = NULL;
+	int count;
 
 	if (non_swap_entry(entry))
 		return 1;
 
 	p = swap_info_get(entry);
 	if (p) {
-		if (swap_entry_free(p, entry, SWAP_MAP) == SWAP_HAS_CACHE) {
+		count = swap_entry_free(p, entry, SWAP_MAP);
+		if (count == SWAP_HAS_CACHE) {
 			page = find_get_page(&swapper_space, entry.val);
 			if (page && !trylock_page(page)) {
 				page_cache_release(page);
 				page = NULL;
 			}
 		}
-		spin_unlock(&swap_lock);
+		spin_unlock(&p->lock);
+		if (!count)
+			free_swap_slot(entry);
 	}
 	if (page) {
 		/*
@@ -795,13 +891,15 @@ unsigned int count_swap_pages(int type, int free)
 	unsigned int n = 0;
 
 	if (type < nr_swapfiles) {
-		spin_lock(&swap_lock);
-		if (swap_info[type].flags & SWP_WRITEOK) {
-			n = swap_info[type].pages;
+		struct swap_info_struct *sis = swap_info + type;
+
+		spin_lock(&sis->lock);
+		if (sis->flags & SWP_WRITEOK) {
+			n = sis->pages;
 			if (free)
-				n -= swap_info[type].inuse_pages;
+				n -= sis->inuse_pages;
 		}
-		spin_unlock(&swap_lock);
+		spin_unlock(&sis->lock);
 	}
 	return n;
 }
@@ -996,7 +1094,7 @@ static unsigned int find_next_to_unuse(struct swap_info_struct *si,
 	 * No need for swap_lock here: we're just looking
 	 * for whether an entry is in use, not modifying it; false
 	 * hits are okay, and sys_swapoff() has already prevented new
-	 * allocations from this area (while holding swap_lock).
+	 * allocations from this area (while holding si->lock).
 	 */
 	for (;;) {
 		if (++i >= max) {
@@ -1197,9 +1295,9 @@ static int try_to_unuse(unsigned int type)
 			goto retry;
 
 		if (swap_count(*swap_map) == SWAP_MAP_MAX) {
-			spin_lock(&swap_lock);
+			spin_lock(&si->lock);
 			*swap_map = encode_swapmap(0, true);
-			spin_unlock(&swap_lock);
+			spin_unlock(&si->lock);
 			reset_overflow = 1;
 		}
 
@@ -1571,11 +1669,16 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 			swap_info[i].prio = p->prio--;
 		least_priority++;
 	}
-	nr_swap_pages -= p->pages;
+	atomic_long_sub(p->pages, &nr_swap_pages);
 	total_swap_pages -= p->pages;
+	spin_lock(&p->lock);
 	p->flags &= ~SWP_WRITEOK;
+	spin_unlock(&p->lock);
 	spin_unlock(&swap_lock);
 
+	/* hand back the slots still parked in the per-cpu caches */
+	drain_swap_slots_caches();
+
 	current->flags |= PF_OOM_ORIGIN;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_OOM_ORIGIN;
@@ -1596,9 +1699,11 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 			swap_list.head = swap_list.next = p - swap_info;
 		else
 			swap_info[prev].next = p - swap_info;
-		nr_swap_pages += p->pages;
+		atomic_long_add(p->pages, &nr_swap_pages);
 		total_swap_pages += p->pages;
+		spin_lock(&p->lock);
 		p->flags |= SWP_WRITEOK;
+		spin_unlock(&p->lock);
 		spin_unlock(&swap_lock);
 		goto out_dput;
 	}
@@ -1612,12 +1717,16 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	spin_lock(&swap_lock);
 	drain_mmlist();
 
+	spin_lock(&p->lock);
+
 	/* wait for anyone still in scan_swap_map */
 	p->highest_bit = 0;		/* cuts scans short */
 	while (p->flags >= SWP_SCANNING) {
+		spin_unlock(&p->lock);
 		spin_unlock(&swap_lock);
 		schedule_timeout_uninterruptible(1);
 		spin_lock(&swap_lock);
+		spin_lock(&p->lock);
 	}
 
 	swap_file = p->swap_file;
@@ -1626,6 +1735,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
 	p->flags = 0;
+	spin_unlock(&p->lock);
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
@@ -1801,6 +1911,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	if (type >= nr_swapfiles)
 		nr_swapfiles = type+1;
 	memset(p, 0, sizeof(*p));
+	spin_lock_init(&p->lock);
 	INIT_LIST_HEAD(&p->extent_list);
 	p->flags = SWP_USED;
 	p->next = -1;
@@ -1991,9 +2102,11 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		  (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
 	else
 		p->prio = --least_priority;
+	spin_lock(&p->lock);
 	p->swap_map = swap_map;
 	p->flags |= SWP_WRITEOK;
-	nr_swap_pages += nr_good_pages;
+	spin_unlock(&p->lock);
+	atomic_long_add(nr_good_pages, &nr_swap_pages);
 	total_swap_pages += nr_good_pages;
 
 	printk(KERN_INFO "Adding %uk swap on %s.  "
@@ -2063,7 +2176,7 @@ void si_swapinfo(struct sysinfo *val)
 			continue;
 		nr_to_be_unused += swap_info[i].inuse_pages;
 	}
-	val->freeswap = nr_swap_pages + nr_to_be_unused;
+	val->freeswap = get_nr_swap_pages() + nr_to_be_unused;
 	val->totalswap = total_swap_pages + nr_to_be_unused;
 	spin_unlock(&swap_lock);
 }
@@ -2097,7 +2210,7 @@ static int __swap_duplicate(swp_entry_t entry, bool cache)
 	p = type + swap_info;
 	offset = swp_offset(entry);
 
-	spin_lock(&swap_lock);
+	spin_lock(&p->lock);
 
 	if (unlikely(offset >= p->max))
 		goto unlock_out;
@@ -2132,7 +2245,7 @@ static int __swap_duplicate(swp_entry_t entry, bool cache)
 	} else
 		result = -ENOENT; /* unused swap entry */
 unlock_out:
-	spin_unlock(&swap_lock);
+	spin_unlock(&p->lock);
 out:
 	return result;
 
@@ -2169,7 +2282,7 @@ get_swap_info_struct(unsigned type)
 }
 
 /*
- * swap_lock prevents swap_map being freed. Don't grab an extra
+ * si->lock prevents swap_map being freed. Don't grab an extra
  * reference on the swaphandle, it doesn't matter if it becomes unused.
  */
 int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
@@ -2190,7 +2303,7 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 	if (!base)		/* first page is swap header */
 		base++;
 
-	spin_lock(&swap_lock);
+	spin_lock(&si->lock);
 	if (end > si->max)	/* don't go beyond end of map */
 		end = si->max;
 
@@ -2210,7 +2323,7 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 		if (swap_count(si->swap_map[toff]) == SWAP_MAP_BAD)
 			break;
 	}
-	spin_unlock(&swap_lock);
+	spin_unlock(&si->lock);
 
 	/*
 	 * Indicate starting offset, and return number of pages to get:
@@ -181,6 +181,52 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/*
+ * Remove the shadow entries of evicted pages in the range [start, end]
+ * from @mapping (see mm/workingset.c).  Pages themselves are left alone.
+ */
+static void clear_shadow_entries(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	unsigned long indices[PAGEVEC_SIZE];
+	void *entries[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	unsigned int nr, i;
+
+	while (start <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		if (!mapping->nrshadows) {
+			spin_unlock_irq(&mapping->tree_lock);
+			break;
+		}
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, start, PAGEVEC_SIZE);
+		/*
+		 * Read all the entries before deleting any: deletions
+		 * may shrink the tree and free the nodes holding @slots.
+		 */
+		for (i = 0; i < nr; i++)
+			entries[i] = *slots[i];
+		for (i = 0; i < nr; i++) {
+			if (indices[i] > end)
+				break;
+			if (!radix_tree_exceptional_entry(entries[i]))
+				continue;
+			if (radix_tree_delete_item(&mapping->page_tree,
+						   indices[i], entries[i]))
+				mapping->nrshadows--;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (i < nr || !nr)
+			break;
+		start = indices[nr - 1] + 1;
+		if (!start)
+			break;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -212,14 +258,25 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	const unsigned partial = lstart & (PAGE_CACHE_SIZE - 1);
 	struct pagevec pvec;
 	pgoff_t next;
+	unsigned long nrpages, nrshadows;
 	int i;
 
-	if (mapping->nrpages == 0)
+	/*
+	 * Reclaim accounts a new shadow entry before it drops the page
+	 * (see page_cache_tree_delete), so read the counters in reverse.
+	 */
+	nrpages = mapping->nrpages;
+	smp_rmb();
+	nrshadows = mapping->nrshadows;
+	if (nrpages == 0 && nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	next = start;
 	while (next <= end &&
@@ -287,6 +344,14 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		pagevec_release(&pvec);
 	}
+
+shadows:
+	/*
+	 * Reclaim holds the page lock while it replaces a page with its
+	 * shadow entry, so by now every page that was in the range has
+	 * either been truncated or has left its shadow behind.
+	 */
+	clear_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -321,7 +386,8 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 {
 	struct pagevec pvec;
 	pgoff_t next = start;
-	unsigned long ret = 0;
+	unsigned long ret;
+	unsigned long count = 0;
 	int i;
 
 	pagevec_init(&pvec, 0);
@@ -347,7 +413,14 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 			if (lock_failed)
 				continue;
 
-			ret += invalidate_inode_page(page);
+			ret = invalidate_inode_page(page);
+			/*
+			 * Invalidation is a hint that the page is no longer
+			 * of interest and try to speed up its reclaim.
+			 */
+			if (!ret)
+				deactivate_page(page);
+			count += ret;
 
 			unlock_page(page);
 			if (next > end)
@@ -356,7 +429,7 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 		pagevec_release(&pvec);
 		cond_resched();
 	}
-	return ret;
+	return count;
 }
 EXPORT_SYMBOL(invalidate_mapping_pages);
 
@@ -382,7 +455,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 	page_cache_release(page);	/* pagecache ref */
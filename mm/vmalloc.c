@@ -26,6 +26,7 @@
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
+#include <linux/workqueue.h>
 #include <asm/atomic.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
@@ -259,6 +260,7 @@ struct vmap_area {
 	struct list_head purge_list;	/* "lazy purge" list */
 	void *private;
 	struct rcu_head rcu_head;
+	int cpu;			/* cpu which lazily freed it */
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
@@ -319,6 +321,86 @@ static void __insert_vmap_area(struct vmap_area *va)
 
 static void purge_vmap_area_lazy(void);
 
+/*
+ * Small vmalloc areas which have been lazily freed and then purged, so
+ * that no cpu can hold a stale TLB entry for them any more, are kept on
+ * a per-cpu cache for reuse by the cpu which freed them, instead of being
+ * handed back to the global allocator.  A cached area stays in
+ * vmap_area_root, so taking one needs neither vmap_area_lock nor a
+ * search of the tree.  Caches are indexed by size in pages, guard page
+ * included.
+ */
+#define VMAP_CACHE_PAGES	8	/* largest cached area */
+#define VMAP_CACHE_DEPTH	16	/* per size, per cpu */
+
+struct vmap_area_cache {
+	spinlock_t lock;
+	unsigned int nr[VMAP_CACHE_PAGES + 1];
+	struct list_head free[VMAP_CACHE_PAGES + 1];
+};
+
+static DEFINE_PER_CPU(struct vmap_area_cache, vmap_area_cache);
+
+/* Statistics for /proc/vmallocinfo, not worth any locking */
+static unsigned long vmap_cache_hits;
+static unsigned long vmap_purge_runs;
+static unsigned long vmap_purged_pages;
+
+static inline bool vmap_area_cacheable(unsigned long size, unsigned long align,
+				       unsigned long vstart, unsigned long vend)
+{
+	return vstart == VMALLOC_START && vend == VMALLOC_END &&
+		align <= PAGE_SIZE && (size >> PAGE_SHIFT) <= VMAP_CACHE_PAGES;
+}
+
+static struct vmap_area *vmap_area_cache_get(unsigned long size)
+{
+	struct vmap_area_cache *vc = &get_cpu_var(vmap_area_cache);
+	unsigned int idx = size >> PAGE_SHIFT;
+	struct vmap_area *va = NULL;
+
+	spin_lock(&vc->lock);
+	if (vc->nr[idx]) {
+		va = list_first_entry(&vc->free[idx], struct vmap_area,
+				      purge_list);
+		list_del(&va->purge_list);
+		vc->nr[idx]--;
+		vmap_cache_hits++;
+	}
+	spin_unlock(&vc->lock);
+	put_cpu_var(vmap_area_cache);
+
+	if (va)
+		va->flags = 0;
+	return va;
+}
+
+/* Returns false if the area is not cacheable or the cache is full */
+static bool vmap_area_cache_put(struct vmap_area *va)
+{
+	unsigned long size = va->va_end - va->va_start;
+	unsigned int idx = size >> PAGE_SHIFT;
+	struct vmap_area_cache *vc;
+	bool ret = false;
+
+	if (va->va_start < VMALLOC_START || va->va_end > VMALLOC_END ||
+	    idx > VMAP_CACHE_PAGES)
+		return false;
+
+	vc = &per_cpu(vmap_area_cache, va->cpu);
+	spin_lock(&vc->lock);
+	if (vc->nr[idx] < VMAP_CACHE_DEPTH) {
+		/* find_vm_area() must not find the old vm_struct */
+		va->flags &= ~VM_VM_AREA;
+		va->private = NULL;
+		list_add(&va->purge_list, &vc->free[idx]);
+		vc->nr[idx]++;
+		ret = true;
+	}
+	spin_unlock(&vc->lock);
+	return ret;
+}
+
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
  * vstart and vend.
@@ -336,6 +418,12 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
 
+	if (vmap_area_cacheable(size, align, vstart, vend)) {
+		va = vmap_area_cache_get(size);
+		if (va)
+			return va;
+	}
+
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
@@ -509,6 +597,21 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Lazily freed areas waiting for the next purge */
+static LIST_HEAD(vmap_purge_list);
+static DEFINE_SPINLOCK(vmap_purge_lock);
+
+/*
+ * Upper bound on how long a lazily freed area waits for its purge when
+ * there is not enough lazy space to trigger one: a vunmap'ed area keeps
+ * its page tables and kernel virtual space until then.
+ */
+#define VMAP_PURGE_DELAY	(HZ / 10)
+
+static void vmap_purge_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(vmap_purge_work, vmap_purge_work_fn);
+static bool vmap_purge_work_ready __read_mostly;
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -536,6 +639,7 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 {
 	static DEFINE_SPINLOCK(purge_lock);
 	LIST_HEAD(valist);
+	LIST_HEAD(freelist);
 	struct vmap_area *va;
 	struct vmap_area *n_va;
 	int nr = 0;
@@ -554,21 +658,20 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			unmap_vmap_area(va);
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	spin_lock(&vmap_purge_lock);
+	list_splice_init(&vmap_purge_list, &valist);
+	spin_unlock(&vmap_purge_lock);
+
+	list_for_each_entry(va, &valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		unmap_vmap_area(va);
+		va->flags |= VM_LAZY_FREEING;
+		va->flags &= ~VM_LAZY_FREE;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
@@ -577,8 +680,18 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 		flush_tlb_kernel_range(*start, *end);
 
 	if (nr) {
+		vmap_purge_runs++;
+		vmap_purged_pages += nr;
+
+		/* Flushed now: small areas can go straight back to use */
+		list_for_each_entry_safe(va, n_va, &valist, purge_list) {
+			list_del(&va->purge_list);
+			if (!vmap_area_cache_put(va))
+				list_add_tail(&va->purge_list, &freelist);
+		}
+
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		list_for_each_entry_safe(va, n_va, &freelist, purge_list)
 			__free_vmap_area(va);
 		spin_unlock(&vmap_area_lock);
 	}
@@ -597,25 +710,78 @@ static void try_purge_vmap_area_lazy(void)
 }
 
 /*
- * Kick off a purge of the outstanding lazy areas.
+ * Return all areas held in the per-cpu caches to the global allocator.
+ */
+static void vmap_area_cache_drain(void)
+{
+	LIST_HEAD(freelist);
+	struct vmap_area *va, *n_va;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct vmap_area_cache *vc = &per_cpu(vmap_area_cache, cpu);
+
+		spin_lock(&vc->lock);
+		for (i = 0; i <= VMAP_CACHE_PAGES; i++) {
+			list_splice_init(&vc->free[i], &freelist);
+			vc->nr[i] = 0;
+		}
+		spin_unlock(&vc->lock);
+	}
+
+	spin_lock(&vmap_area_lock);
+	list_for_each_entry_safe(va, n_va, &freelist, purge_list)
+		__free_vmap_area(va);
+	spin_unlock(&vmap_area_lock);
+}
+
+/*
+ * Kick off a purge of the outstanding lazy areas, and give back what the
+ * per-cpu caches hold: we are called when kernel virtual space ran out.
  */
 static void purge_vmap_area_lazy(void)
 {
 	unsigned long start = ULONG_MAX, end = 0;
 
 	__purge_vmap_area_lazy(&start, &end, 1, 0);
+	vmap_area_cache_drain();
+}
+
+static void vmap_purge_work_fn(struct work_struct *work)
+{
+	try_purge_vmap_area_lazy();
+	/* A purge already in progress may have missed the latest areas */
+	if (!list_empty(&vmap_purge_list))
+		schedule_delayed_work(&vmap_purge_work, VMAP_PURGE_DELAY);
 }
 
+static int __init vmap_purge_init(void)
+{
+	vmap_purge_work_ready = true;
+	return 0;
+}
+core_initcall(vmap_purge_init);
+
 /*
  * Free and unmap a vmap area, caller ensuring flush_cache_vunmap had been
  * called for the correct range previously.
  */
 static void free_unmap_vmap_area_noflush(struct vmap_area *va)
 {
+	bool first;
+
 	va->flags |= VM_LAZY_FREE;
+	va->cpu = raw_smp_processor_id();
+	spin_lock(&vmap_purge_lock);
+	first = list_empty(&vmap_purge_list);
+	list_add_tail(&va->purge_list, &vmap_purge_list);
+	spin_unlock(&vmap_purge_lock);
+
 	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
 	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
+	else if (first && vmap_purge_work_ready)
+		schedule_delayed_work(&vmap_purge_work, VMAP_PURGE_DELAY);
 }
 
 /*
@@ -1102,9 +1268,17 @@ void __init vmalloc_init(void)
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
 
+		struct vmap_area_cache *vc;
+		int j;
+
 		vbq = &per_cpu(vmap_block_queue, i);
 		spin_lock_init(&vbq->lock);
 		INIT_LIST_HEAD(&vbq->free);
+
+		vc = &per_cpu(vmap_area_cache, i);
+		spin_lock_init(&vc->lock);
+		for (j = 0; j <= VMAP_CACHE_PAGES; j++)
+			INIT_LIST_HEAD(&vc->free[j]);
 	}
 
 	/* Import existing vmlist entries. */
@@ -2395,6 +2569,49 @@ static void show_numa_info(struct seq_file *m, struct vm_struct *v)
 	}
 }
 
+/*
+ * Summary lines after the last area: how fragmented the free vmalloc
+ * space is, and what the lazy purging and per-cpu caching amount to.
+ */
+static void show_vmap_stats(struct seq_file *m)
+{
+	unsigned long addr = VMALLOC_START;
+	unsigned long free = 0, largest = 0, holes = 0;
+	unsigned long cached = 0;
+	struct vmap_area *va;
+	int cpu, i;
+
+	spin_lock(&vmap_area_lock);
+	list_for_each_entry(va, &vmap_area_list, list) {
+		if (va->va_end <= VMALLOC_START || va->va_start >= VMALLOC_END)
+			continue;
+		if (va->va_start > addr) {
+			free += va->va_start - addr;
+			largest = max(largest, va->va_start - addr);
+			holes++;
+		}
+		addr = max(addr, va->va_end);
+	}
+	spin_unlock(&vmap_area_lock);
+	if (VMALLOC_END > addr) {
+		free += VMALLOC_END - addr;
+		largest = max(largest, VMALLOC_END - addr);
+		holes++;
+	}
+
+	for_each_possible_cpu(cpu)
+		for (i = 0; i <= VMAP_CACHE_PAGES; i++)
+			cached += per_cpu(vmap_area_cache, cpu).nr[i];
+
+	seq_printf(m, "vmap free: %lukB holes: %lu largest: %lukB\n",
+		   free >> 10, holes, largest >> 10);
+	seq_printf(m, "vmap lazy: %lukB purges: %lu purged: %lukB "
+		   "cached: %lu cache hits: %lu\n",
+		   (unsigned long)atomic_read(&vmap_lazy_nr) << (PAGE_SHIFT - 10),
+		   vmap_purge_runs, vmap_purged_pages << (PAGE_SHIFT - 10),
+		   cached, vmap_cache_hits);
+}
+
 static int s_show(struct seq_file *m, void *p)
 {
 	struct vm_struct *v = p;
@@ -2433,6 +2650,9 @@ static int s_show(struct seq_file *m, void *p)
 
 	show_numa_info(m, v);
 	seq_putc(m, '\n');
+
+	if (!v->next)
+		show_vmap_stats(m);
 	return 0;
 }
 
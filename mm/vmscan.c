@@ -29,6 +29,7 @@
 #include <linux/pagevec.h>
 #include <linux/backing-dev.h>
 #include <linux/rmap.h>
+#include <linux/hugetlb.h>
 #include <linux/topology.h>
 #include <linux/cpu.h>
 #include <linux/cpuset.h>
@@ -429,9 +430,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  If @reclaimed is set, a shadow
+ * entry is left behind for refault detection (see mm/workingset.c).
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -476,7 +479,17 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		spin_unlock_irq(&mapping->tree_lock);
 		swapcache_free(swap, page);
 	} else {
-		__remove_from_page_cache(page);
+		void *shadow = NULL;
+
+		/*
+		 * Remember the eviction of file cache pages so that a
+		 * refault of the working set can be told apart from a
+		 * used-once stream.  Swap backed pages (shmem) are not
+		 * tracked.
+		 */
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 	}
@@ -496,7 +509,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -758,7 +771,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -955,7 +968,7 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 			 * anon page which don't already have a swap slot is
 			 * pointless.
 			 */
-			if (nr_swap_pages <= 0 && PageAnon(cursor_page) &&
+			if (get_nr_swap_pages() <= 0 && PageAnon(cursor_page) &&
 					!PageSwapCache(cursor_page))
 				continue;
 
@@ -1642,7 +1655,7 @@ static void shrink_zone(int priority, struct zone *zone,
 	int noswap = 0;
 
 	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || (nr_swap_pages <= 0)) {
+	if (!sc->may_swap || (get_nr_swap_pages() <= 0)) {
 		noswap = 1;
 		percent[0] = 0;
 		percent[1] = 100;
@@ -1693,7 +1706,7 @@ static void shrink_zone(int priority, struct zone *zone,
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_anon_is_low(zone, sc) && nr_swap_pages > 0)
+	if (inactive_anon_is_low(zone, sc) && get_nr_swap_pages() > 0)
 		shrink_active_list(SWAP_CLUSTER_MAX, zone, sc, priority, 0);
 
 	throttle_vm_writeout(sc->gfp_mask);
@@ -1991,6 +2004,7 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order)
 	 * free_pages == high_wmark_pages(zone).
 	 */
 	int temp_priority[MAX_NR_ZONES];
+	int shrink_slabs = current == pgdat->kswapd[0];
 
 loop_again:
 	total_scanned = 0;
@@ -2059,7 +2073,7 @@ loop_again:
 		 */
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
-			int nr_slab;
+			int nr_slab = 0;
 			int nid, zid;
 
 			if (!populated_zone(zone))
@@ -2091,14 +2105,22 @@ loop_again:
 			if (!zone_watermark_ok(zone, order,
 					8*high_wmark_pages(zone), end_zone, 0))
 				shrink_zone(priority, zone, &sc);
-			reclaim_state->reclaimed_slab = 0;
-			nr_slab = shrink_slab(sc.nr_scanned, GFP_KERNEL,
-						lru_pages);
-			sc.nr_reclaimed += reclaim_state->reclaimed_slab;
+			/*
+			 * With several kswapd threads per node, only the
+			 * first one shrinks the slab caches, or they would
+			 * get kswapd_threads times the pressure.
+			 */
+			if (shrink_slabs) {
+				reclaim_state->reclaimed_slab = 0;
+				nr_slab = shrink_slab(sc.nr_scanned, GFP_KERNEL,
+							lru_pages);
+				sc.nr_reclaimed += reclaim_state->reclaimed_slab;
+			}
 			total_scanned += sc.nr_scanned;
 			if (zone_is_all_unreclaimable(zone))
 				continue;
-			if (nr_slab == 0 && zone->pages_scanned >=
+			if (shrink_slabs && nr_slab == 0 &&
+			    zone->pages_scanned >=
 					(zone_reclaimable_pages(zone) * 6))
 					zone_set_flag(zone,
 						      ZONE_ALL_UNRECLAIMABLE);
@@ -2140,7 +2162,8 @@ out:
 
 		zone->prev_priority = temp_priority[i];
 	}
-	if (!all_zones_ok) {
+	/* A thread being stopped by vm.kswapd_threads leaves it to the rest */
+	if (!all_zones_ok && !kthread_should_stop()) {
 		cond_resched();
 
 		try_to_freeze();
@@ -2214,7 +2237,7 @@ static int kswapd(void *p)
 	set_freezable();
 
 	order = 0;
-	for ( ; ; ) {
+	while (!kthread_should_stop()) {
 		unsigned long new_order;
 
 		prepare_to_wait(&pgdat->kswapd_wait, &wait, TASK_INTERRUPTIBLE);
@@ -2234,6 +2257,8 @@ static int kswapd(void *p)
 		}
 		finish_wait(&pgdat->kswapd_wait, &wait);
 
+		if (kthread_should_stop())
+			break;
 		if (!try_to_freeze()) {
 			/* We can speed up thawing tasks if we don't call
 			 * balance_pgdat after returning from the refrigerator
@@ -2241,6 +2266,11 @@ static int kswapd(void *p)
 			balance_pgdat(pgdat, order);
 		}
 	}
+
+	/* Stopped by vm.kswapd_threads: don't exit as a reclaimer */
+	tsk->flags &= ~(PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD);
+	current->reclaim_state = NULL;
+	lockdep_clear_current_reclaim_state();
 	return 0;
 }
 
@@ -2280,7 +2310,7 @@ unsigned long global_reclaimable_pages(void)
 	nr = global_page_state(NR_ACTIVE_FILE) +
 	     global_page_state(NR_INACTIVE_FILE);
 
-	if (nr_swap_pages > 0)
+	if (get_nr_swap_pages() > 0)
 		nr += global_page_state(NR_ACTIVE_ANON) +
 		      global_page_state(NR_INACTIVE_ANON);
 
@@ -2294,13 +2324,135 @@ unsigned long zone_reclaimable_pages(struct zone *zone)
 	nr = zone_page_state(zone, NR_ACTIVE_FILE) +
 	     zone_page_state(zone, NR_INACTIVE_FILE);
 
-	if (nr_swap_pages > 0)
+	if (get_nr_swap_pages() > 0)
 		nr += zone_page_state(zone, NR_ACTIVE_ANON) +
 		      zone_page_state(zone, NR_INACTIVE_ANON);
 
 	return nr;
 }
 
+struct idle_reclaim {
+	struct vm_area_struct *vma;
+	int age;
+	unsigned long nr_to_reclaim;
+	unsigned long nr_reclaimed;
+};
+
+static unsigned long reclaim_page_list(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.swap_cluster_max = SWAP_CLUSTER_MAX,
+		.swappiness = vm_swappiness,
+		.order = 0,
+	};
+	unsigned long nr_reclaimed;
+	struct page *page;
+
+	/* The pages are idle, whatever list they were isolated from */
+	list_for_each_entry(page, page_list, lru)
+		ClearPageActive(page);
+
+	nr_reclaimed = shrink_page_list(page_list, &sc, PAGEOUT_IO_ASYNC);
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+	return nr_reclaimed;
+}
+
+/*
+ * Isolate the pages of @ir->age in this page table page and reclaim them.
+ * The batch is at most one page table page worth of pages, so it is not
+ * accounted as NR_ISOLATED_*.
+ */
+static int idle_reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct idle_reclaim *ir = walk->private;
+	struct vm_area_struct *vma = ir->vma;
+	unsigned long nr_isolated = 0;
+	LIST_HEAD(page_list);
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent) || pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || page_idle_age(page) != ir->age)
+			continue;
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, &page_list);
+		if (ir->nr_reclaimed + ++nr_isolated >= ir->nr_to_reclaim)
+			break;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	if (nr_isolated)
+		ir->nr_reclaimed += reclaim_page_list(&page_list);
+	cond_resched();
+
+	/* Stop the walk once the target is met */
+	return ir->nr_reclaimed >= ir->nr_to_reclaim;
+}
+
+/**
+ * reclaim_idle_pages - proactively reclaim the idle memory of a process
+ * @mm: address space to reclaim from, its mmap_sem held for reading
+ * @nr_pages: number of pages to reclaim
+ * @min_age: minimum idle age of the pages to reclaim
+ *
+ * Reclaims the pages mapped by @mm that have not been accessed for at
+ * least @min_age samples, oldest first, until @nr_pages pages are freed.
+ * Pages that are shared with other processes are reclaimed as well, as
+ * long as they are idle as far as @mm is concerned.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long reclaim_idle_pages(struct mm_struct *mm, unsigned long nr_pages,
+				 int min_age)
+{
+	struct idle_reclaim ir = {
+		.nr_to_reclaim = nr_pages,
+	};
+	struct mm_walk idle_reclaim_walk = {
+		.pmd_entry = idle_reclaim_pte_range,
+		.mm = mm,
+		.private = &ir,
+	};
+	struct vm_area_struct *vma;
+
+	if (min_age < 1)
+		min_age = 1;
+
+	for (ir.age = IDLE_AGE_MAX; ir.age >= min_age; ir.age--) {
+		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+			if (is_vm_hugetlb_page(vma) ||
+			    (vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP)))
+				continue;
+			ir.vma = vma;
+			if (walk_page_range(vma->vm_start, vma->vm_end,
+					    &idle_reclaim_walk))
+				return ir.nr_reclaimed;
+			if (fatal_signal_pending(current))
+				return ir.nr_reclaimed;
+		}
+	}
+	return ir.nr_reclaimed;
+}
+
 #ifdef CONFIG_HIBERNATION
 /*
  * Helper function for shrink_all_memory().  Tries to reclaim 'nr_pages' pages
@@ -2452,6 +2604,8 @@ out:
    not required for correctness.  So if the last cpu in a node goes
    away, we get changed to run anywhere: as the first one comes back,
    restore their cpu bindings. */
+static DEFINE_MUTEX(kswapd_threads_lock);
+
 static int __devinit cpu_callback(struct notifier_block *nfb,
 				  unsigned long action, void *hcpu)
 {
@@ -2464,33 +2618,92 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 
 			mask = cpumask_of_node(pgdat->node_id);
 
-			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids) {
+				int i;
+
 				/* One of our CPUs online: restore mask */
-				set_cpus_allowed_ptr(pgdat->kswapd, mask);
+				mutex_lock(&kswapd_threads_lock);
+				for (i = 0; i < MAX_KSWAPD_THREADS; i++)
+					if (pgdat->kswapd[i])
+						set_cpus_allowed_ptr(
+							pgdat->kswapd[i], mask);
+				mutex_unlock(&kswapd_threads_lock);
+			}
 		}
 	}
 	return NOTIFY_OK;
 }
 
+/*
+ * Start or stop the kswapd threads of a node so that it has kswapd_threads
+ * of them.  Called with kswapd_threads_lock held.
+ */
+static int __kswapd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	struct task_struct *tsk;
+	int i;
+
+	for (i = MAX_KSWAPD_THREADS - 1; i >= kswapd_threads; i--) {
+		if (pgdat->kswapd[i]) {
+			kthread_stop(pgdat->kswapd[i]);
+			pgdat->kswapd[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < kswapd_threads; i++) {
+		if (pgdat->kswapd[i])
+			continue;
+
+		if (i)
+			tsk = kthread_run(kswapd, pgdat, "kswapd%d:%d", nid, i);
+		else
+			tsk = kthread_run(kswapd, pgdat, "kswapd%d", nid);
+		if (IS_ERR(tsk)) {
+			/* failure at boot is fatal */
+			BUG_ON(system_state == SYSTEM_BOOTING);
+			printk("Failed to start kswapd on node %d\n",nid);
+			return -1;
+		}
+		pgdat->kswapd[i] = tsk;
+	}
+	return 0;
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
  */
 int kswapd_run(int nid)
 {
-	pg_data_t *pgdat = NODE_DATA(nid);
-	int ret = 0;
+	int ret;
 
-	if (pgdat->kswapd)
-		return 0;
+	mutex_lock(&kswapd_threads_lock);
+	ret = __kswapd_run(nid);
+	mutex_unlock(&kswapd_threads_lock);
+	return ret;
+}
+
+/*
+ * The number of kswapd threads per node.  They all reclaim from the whole
+ * node in parallel: each of them isolates its own batches from the LRU
+ * lists, so on big nodes with fast allocators they keep up where a single
+ * thread would leave the allocators to direct reclaim.
+ */
+int kswapd_threads = 1;
+
+int kswapd_threads_sysctl_handler(ctl_table *table, int write,
+	void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int nid, ret;
 
-	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
-	if (IS_ERR(pgdat->kswapd)) {
-		/* failure at boot is fatal */
-		BUG_ON(system_state == SYSTEM_BOOTING);
-		printk("Failed to start kswapd on node %d\n",nid);
-		ret = -1;
+	mutex_lock(&kswapd_threads_lock);
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (write && !ret) {
+		for_each_node_state(nid, N_HIGH_MEMORY)
+			__kswapd_run(nid);
 	}
+	mutex_unlock(&kswapd_threads_lock);
 	return ret;
 }
 
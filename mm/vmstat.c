@@ -652,6 +652,7 @@ static const char * const vmstat_text[] = {
 	"nr_slab_reclaimable",
 	"nr_slab_unreclaimable",
 	"nr_page_table_pages",
+	"nr_page_table_pages_saved",
 	"nr_kernel_stack",
 	"nr_unstable",
 	"nr_bounce",
@@ -660,6 +661,8 @@ static const char * const vmstat_text[] = {
 	"nr_isolated_anon",
 	"nr_isolated_file",
 	"nr_shmem",
+	"workingset_refault",
+	"workingset_activate",
 #ifdef CONFIG_NUMA
 	"numa_hit",
 	"numa_miss",
@@ -698,11 +701,20 @@ static const char * const vmstat_text[] = {
 	"kswapd_inodesteal",
 	"pageoutrun",
 	"allocstall",
+	"allocstall_avoided",
 
 	"pgrotated",
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
+#endif
+#ifdef CONFIG_HUGETLBFS
+	"shm_hugepage_alloc",
+	"shm_hugepage_fallback",
+#endif
+#ifdef CONFIG_SHARED_PAGE_TABLES
+	"pgtable_share",
+	"pgtable_unshare",
 #endif
 	"unevictable_pgs_culled",
 	"unevictable_pgs_scanned",
@@ -712,6 +724,12 @@ static const char * const vmstat_text[] = {
 	"unevictable_pgs_cleared",
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
+#ifdef CONFIG_NUMA_BALANCING
+	"numa_pte_updates",
+	"numa_hint_faults",
+	"numa_hint_faults_local",
+	"numa_pages_migrated",
+#endif
 #endif
 };
 
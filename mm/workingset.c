@@ -0,0 +1,180 @@
+/*
+ * mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * Released under the GPL, see the file COPYING for details.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/module.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/vmstat.h>
+
+/*
+ *		Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the
+ * inactive and the active list.  Freshly faulted pages start out at
+ * the head of the inactive list and page reclaim scans pages from the
+ * tail.  Pages that are accessed multiple times on the inactive list
+ * are promoted to the active list, to protect them from reclaim,
+ * whereas active pages are demoted to the inactive list when the
+ * active list grows too big.
+ *
+ * The inactive list alone cannot tell a stream of used-once pages
+ * (e.g. a backup reading through a large file) from a working set that
+ * is only slightly bigger than the inactive list: in both cases pages
+ * fall off the tail of the inactive list before they are accessed a
+ * second time, and the active list stays unchallenged.
+ *
+ *		Approximating inactive page access frequency
+ *
+ * Consider the number of evictions and activations of the zone's
+ * inactive list as a clock (zone->inactive_age).  Each eviction moves
+ * every page on the inactive list one slot closer to the tail, and so
+ * does each activation, because it removes a page ahead of them.
+ *
+ * When a page is evicted, the current value of the clock is stored in
+ * the page cache slot it leaves behind (a "shadow" entry).  When the
+ * page is faulted back in, the difference between the current clock
+ * and the stored one - the refault distance - is the minimum number of
+ * slots the inactive list would have needed on top of its current size
+ * to keep the page around until the second access.
+ *
+ * The inactive list could only have grown at the expense of the active
+ * list, so if the refault distance is smaller than the number of
+ * active file pages, the page is part of a working set that is
+ * competing for memory with the active pages, and it is activated
+ * right away.  Otherwise it is a used-once page and starts out on the
+ * inactive list like any other new page.
+ *
+ *		Implementation
+ *
+ * Shadow entries are exceptional radix tree entries, so they are
+ * skipped by all the page cache lookup functions.  They are removed
+ * when the slot is reused by a new page, or when the mapping is
+ * truncated.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+/*
+ * Eviction timestamps need to be able to cover the full range of
+ * actionable refaults. However, bits are tight in the radix tree
+ * entry, and after storing the identifier for the zone the page
+ * belongs to, we might not have enough left to represent every
+ * single actionable refault. In that case, we have to sacrifice
+ * granularity for distance, and group evictions into coarser buckets
+ * by shaving off lower timestamp bits.
+ */
+static unsigned int bucket_order __read_mostly;
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction >>= bucket_order;
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *evictionp)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+	*evictionp = entry << bucket_order;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	unsigned long eviction;
+	unsigned long refault;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &eviction);
+
+	refault = atomic_long_read(&zone->inactive_age);
+	refault_distance = (refault - eviction) & EVICTION_MASK;
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+static int __init workingset_init(void)
+{
+	unsigned int timestamp_bits;
+	unsigned int max_order;
+
+	/*
+	 * Calculate the eviction bucket size to cover the longest
+	 * actionable refault distance, which is currently half of
+	 * memory (totalram_pages/2). However, memory hotplug may add
+	 * some more pages at runtime, so keep working with up to
+	 * double the initial memory by using totalram_pages as-is.
+	 */
+	timestamp_bits = BITS_PER_LONG - EVICTION_SHIFT;
+	max_order = fls_long(totalram_pages - 1);
+	if (max_order > timestamp_bits)
+		bucket_order = max_order - timestamp_bits;
+	printk(KERN_INFO "workingset: timestamp_bits=%d max_order=%d "
+	       "bucket_order=%u\n", timestamp_bits, max_order, bucket_order);
+	return 0;
+}
+module_init(workingset_init);
@@ -5234,11 +5234,18 @@ EXPORT_SYMBOL(free_netdev);
  *
  *	Wait for packets currently being received to be done.
  *	Does not block later packets from starting.
+ *
+ *	Under the RTNL, as when devices are unregistered or moved
+ *	between namespaces, use an expedited grace period: everybody
+ *	else waiting for the RTNL waits for this one too.
  */
 void synchronize_net(void)
 {
 	might_sleep();
-	synchronize_rcu();
+	if (rtnl_is_locked())
+		synchronize_rcu_expedited();
+	else
+		synchronize_rcu();
 }
 EXPORT_SYMBOL(synchronize_net);
 